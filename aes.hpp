@@ -5,11 +5,17 @@
 #include <algorithm>
 #include <array>
 #include <bit>
+#include <cstddef>
 #include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include "aes_stats.hpp"
 
 namespace cheap_aes
 {
-    template <int Nk, int Nb, int Nr>
+    // Stats is the instrumentation policy, see aes_stats.hpp
+    template <int Nk, int Nb, int Nr, class Stats = no_stats>
     class aes_base
     {
     public:
@@ -19,59 +25,108 @@ namespace cheap_aes
         using key_array = std::array<std::uint8_t, key_size()>;
         using block_array = std::array<std::uint8_t, block_size()>;
         using work_array = std::array<std::uint32_t, work_size()>;
+        using stats_type = Stats;
 
     private:
         work_array w;
+        work_array dw;
 
     public:
         constexpr aes_base() {}
 
         constexpr explicit aes_base(const std::uint8_t key[4*Nk]) {
-            key_expansion(&key[0], &w[0]);
+            set_key(&key[0]);
         }
 
         constexpr explicit aes_base(const key_array& key) {
-            key_expansion(&key[0], &w[0]);
+            set_key(&key[0]);
         }
 
         constexpr void set(const std::uint8_t key[4*Nk]) {
-            key_expansion(&key[0], &w[0]);
+            set_key(&key[0]);
         }
 
         constexpr void set(const key_array& key) {
-            key_expansion(&key[0], &w[0]);
+            set_key(&key[0]);
         }
 
         constexpr void encrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
+            Stats::blocks(1);
             cipher(&in[0], &out[0], &w[0]);
         }
 
         constexpr void encrypt(const block_array& in, block_array& out) const {
+            Stats::blocks(1);
             cipher(&in[0], &out[0], &w[0]);
         }
 
         constexpr block_array encrypt(const block_array& in) const {
             block_array out;
+            Stats::blocks(1);
             cipher(&in[0], &out[0], &w[0]);
             return out;
         }
 
         constexpr void decrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
-            inv_cipher(&in[0], &out[0], &w[0]);
+            Stats::blocks(1);
+            inv_cipher(&in[0], &out[0], &w[0], &dw[0]);
         }
 
         constexpr void decrypt(const block_array& in, block_array& out) const {
-            inv_cipher(&in[0], &out[0], &w[0]);
+            Stats::blocks(1);
+            inv_cipher(&in[0], &out[0], &w[0], &dw[0]);
         }
 
         constexpr block_array decrypt(const block_array& in) const {
             block_array out;
-            inv_cipher(&in[0], &out[0], &w[0]);
+            Stats::blocks(1);
+            inv_cipher(&in[0], &out[0], &w[0], &dw[0]);
             return out;
         }
 
+        // the FIPS 197 key schedule, one big-endian word per column
+        constexpr const work_array& round_keys() const {
+            return w;
+        }
+
+        // the Equivalent Inverse Cipher schedule, last round first
+        constexpr const work_array& inv_round_keys() const {
+            return dw;
+        }
+
+        // ECB over nblocks consecutive blocks
+        constexpr void encrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks) const {
+            typename Stats::call scope(nblocks * block_size());
+            Stats::blocks(nblocks);
+            for (std::size_t i = 0; i < nblocks; i++)
+                cipher(&in[4*Nb*i], &out[4*Nb*i], &w[0]);
+        }
+
+        constexpr void encrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check_blocks(in, out);
+            encrypt_blocks(in.data(), out.data(), in.size() / block_size());
+        }
+
+        constexpr void decrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks) const {
+            typename Stats::call scope(nblocks * block_size());
+            Stats::blocks(nblocks);
+            for (std::size_t i = 0; i < nblocks; i++)
+                inv_cipher(&in[4*Nb*i], &out[4*Nb*i], &w[0], &dw[0]);
+        }
+
+        constexpr void decrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check_blocks(in, out);
+            decrypt_blocks(in.data(), out.data(), in.size() / block_size());
+        }
+
     private:
-        static constexpr void key_expansion(const std::uint8_t key[4*Nk], std::uint32_t w[Nb*(Nr+1)]) {
+        constexpr void set_key(const std::uint8_t key[4*Nk]) {
+            Stats::key_setup();
+            Stats::inv_schedule();
+            key_expansion(&key[0], &w[0], &dw[0]);
+        }
+
+        static constexpr void key_expansion(const std::uint8_t key[4*Nk], std::uint32_t w[Nb*(Nr+1)], std::uint32_t dw[Nb*(Nr+1)]) {
             for (int i = 0; i < Nk; i++)
                 w[i] = word(key[4*i], key[4*i+1], key[4*i+2], key[4*i+3]);
 
@@ -83,6 +138,21 @@ namespace cheap_aes
                     temp = sub_word(temp);
                 w[i] = w[i-Nk] ^ temp;
             }
+
+            // Equivalent Inverse Cipher (FIPS 197 5.3.5) for the table driven inv_cipher
+            for (int round = 0; round <= Nr; round++) {
+                for (int i = 0; i < Nb; i++) {
+                    auto k = w[(Nr-round)*Nb + i];
+                    dw[round*Nb + i] = (round == 0 || round == Nr) ? k : inv_mix_word(k);
+                }
+            }
+        }
+
+        static constexpr std::uint32_t inv_mix_word(std::uint32_t k) {
+            return td[0][sbox[k >> 24]] ^
+                td[1][sbox[k >> 16 & 0xff]] ^
+                td[2][sbox[k >> 8 & 0xff]] ^
+                td[3][sbox[k & 0xff]];
         }
 
         static constexpr std::uint32_t word(std::uint8_t a, std::uint8_t b, std::uint8_t c, std::uint8_t d) {
@@ -101,6 +171,11 @@ namespace cheap_aes
         }
 
         static constexpr void cipher(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb], const std::uint32_t w[Nb*(Nr+1)]) {
+            if (!std::is_constant_evaluated() && Nb == 4) {
+                cipher_table(in, out, w);
+                return;
+            }
+
             std::uint8_t state[4*Nb];
             std::ranges::copy(in, in+4*Nb, state);
 
@@ -173,7 +248,13 @@ namespace cheap_aes
             return (n & 0x80) ? (n2 ^ 0x1b) : n2;
         }
 
-        static constexpr void inv_cipher(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb], const std::uint32_t w[Nb*(Nr+1)]) {
+        static constexpr void inv_cipher(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb],
+                                         const std::uint32_t w[Nb*(Nr+1)], const std::uint32_t dw[Nb*(Nr+1)]) {
+            if (!std::is_constant_evaluated() && Nb == 4) {
+                inv_cipher_table(in, out, dw);
+                return;
+            }
+
             std::uint8_t state[4*Nb];
             std::copy(in, in+4*Nb, state);
 
@@ -221,6 +302,69 @@ namespace cheap_aes
             }
         }
 
+        static constexpr void check_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+            if (in.size() % block_size() != 0)
+                throw std::invalid_argument("cheap_aes: input is not a multiple of the block size");
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+        }
+
+        // T-table rounds on column words, taken at run time instead of the byte-wise code above
+        static void cipher_table(const std::uint8_t in[16], std::uint8_t out[16], const std::uint32_t w[4*(Nr+1)]) {
+            auto s0 = load_word(&in[0]) ^ w[0];
+            auto s1 = load_word(&in[4]) ^ w[1];
+            auto s2 = load_word(&in[8]) ^ w[2];
+            auto s3 = load_word(&in[12]) ^ w[3];
+
+            for (int round = 1; round < Nr; round++) {
+                auto rk = &w[round*4];
+                auto t0 = te[0][s0 >> 24] ^ te[1][s1 >> 16 & 0xff] ^ te[2][s2 >> 8 & 0xff] ^ te[3][s3 & 0xff] ^ rk[0];
+                auto t1 = te[0][s1 >> 24] ^ te[1][s2 >> 16 & 0xff] ^ te[2][s3 >> 8 & 0xff] ^ te[3][s0 & 0xff] ^ rk[1];
+                auto t2 = te[0][s2 >> 24] ^ te[1][s3 >> 16 & 0xff] ^ te[2][s0 >> 8 & 0xff] ^ te[3][s1 & 0xff] ^ rk[2];
+                auto t3 = te[0][s3 >> 24] ^ te[1][s0 >> 16 & 0xff] ^ te[2][s1 >> 8 & 0xff] ^ te[3][s2 & 0xff] ^ rk[3];
+                s0 = t0, s1 = t1, s2 = t2, s3 = t3;
+            }
+
+            auto rk = &w[Nr*4];
+            store_word(&out[0], word(sbox[s0 >> 24], sbox[s1 >> 16 & 0xff], sbox[s2 >> 8 & 0xff], sbox[s3 & 0xff]) ^ rk[0]);
+            store_word(&out[4], word(sbox[s1 >> 24], sbox[s2 >> 16 & 0xff], sbox[s3 >> 8 & 0xff], sbox[s0 & 0xff]) ^ rk[1]);
+            store_word(&out[8], word(sbox[s2 >> 24], sbox[s3 >> 16 & 0xff], sbox[s0 >> 8 & 0xff], sbox[s1 & 0xff]) ^ rk[2]);
+            store_word(&out[12], word(sbox[s3 >> 24], sbox[s0 >> 16 & 0xff], sbox[s1 >> 8 & 0xff], sbox[s2 & 0xff]) ^ rk[3]);
+        }
+
+        static void inv_cipher_table(const std::uint8_t in[16], std::uint8_t out[16], const std::uint32_t dw[4*(Nr+1)]) {
+            auto s0 = load_word(&in[0]) ^ dw[0];
+            auto s1 = load_word(&in[4]) ^ dw[1];
+            auto s2 = load_word(&in[8]) ^ dw[2];
+            auto s3 = load_word(&in[12]) ^ dw[3];
+
+            for (int round = 1; round < Nr; round++) {
+                auto rk = &dw[round*4];
+                auto t0 = td[0][s0 >> 24] ^ td[1][s3 >> 16 & 0xff] ^ td[2][s2 >> 8 & 0xff] ^ td[3][s1 & 0xff] ^ rk[0];
+                auto t1 = td[0][s1 >> 24] ^ td[1][s0 >> 16 & 0xff] ^ td[2][s3 >> 8 & 0xff] ^ td[3][s2 & 0xff] ^ rk[1];
+                auto t2 = td[0][s2 >> 24] ^ td[1][s1 >> 16 & 0xff] ^ td[2][s0 >> 8 & 0xff] ^ td[3][s3 & 0xff] ^ rk[2];
+                auto t3 = td[0][s3 >> 24] ^ td[1][s2 >> 16 & 0xff] ^ td[2][s1 >> 8 & 0xff] ^ td[3][s0 & 0xff] ^ rk[3];
+                s0 = t0, s1 = t1, s2 = t2, s3 = t3;
+            }
+
+            auto rk = &dw[Nr*4];
+            store_word(&out[0], word(inv_sbox[s0 >> 24], inv_sbox[s3 >> 16 & 0xff], inv_sbox[s2 >> 8 & 0xff], inv_sbox[s1 & 0xff]) ^ rk[0]);
+            store_word(&out[4], word(inv_sbox[s1 >> 24], inv_sbox[s0 >> 16 & 0xff], inv_sbox[s3 >> 8 & 0xff], inv_sbox[s2 & 0xff]) ^ rk[1]);
+            store_word(&out[8], word(inv_sbox[s2 >> 24], inv_sbox[s1 >> 16 & 0xff], inv_sbox[s0 >> 8 & 0xff], inv_sbox[s3 & 0xff]) ^ rk[2]);
+            store_word(&out[12], word(inv_sbox[s3 >> 24], inv_sbox[s2 >> 16 & 0xff], inv_sbox[s1 >> 8 & 0xff], inv_sbox[s0 & 0xff]) ^ rk[3]);
+        }
+
+        static constexpr std::uint32_t load_word(const std::uint8_t p[4]) {
+            return word(p[0], p[1], p[2], p[3]);
+        }
+
+        static constexpr void store_word(std::uint8_t p[4], std::uint32_t n) {
+            p[0] = n >> 24;
+            p[1] = n >> 16;
+            p[2] = n >> 8;
+            p[3] = n;
+        }
+
         static constexpr std::uint32_t rcon[11] = {
             0x00000000,
             0x01000000,
@@ -272,6 +416,34 @@ namespace cheap_aes
             0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
             0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d,
         };
+
+        using table_array = std::array<std::array<std::uint32_t, 256>, 4>;
+
+        // te[0][x] is the MixColumns column of sbox[x] in row 0, te[i] is rotated by i rows
+        static constexpr table_array make_te() {
+            table_array t;
+            for (int x = 0; x < 256; x++) {
+                const auto s = sbox[x];
+                const auto e = word(gf256m(2, s), s, s, gf256m(3, s));
+                for (int i = 0; i < 4; i++)
+                    t[i][x] = std::rotr(e, 8*i);
+            }
+            return t;
+        }
+
+        static constexpr table_array make_td() {
+            table_array t;
+            for (int x = 0; x < 256; x++) {
+                const auto s = inv_sbox[x];
+                const auto d = word(gf256m(0x0e, s), gf256m(0x09, s), gf256m(0x0d, s), gf256m(0x0b, s));
+                for (int i = 0; i < 4; i++)
+                    t[i][x] = std::rotr(d, 8*i);
+            }
+            return t;
+        }
+
+        static constexpr table_array te = make_te();
+        static constexpr table_array td = make_td();
     };
 
     using aes128 = aes_base<4, 4, 10>;
@@ -0,0 +1,700 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+//
+// aes-bench: key setup, single-block latency and bulk throughput of each
+// backend, key size, mode and buffer size. Each figure is the median of
+// several timed repetitions after a warm-up, in ns from steady_clock, in
+// TSC ticks from rdtsc and, where perf_event_open is allowed, in core
+// cycles and instructions. Results are written as JSON.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#include <sched.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/random.h>
+#include <sys/syscall.h>
+#endif
+#include "aes_dispatch.hpp"
+#include "aes_bitslice.hpp"
+#include "aes_cbc_x86.hpp"
+#include "aes_drbg_x86.hpp"
+#include "aes_gcm_x86.hpp"
+#include "aes_hash_x86.hpp"
+#include "aes_ocb_x86.hpp"
+#include "aes_xts_x86.hpp"
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    struct options
+    {
+        std::vector<std::string> backends, modes;
+        std::vector<int> key_bits = { 128, 192, 256 };
+        std::size_t max_size = 64 << 20;
+        std::size_t victim_size = 1 << 20;
+        int repeats = 9;
+        int cpu = -1;
+        double min_time = 1e-3;
+        const char* out = nullptr;
+    };
+
+    bool selected(const std::vector<std::string>& list, const std::string& name)
+    {
+        return list.empty() || std::find(list.begin(), list.end(), name) != list.end();
+    }
+
+    std::vector<std::string> split(const char* s)
+    {
+        std::vector<std::string> out;
+        std::string cur;
+        for (; *s; s++) {
+            if (*s == ',') {
+                out.push_back(cur);
+                cur.clear();
+            } else {
+                cur += *s;
+            }
+        }
+        out.push_back(cur);
+        return out;
+    }
+
+    template <class T>
+    inline void keep(const T& x)
+    {
+        asm volatile("" : : "r,m"(x) : "memory");
+    }
+
+    // cycles and instructions of this thread, user space only
+    class perf_counters
+    {
+    private:
+        int leader = -1, member = -1;
+
+    public:
+        perf_counters() {
+#if defined(__linux__)
+            leader = open(PERF_COUNT_HW_CPU_CYCLES, -1);
+            if (leader >= 0)
+                member = open(PERF_COUNT_HW_INSTRUCTIONS, leader);
+            if (member < 0 && leader >= 0) {
+                ::close(leader);
+                leader = -1;
+            }
+#endif
+        }
+
+        ~perf_counters() {
+            if (member >= 0) ::close(member);
+            if (leader >= 0) ::close(leader);
+        }
+
+        bool ok() const { return leader >= 0; }
+
+        void start() {
+#if defined(__linux__)
+            if (ok()) {
+                ::ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ::ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+#endif
+        }
+
+        // cycles, instructions
+        std::pair<double, double> stop() {
+#if defined(__linux__)
+            if (ok()) {
+                ::ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+                std::uint64_t v[3] = {};
+                if (::read(leader, v, sizeof(v)) == sizeof(v))
+                    return { (double)v[1], (double)v[2] };
+            }
+#endif
+            return { 0, 0 };
+        }
+
+    private:
+#if defined(__linux__)
+        static int open(std::uint64_t config, int group) {
+            perf_event_attr attr = {};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = config;
+            attr.disabled = group < 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            return (int)::syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+        }
+#endif
+    };
+
+    struct result
+    {
+        const char* kind = "";
+        std::string backend, mode;
+        int key_bits = 0;
+        std::size_t size = 0;
+        std::size_t iterations = 0;
+        double median = 0, p10 = 0, p90 = 0, min = 0;  // ns per call
+        double tsc = 0, cycles = 0, instructions = 0;  // per call, medians
+    };
+
+    class bench
+    {
+    private:
+        const options& opt;
+        perf_counters perf;
+        std::vector<result> results;
+
+    public:
+        explicit bench(const options& opt) : opt(opt) {}
+
+        bool has_perf() const { return perf.ok(); }
+
+        // f() once per call; the calls of one repetition take at least min_time.
+        // Figures are per operation when one call does ops of them.
+        template <class F>
+        void measure(const char* kind, const std::string& backend, const std::string& mode,
+                     int key_bits, std::size_t size, F&& f, unsigned ops = 1) {
+            // doubling the count doubles as the warm-up
+            std::size_t iterations = 1;
+            for (;;) {
+                const auto t0 = clock::now();
+                for (std::size_t i = 0; i < iterations; i++)
+                    f();
+                const std::chrono::duration<double> t = clock::now() - t0;
+                if (t.count() >= opt.min_time || iterations >= (std::size_t(1) << 30))
+                    break;
+                iterations *= 2;
+            }
+
+            samples s;
+            for (int r = 0; r < opt.repeats; r++)
+                s.add(perf, iterations, ops, f);
+            record(kind, backend, mode, key_bits, size, iterations, s);
+        }
+
+        // f() once per repetition after an untimed setup(), for work whose
+        // cost depends on what setup() left in the caches
+        template <class S, class F>
+        void measure_after(const char* kind, const std::string& backend, const std::string& mode,
+                           int key_bits, std::size_t size, S&& setup, F&& f, unsigned ops = 1) {
+            setup();
+            f();
+            samples s;
+            for (int r = 0; r < opt.repeats; r++) {
+                setup();
+                s.add(perf, 1, ops, f);
+            }
+            record(kind, backend, mode, key_bits, size, 1, s);
+        }
+
+
+        void write_json(std::FILE* fp, int cpu, double tsc_hz) const {
+            std::fprintf(fp, "{\n  \"tool\": \"aes-bench\",\n  \"format\": 1,\n");
+            std::fprintf(fp, "  \"cpu\": { \"brand\": \"%s\", \"pinned\": %d, \"tsc_hz\": %.0f, \"best_kernel\": \"%s\" },\n",
+                         cpu_brand().c_str(), cpu, tsc_hz,
+                         cheap_aes::dispatch::kernel_name(cheap_aes::dispatch::best_kernel()));
+            std::fprintf(fp, "  \"repeats\": %d,\n  \"perf_counters\": %s,\n  \"results\": [\n",
+                         opt.repeats, has_perf() ? "true" : "false");
+            for (std::size_t i = 0; i < results.size(); i++) {
+                const auto& r = results[i];
+                std::fprintf(fp, "    { \"kind\": \"%s\", \"backend\": \"%s\", \"mode\": \"%s\", \"key_bits\": %d, "
+                             "\"size\": %zu, \"iterations\": %zu, "
+                             "\"ns\": { \"median\": %.3f, \"p10\": %.3f, \"p90\": %.3f, \"min\": %.3f }, "
+                             "\"tsc\": %.3f",
+                             r.kind, r.backend.c_str(), r.mode.c_str(), r.key_bits,
+                             r.size, r.iterations, r.median, r.p10, r.p90, r.min, r.tsc);
+                if (r.size > 0)
+                    std::fprintf(fp, ", \"mb_per_s\": %.3f, \"tsc_per_byte\": %.4f", r.size / r.median * 1e3, r.tsc / r.size);
+                if (has_perf()) {
+                    std::fprintf(fp, ", \"cycles\": %.3f, \"instructions\": %.3f", r.cycles, r.instructions);
+                    if (r.size > 0)
+                        std::fprintf(fp, ", \"cycles_per_byte\": %.4f", r.cycles / r.size);
+                }
+                std::fprintf(fp, " }%s\n", i + 1 < results.size() ? "," : "");
+            }
+            std::fprintf(fp, "  ]\n}\n");
+        }
+
+    private:
+        struct samples
+        {
+            std::vector<double> ns, tsc, cycles, instructions;
+
+            template <class F>
+            void add(perf_counters& perf, std::size_t iterations, unsigned ops, F&& f) {
+                perf.start();
+                const auto t0 = clock::now();
+                const auto c0 = __rdtsc();
+                for (std::size_t i = 0; i < iterations; i++)
+                    f();
+                const auto c1 = __rdtsc();
+                const std::chrono::duration<double, std::nano> t = clock::now() - t0;
+                const auto [cy, in] = perf.stop();
+                const double n = (double)iterations * ops;
+                ns.push_back(t.count() / n);
+                tsc.push_back(double(c1 - c0) / n);
+                cycles.push_back(cy / n);
+                instructions.push_back(in / n);
+            }
+        };
+
+        void record(const char* kind, const std::string& backend, const std::string& mode,
+                    int key_bits, std::size_t size, std::size_t iterations, const samples& s) {
+            result res{ kind, backend, mode, key_bits, size, iterations };
+            res.median = percentile(s.ns, 50);
+            res.p10 = percentile(s.ns, 10);
+            res.p90 = percentile(s.ns, 90);
+            res.min = percentile(s.ns, 0);
+            res.tsc = percentile(s.tsc, 50);
+            res.cycles = percentile(s.cycles, 50);
+            res.instructions = percentile(s.instructions, 50);
+            results.push_back(res);
+            report(res);
+        }
+
+        static double percentile(std::vector<double> v, int p) {
+            std::sort(v.begin(), v.end());
+            return v[(v.size() - 1) * p / 100];
+        }
+
+        static void report(const result& r) {
+            if (std::strcmp(r.kind, "request") == 0 || std::strcmp(r.kind, "victim") == 0)
+                std::fprintf(stderr, "%-10s %-10s %3d %9zu B %10.1f ns %10.1f tsc\n",
+                             r.backend.c_str(), r.mode.c_str(), r.key_bits, r.size, r.median, r.tsc);
+            else if (r.size > 0)
+                std::fprintf(stderr, "%-10s %-10s %3d %9zu B %10.1f MB/s %8.3f tsc/B\n",
+                             r.backend.c_str(), r.mode.c_str(), r.key_bits, r.size, r.size / r.median * 1e3, r.tsc / r.size);
+            else
+                std::fprintf(stderr, "%-10s %-10s %3d %13s %10.1f ns %10.1f tsc\n",
+                             r.backend.c_str(), r.mode.c_str(), r.key_bits, "", r.median, r.tsc);
+        }
+
+        static std::string cpu_brand() {
+            unsigned r[4];
+            cheap_aes::dispatch::cpuid(0x80000000, 0, r);
+            if (r[0] < 0x80000004)
+                return "";
+            char s[49] = {};
+            for (unsigned i = 0; i < 3; i++) {
+                cheap_aes::dispatch::cpuid(0x80000002 + i, 0, r);
+                std::memcpy(s + 16*i, r, 16);
+            }
+            std::string brand;
+            for (const char* p = s; *p; p++)
+                if (*p != '"' && *p != '\\')
+                    brand += *p;
+            brand.erase(0, brand.find_first_not_of(' '));
+            return brand;
+        }
+    };
+
+    // TSC ticks per second against steady_clock
+    double tsc_hz()
+    {
+        const auto t0 = clock::now();
+        const auto c0 = __rdtsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const auto c1 = __rdtsc();
+        const std::chrono::duration<double> t = clock::now() - t0;
+        return (c1 - c0) / t.count();
+    }
+
+    int pin(int cpu)
+    {
+        cpu_set_t set;
+        if (cpu < 0) {
+            if (sched_getaffinity(0, sizeof(set), &set) != 0)
+                return -1;
+            for (cpu = 0; cpu < CPU_SETSIZE && !CPU_ISSET(cpu, &set); cpu++)
+                ;
+        }
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0 ? cpu : -1;
+    }
+
+    std::vector<std::size_t> sizes(std::size_t max_size)
+    {
+        std::vector<std::size_t> out;
+        for (std::size_t n = 16; n <= max_size; n *= 4)
+            out.push_back(n);
+        return out;
+    }
+
+    struct buffers
+    {
+        std::vector<std::uint8_t> in, out;
+        explicit buffers(std::size_t n) : in(n), out(n) {
+            for (std::size_t i = 0; i < n; i++)
+                in[i] = i * 31 + 7;
+        }
+    };
+
+    template <class AES>
+    void ctr(const AES& aes, std::uint8_t counter[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len)
+    {
+        if constexpr (requires { aes.ctr_crypt(counter, in, out, len); })
+            aes.ctr_crypt(counter, in, out, len);
+        else if constexpr (requires { aes.encrypt_si128(_mm_setzero_si128()); })
+            cheap_aes::x86::ctr_crypt(aes, counter, in, out, len);
+        else
+            cheap_aes::ctr_crypt(aes, counter, in, out, len);
+    }
+
+    // key setup, latency, ECB and CTR for any backend
+    template <class AES, class Make>
+    void bench_cipher(bench& b, const options& opt, buffers& buf, const char* name, int bits, Make&& make)
+    {
+        if (!selected(opt.backends, name))
+            return;
+
+        typename AES::key_array key;
+        for (std::size_t i = 0; i < key.size(); i++)
+            key[i] = i;
+        AES aes = make();
+
+        if (selected(opt.modes, "key-setup"))
+            b.measure("key_setup", name, "key-setup", bits, 0, [&] {
+                key[0]++;
+                aes.set(key);
+                keep(aes);
+            });
+        aes.set(key);
+
+        if (selected(opt.modes, "latency")) {
+            // each block is the previous one encrypted, 64 per call
+            typename AES::block_array x{};
+            b.measure("latency", name, "encrypt", bits, 0, [&] {
+                for (int i = 0; i < 64; i++)
+                    aes.encrypt(x.data(), x.data());
+                keep(x);
+            }, 64);
+            b.measure("latency", name, "decrypt", bits, 0, [&] {
+                for (int i = 0; i < 64; i++)
+                    aes.decrypt(x.data(), x.data());
+                keep(x);
+            }, 64);
+        }
+
+        for (auto size : sizes(opt.max_size)) {
+            if (selected(opt.modes, "ecb-enc"))
+                b.measure("bulk", name, "ecb-enc", bits, size, [&] { aes.encrypt_blocks(buf.in.data(), buf.out.data(), size / 16); });
+            if (selected(opt.modes, "ecb-dec"))
+                b.measure("bulk", name, "ecb-dec", bits, size, [&] { aes.decrypt_blocks(buf.in.data(), buf.out.data(), size / 16); });
+            if (selected(opt.modes, "ctr")) {
+                std::uint8_t counter[16] = {};
+                b.measure("bulk", name, "ctr", bits, size, [&] { ctr(aes, counter, buf.in.data(), buf.out.data(), size); });
+            }
+        }
+    }
+
+    // the x86 mode layers
+    template <class AES>
+    void bench_modes(bench& b, const options& opt, buffers& buf, int bits)
+    {
+        if (!selected(opt.backends, "aesni"))
+            return;
+
+        typename AES::key_array key;
+        for (std::size_t i = 0; i < key.size(); i++)
+            key[i] = i;
+        const AES aes(key);
+        const cheap_aes::x86::gcm_base<AES> gcm(key);
+        const cheap_aes::x86::ocb_base<AES> ocb(key);
+        std::array<std::uint8_t, 2 * sizeof(key)> key2;
+        for (std::size_t i = 0; i < key2.size(); i++)
+            key2[i] = i * 3;
+        const cheap_aes::x86::xts_base<AES> xts(key2.data());
+
+        if (selected(opt.modes, "key-setup-batch")) {
+            // 64 contexts per call, figures per key
+            std::vector<AES> ctxs(64);
+            std::vector<typename AES::key_array> keys(ctxs.size(), key);
+            for (std::size_t n = 0; n < keys.size(); n++)
+                keys[n][1] = n;
+            b.measure("key_setup", "aesni", "key-setup-batch", bits, 0, [&] {
+                keys[0][0]++;
+                AES::set_keys(ctxs, keys);
+                keep(ctxs[0]);
+            }, ctxs.size());
+        }
+
+        std::uint8_t iv[16] = {}, tag[16] = {};
+        for (auto size : sizes(opt.max_size)) {
+            if (selected(opt.modes, "cbc-enc"))
+                b.measure("bulk", "aesni", "cbc-enc", bits, size, [&] { cheap_aes::x86::cbc_encrypt(aes, iv, buf.in.data(), buf.out.data(), size); });
+            if (selected(opt.modes, "cbc-dec"))
+                b.measure("bulk", "aesni", "cbc-dec", bits, size, [&] { cheap_aes::x86::cbc_decrypt(aes, iv, buf.in.data(), buf.out.data(), size); });
+            if (selected(opt.modes, "gcm-seal"))
+                b.measure("bulk", "aesni", "gcm-seal", bits, size, [&] { gcm.seal(iv, 12, nullptr, 0, buf.in.data(), buf.out.data(), size, tag); });
+            if (selected(opt.modes, "gcm-open"))
+                b.measure("bulk", "aesni", "gcm-open", bits, size, [&] { keep(gcm.open(iv, 12, nullptr, 0, buf.in.data(), buf.out.data(), size, tag)); });
+            if (selected(opt.modes, "ocb-seal"))
+                b.measure("bulk", "aesni", "ocb-seal", bits, size, [&] { ocb.seal(iv, 12, nullptr, 0, buf.in.data(), buf.out.data(), size, tag); });
+            if (selected(opt.modes, "ocb-open"))
+                b.measure("bulk", "aesni", "ocb-open", bits, size, [&] { keep(ocb.open(iv, 12, nullptr, 0, buf.in.data(), buf.out.data(), size, tag)); });
+
+            // 4 KiB sectors, or one data unit of the whole buffer below that
+            const auto unit = std::min<std::size_t>(size, 4096);
+            if (selected(opt.modes, "xts-enc"))
+                b.measure("bulk", "aesni", "xts-enc", bits, size, [&] { xts.encrypt_sectors(0, unit, buf.in.data(), buf.out.data(), size); });
+            if (selected(opt.modes, "xts-dec"))
+                b.measure("bulk", "aesni", "xts-dec", bits, size, [&] { xts.decrypt_sectors(0, unit, buf.in.data(), buf.out.data(), size); });
+        }
+
+        bench_streaming(b, opt, buf, aes, bits);
+    }
+
+    // A working set of another task on the same core: a pointer chase over
+    // size bytes in a random order of 64-byte lines, which the hardware
+    // prefetchers cannot follow, so each load costs where its line was left.
+    class victim
+    {
+    private:
+        std::vector<std::size_t> next;
+
+    public:
+        explicit victim(std::size_t size) : next(std::max<std::size_t>(size / 64, 1) * 8) {
+            std::vector<std::size_t> order(next.size() / 8);
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin() + 1, order.end(), std::mt19937(1));
+            for (std::size_t i = 0; i < order.size(); i++)
+                next[8 * order[i]] = 8 * order[(i + 1) % order.size()];
+        }
+
+        std::size_t lines() const { return next.size() / 8; }
+
+        void walk() const {
+            std::size_t p = 0;
+            for (std::size_t i = 0; i < lines(); i++)
+                p = next[p];
+            keep(p);
+        }
+    };
+
+    // ECB and CTR with non-temporal stores, and what a large pass through
+    // the caches or around them costs the victim afterwards, in ns per
+    // victim load. A cached pass moves about 3 bytes of memory traffic per
+    // byte (the input, a read for ownership and a write back of the
+    // output), a streaming one 2.
+    template <class AES>
+    void bench_streaming(bench& b, const options& opt, buffers& buf, const AES& aes, int bits)
+    {
+        using cheap_aes::x86::store_hint;
+        std::uint8_t counter[16] = {};
+        for (auto size : sizes(opt.max_size)) {
+            if (selected(opt.modes, "ecb-enc-nt"))
+                b.measure("bulk", "aesni", "ecb-enc-nt", bits, size,
+                    [&] { aes.encrypt_blocks(buf.in.data(), buf.out.data(), size / 16, store_hint::streaming); });
+            if (selected(opt.modes, "ctr-nt"))
+                b.measure("bulk", "aesni", "ctr-nt", bits, size,
+                    [&] { cheap_aes::x86::ctr_crypt(aes, counter, buf.in.data(), buf.out.data(), size, store_hint::streaming); });
+        }
+
+        if (!selected(opt.modes, "cache-impact"))
+            return;
+        const victim v(opt.victim_size);
+        const auto size = opt.max_size / 16 * 16;
+        const auto after = [&](const char* mode, auto&& pass) {
+            b.measure_after("victim", "aesni", mode, bits, opt.victim_size, [&] {
+                v.walk();
+                pass();
+            }, [&] { v.walk(); }, v.lines());
+        };
+        after("after-none", [] {});
+        for (auto [mode, hint] : { std::pair("after-ecb", store_hint::cached), std::pair("after-ecb-nt", store_hint::streaming) })
+            after(mode, [&] { aes.encrypt_blocks(buf.in.data(), buf.out.data(), size / 16, hint); });
+        for (auto [mode, hint] : { std::pair("after-ctr", store_hint::cached), std::pair("after-ctr-nt", store_hint::streaming) })
+            after(mode, [&] { cheap_aes::x86::ctr_crypt(aes, counter, buf.in.data(), buf.out.data(), size, hint); });
+    }
+
+    // random bytes from the per-thread generator, figures per request
+    template <class F>
+    void bench_random(bench& b, const options& opt, const char* name, int bits, F&& fill)
+    {
+        if (!selected(opt.backends, name) || !selected(opt.modes, "drbg"))
+            return;
+
+        std::uint8_t out[4096];
+        for (std::size_t size : { 16, 64, 256, 4096 })
+            b.measure("request", name, "drbg", bits, size, [&] {
+                fill(out, size);
+                keep(out);
+            });
+    }
+
+    // the plain one-stream loop, as a checksum baseline
+    CHEAP_AES_TARGET("sse4.2")
+    std::uint32_t crc32c(const std::uint8_t* p, std::size_t len)
+    {
+        std::uint64_t crc = ~0u;
+        for (; len >= 8; len -= 8, p += 8) {
+            std::uint64_t x;
+            std::memcpy(&x, p, 8);
+            crc = _mm_crc32_u64(crc, x);
+        }
+        for (; len > 0; len--, p++)
+            crc = _mm_crc32_u8((std::uint32_t)crc, *p);
+        return ~(std::uint32_t)crc;
+    }
+
+    bool has_sse42()
+    {
+        unsigned r[4];
+        cheap_aes::dispatch::cpuid(1, 0, r);
+        return r[2] >> 20 & 1;
+    }
+
+    // hash of short strings against std::hash, figures per string;
+    // checksum of large buffers against CRC32C
+    void bench_hash(bench& b, const options& opt, buffers& buf)
+    {
+        const cheap_aes::x86::aes_hash h(cheap_aes::x86::aes_hash::seed_array{1, 2, 3});
+        if (selected(opt.modes, "hash")) {
+            for (std::size_t size : { 4, 8, 16, 32, 64, 128 }) {
+                std::vector<std::string> strings(64);
+                for (std::size_t i = 0; i < strings.size(); i++)
+                    strings[i].assign((const char*)&buf.in[i * 7], size);
+                if (selected(opt.backends, "aes-hash"))
+                    b.measure("request", "aes-hash", "hash", 0, size, [&] {
+                        std::uint64_t x = 0;
+                        for (auto& s : strings)
+                            x += h.hash(s);
+                        keep(x);
+                    }, strings.size());
+                if (selected(opt.backends, "std-hash"))
+                    b.measure("request", "std-hash", "hash", 0, size, [&] {
+                        std::uint64_t x = 0;
+                        for (auto& s : strings)
+                            x += std::hash<std::string>()(s);
+                        keep(x);
+                    }, strings.size());
+            }
+        }
+
+        if (selected(opt.modes, "checksum")) {
+            for (auto size : sizes(opt.max_size)) {
+                if (selected(opt.backends, "aes-hash"))
+                    b.measure("bulk", "aes-hash", "checksum", 0, size, [&] { keep(h.checksum(buf.in.data(), size)); });
+                if (selected(opt.backends, "crc32c") && has_sse42())
+                    b.measure("bulk", "crc32c", "checksum", 0, size, [&] { keep(crc32c(buf.in.data(), size)); });
+            }
+        }
+    }
+
+    template <int Nk, int Nr>
+    void bench_key_size(bench& b, const options& opt, buffers& buf)
+    {
+        using namespace cheap_aes;
+        const int bits = 32 * Nk;
+        if (std::find(opt.key_bits.begin(), opt.key_bits.end(), bits) == opt.key_bits.end())
+            return;
+
+        bench_cipher<aes_base<Nk, 4, Nr>>(b, opt, buf, "portable", bits, [] { return aes_base<Nk, 4, Nr>(); });
+        bench_cipher<bitslice::aes_base<Nk, 4, Nr>>(b, opt, buf, "bitslice", bits, [] { return bitslice::aes_base<Nk, 4, Nr>(); });
+        bench_random(b, opt, "portable", bits, [](auto... args) { thread_drbg<aes_base<Nk, 4, Nr>>::fill(args...); });
+        if (dispatch::supported(dispatch::kernel::vperm))
+            bench_cipher<vperm::aes_base<Nk, 4, Nr>>(b, opt, buf, "vperm", bits, [] { return vperm::aes_base<Nk, 4, Nr>(); });
+        if (dispatch::supported(dispatch::kernel::aesni)) {
+            bench_cipher<x86::aes_base<Nk, 4, Nr>>(b, opt, buf, "aesni", bits, [] { return x86::aes_base<Nk, 4, Nr>(); });
+            bench_cipher<x86::aes_base<Nk, 4, Nr, x86::key_dir::encrypt>>(b, opt, buf, "aesni-enc", bits,
+                [] { return x86::aes_base<Nk, 4, Nr, x86::key_dir::encrypt>(); });
+            bench_modes<x86::aes_base<Nk, 4, Nr>>(b, opt, buf, bits);
+            bench_random(b, opt, "aesni", bits, [](auto... args) { thread_drbg<x86::aes_base<Nk, 4, Nr, x86::key_dir::encrypt>>::fill(args...); });
+        }
+        for (auto k : { dispatch::kernel::vaes256, dispatch::kernel::vaes512 })
+            if (dispatch::supported(k))
+                bench_cipher<dispatch::aes_base<Nk, 4, Nr>>(b, opt, buf, dispatch::kernel_name(k), bits,
+                    [k] { return dispatch::aes_base<Nk, 4, Nr>(k); });
+    }
+
+    [[noreturn]] void usage()
+    {
+        std::fputs(
+            "usage: aes-bench [options]\n"
+            "  -b list  backends: portable,bitslice,vperm,aesni,aesni-enc,vaes256,vaes512,\n"
+            "           getrandom,aes-hash,std-hash,crc32c\n"
+            "  -m list  modes: key-setup,key-setup-batch,latency,ecb-enc,ecb-dec,ctr,\n"
+            "           cbc-enc,cbc-dec,gcm-seal,gcm-open,ocb-seal,ocb-open,xts-enc,xts-dec,\n"
+            "           drbg,hash,checksum,ecb-enc-nt,ctr-nt,cache-impact\n"
+            "  -k list  key sizes in bits (default 128,192,256)\n"
+            "  -s n     largest buffer in bytes (default 64 MiB), sizes go up from 16 by 4x\n"
+            "  -n n     bytes from which ECB and CTR stream their output (default 32 MiB)\n"
+            "  -w n     working set of the cache-impact victim in bytes (default 1 MiB)\n"
+            "  -r n     timed repetitions (default 9)\n"
+            "  -t sec   shortest repetition (default 0.001)\n"
+            "  -c n     CPU to pin to (default the first allowed one)\n"
+            "  -o file  JSON output (default stdout)\n",
+            stderr);
+        std::exit(2);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    int c;
+    while ((c = ::getopt(argc, argv, "b:m:k:s:n:w:r:t:c:o:")) != -1) {
+        switch (c) {
+        case 'b': opt.backends = split(optarg); break;
+        case 'm': opt.modes = split(optarg); break;
+        case 'k':
+            opt.key_bits.clear();
+            for (auto& s : split(optarg))
+                opt.key_bits.push_back(std::atoi(s.c_str()));
+            break;
+        case 's': opt.max_size = std::strtoull(optarg, nullptr, 0); break;
+        case 'n': cheap_aes::x86::streaming_threshold = std::strtoull(optarg, nullptr, 0); break;
+        case 'w': opt.victim_size = std::strtoull(optarg, nullptr, 0); break;
+        case 'r': opt.repeats = std::max(1, std::atoi(optarg)); break;
+        case 't': opt.min_time = std::atof(optarg); break;
+        case 'c': opt.cpu = std::atoi(optarg); break;
+        case 'o': opt.out = optarg; break;
+        default: usage();
+        }
+    }
+
+    const int cpu = pin(opt.cpu);
+    const auto hz = tsc_hz();
+    bench b(opt);
+    buffers buf(std::max<std::size_t>(opt.max_size, 16));
+
+    bench_key_size<4, 10>(b, opt, buf);
+    bench_key_size<6, 12>(b, opt, buf);
+    bench_key_size<8, 14>(b, opt, buf);
+    if (cheap_aes::dispatch::supported(cheap_aes::dispatch::kernel::aesni))
+        bench_hash(b, opt, buf);
+#if defined(__linux__)
+    // the syscall per request that the DRBG saves
+    bench_random(b, opt, "getrandom", 0, [](std::uint8_t* out, std::size_t len) {
+        if (::getrandom(out, len, 0) != (ssize_t)len)
+            std::abort();
+    });
+#endif
+
+    auto fp = opt.out ? std::fopen(opt.out, "w") : stdout;
+    if (!fp) {
+        std::perror(opt.out);
+        return 1;
+    }
+    b.write_json(fp, cpu, hz);
+    if (fp != stdout)
+        std::fclose(fp);
+}
@@ -0,0 +1,511 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include "aes.hpp"
+
+namespace cheap_aes::bitslice
+{
+    // Constant-time AES without table lookups, after the 64-bit bitsliced
+    // layout of BearSSL's aes_ct64: eight uint64_t hold four blocks, one
+    // bit plane each, and two such sets run through every round together
+    // so that 8 blocks are processed at once. SubBytes is the Boyar-Peralta
+    // circuit. The key schedule is cheap_aes::aes_base's key_expansion.
+    template <int Nk, int Nb, int Nr>
+    class aes_base
+    {
+    public:
+        static constexpr int key_size() { return 4 * Nk; };
+        static constexpr int block_size() { return 4 * Nb; };
+        static constexpr std::size_t parallel_blocks() { return 8; };
+        using key_array = std::array<std::uint8_t, key_size()>;
+        using block_array = std::array<std::uint8_t, block_size()>;
+
+    private:
+        std::uint64_t sk[8*(Nr+1)];
+
+    public:
+        aes_base() {}
+
+        explicit aes_base(const std::uint8_t key[4*Nk]) {
+            set(key);
+        }
+
+        explicit aes_base(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void set(const std::uint8_t key[4*Nk]) {
+            const cheap_aes::aes_base<Nk, Nb, Nr> schedule(key);
+            const auto& w = schedule.round_keys();
+
+            // the round key of each round, repeated for all four blocks of a set
+            for (int round = 0; round <= Nr; round++) {
+                std::uint32_t rk[4];
+                for (int i = 0; i < 4; i++) {
+                    const auto x = w[4*round + i];
+                    rk[i] = x >> 24 | (x >> 8 & 0xff00) | (x << 8 & 0xff0000) | x << 24;
+                }
+                auto q = &sk[8*round];
+                for (int i = 0; i < 4; i++)
+                    interleave_in(q[i], q[i+4], rk);
+                ortho(q);
+            }
+        }
+
+        void set(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void encrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
+            encrypt_blocks(in, out, 1);
+        }
+
+        void encrypt(const block_array& in, block_array& out) const {
+            encrypt_blocks(&in[0], &out[0], 1);
+        }
+
+        block_array encrypt(const block_array& in) const {
+            block_array out;
+            encrypt_blocks(&in[0], &out[0], 1);
+            return out;
+        }
+
+        void decrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
+            decrypt_blocks(in, out, 1);
+        }
+
+        void decrypt(const block_array& in, block_array& out) const {
+            decrypt_blocks(&in[0], &out[0], 1);
+        }
+
+        block_array decrypt(const block_array& in) const {
+            block_array out;
+            decrypt_blocks(&in[0], &out[0], 1);
+            return out;
+        }
+
+        // ECB over nblocks consecutive blocks, 8 per pass
+        void encrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks) const {
+            crypt_blocks<false>(in, out, nblocks);
+        }
+
+        void encrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check_blocks(in, out);
+            crypt_blocks<false>(in.data(), out.data(), in.size() / block_size());
+        }
+
+        void decrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks) const {
+            crypt_blocks<true>(in, out, nblocks);
+        }
+
+        void decrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check_blocks(in, out);
+            crypt_blocks<true>(in.data(), out.data(), in.size() / block_size());
+        }
+
+    private:
+        template <bool Inverse>
+        void crypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t n) const {
+            while (n > 0) {
+                const auto m = std::min<std::size_t>(n, 8);
+                std::uint64_t q[2][8];
+                load(q, in, m);
+                if (Inverse)
+                    decrypt8(q);
+                else
+                    encrypt8(q);
+                store(q, out, m);
+                in += 16*m;
+                out += 16*m;
+                n -= m;
+            }
+        }
+
+        // blocks past m are zero and their output is dropped
+        static void load(std::uint64_t (&q)[2][8], const std::uint8_t* in, std::size_t m) {
+            for (int g = 0; g < 2; g++) {
+                for (int i = 0; i < 4; i++) {
+                    const std::size_t b = 4*g + i;
+                    std::uint32_t w[4] = {};
+                    if (b < m)
+                        for (int j = 0; j < 4; j++)
+                            w[j] = load32le(&in[16*b + 4*j]);
+                    interleave_in(q[g][i], q[g][i+4], w);
+                }
+                ortho(q[g]);
+            }
+        }
+
+        static void store(std::uint64_t (&q)[2][8], std::uint8_t* out, std::size_t m) {
+            for (int g = 0; g < 2; g++) {
+                ortho(q[g]);
+                for (int i = 0; i < 4; i++) {
+                    const std::size_t b = 4*g + i;
+                    if (b >= m)
+                        continue;
+                    std::uint32_t w[4];
+                    interleave_out(w, q[g][i], q[g][i+4]);
+                    for (int j = 0; j < 4; j++)
+                        store32le(&out[16*b + 4*j], w[j]);
+                }
+            }
+        }
+
+        void encrypt8(std::uint64_t (&q)[2][8]) const {
+            for (auto& x : q)
+                add_round_key(x, &sk[0]);
+            for (int round = 1; round < Nr; round++) {
+                for (auto& x : q) {
+                    sub_bytes(x);
+                    shift_rows(x);
+                    mix_columns(x);
+                    add_round_key(x, &sk[8*round]);
+                }
+            }
+            for (auto& x : q) {
+                sub_bytes(x);
+                shift_rows(x);
+                add_round_key(x, &sk[8*Nr]);
+            }
+        }
+
+        void decrypt8(std::uint64_t (&q)[2][8]) const {
+            for (auto& x : q)
+                add_round_key(x, &sk[8*Nr]);
+            for (int round = Nr-1; round > 0; round--) {
+                for (auto& x : q) {
+                    inv_shift_rows(x);
+                    inv_sub_bytes(x);
+                    add_round_key(x, &sk[8*round]);
+                    inv_mix_columns(x);
+                }
+            }
+            for (auto& x : q) {
+                inv_shift_rows(x);
+                inv_sub_bytes(x);
+                add_round_key(x, &sk[0]);
+            }
+        }
+
+        static inline void add_round_key(std::uint64_t q[8], const std::uint64_t sk[8]) {
+            for (int i = 0; i < 8; i++)
+                q[i] ^= sk[i];
+        }
+
+        // Boyar and Peralta, "A depth-16 circuit for the AES S-box"
+        static inline void sub_bytes(std::uint64_t q[8]) {
+            const auto x0 = q[7];
+            const auto x1 = q[6];
+            const auto x2 = q[5];
+            const auto x3 = q[4];
+            const auto x4 = q[3];
+            const auto x5 = q[2];
+            const auto x6 = q[1];
+            const auto x7 = q[0];
+
+            // top linear transformation
+            const auto y14 = x3 ^ x5;
+            const auto y13 = x0 ^ x6;
+            const auto y9 = x0 ^ x3;
+            const auto y8 = x0 ^ x5;
+            const auto t0 = x1 ^ x2;
+            const auto y1 = t0 ^ x7;
+            const auto y4 = y1 ^ x3;
+            const auto y12 = y13 ^ y14;
+            const auto y2 = y1 ^ x0;
+            const auto y5 = y1 ^ x6;
+            const auto y3 = y5 ^ y8;
+            const auto t1 = x4 ^ y12;
+            const auto y15 = t1 ^ x5;
+            const auto y20 = t1 ^ x1;
+            const auto y6 = y15 ^ x7;
+            const auto y10 = y15 ^ t0;
+            const auto y11 = y20 ^ y9;
+            const auto y7 = x7 ^ y11;
+            const auto y17 = y10 ^ y11;
+            const auto y19 = y10 ^ y8;
+            const auto y16 = t0 ^ y11;
+            const auto y21 = y13 ^ y16;
+            const auto y18 = x0 ^ y16;
+
+            // non-linear section
+            const auto t2 = y12 & y15;
+            const auto t3 = y3 & y6;
+            const auto t4 = t3 ^ t2;
+            const auto t5 = y4 & x7;
+            const auto t6 = t5 ^ t2;
+            const auto t7 = y13 & y16;
+            const auto t8 = y5 & y1;
+            const auto t9 = t8 ^ t7;
+            const auto t10 = y2 & y7;
+            const auto t11 = t10 ^ t7;
+            const auto t12 = y9 & y11;
+            const auto t13 = y14 & y17;
+            const auto t14 = t13 ^ t12;
+            const auto t15 = y8 & y10;
+            const auto t16 = t15 ^ t12;
+            const auto t17 = t4 ^ t14;
+            const auto t18 = t6 ^ t16;
+            const auto t19 = t9 ^ t14;
+            const auto t20 = t11 ^ t16;
+            const auto t21 = t17 ^ y20;
+            const auto t22 = t18 ^ y19;
+            const auto t23 = t19 ^ y21;
+            const auto t24 = t20 ^ y18;
+
+            const auto t25 = t21 ^ t22;
+            const auto t26 = t21 & t23;
+            const auto t27 = t24 ^ t26;
+            const auto t28 = t25 & t27;
+            const auto t29 = t28 ^ t22;
+            const auto t30 = t23 ^ t24;
+            const auto t31 = t22 ^ t26;
+            const auto t32 = t31 & t30;
+            const auto t33 = t32 ^ t24;
+            const auto t34 = t23 ^ t33;
+            const auto t35 = t27 ^ t33;
+            const auto t36 = t24 & t35;
+            const auto t37 = t36 ^ t34;
+            const auto t38 = t27 ^ t36;
+            const auto t39 = t29 & t38;
+            const auto t40 = t25 ^ t39;
+
+            const auto t41 = t40 ^ t37;
+            const auto t42 = t29 ^ t33;
+            const auto t43 = t29 ^ t40;
+            const auto t44 = t33 ^ t37;
+            const auto t45 = t42 ^ t41;
+            const auto z0 = t44 & y15;
+            const auto z1 = t37 & y6;
+            const auto z2 = t33 & x7;
+            const auto z3 = t43 & y16;
+            const auto z4 = t40 & y1;
+            const auto z5 = t29 & y7;
+            const auto z6 = t42 & y11;
+            const auto z7 = t45 & y17;
+            const auto z8 = t41 & y10;
+            const auto z9 = t44 & y12;
+            const auto z10 = t37 & y3;
+            const auto z11 = t33 & y4;
+            const auto z12 = t43 & y13;
+            const auto z13 = t40 & y5;
+            const auto z14 = t29 & y2;
+            const auto z15 = t42 & y9;
+            const auto z16 = t45 & y14;
+            const auto z17 = t41 & y8;
+
+            // bottom linear transformation
+            const auto t46 = z15 ^ z16;
+            const auto t47 = z10 ^ z11;
+            const auto t48 = z5 ^ z13;
+            const auto t49 = z9 ^ z10;
+            const auto t50 = z2 ^ z12;
+            const auto t51 = z2 ^ z5;
+            const auto t52 = z7 ^ z8;
+            const auto t53 = z0 ^ z3;
+            const auto t54 = z6 ^ z7;
+            const auto t55 = z16 ^ z17;
+            const auto t56 = z12 ^ t48;
+            const auto t57 = t50 ^ t53;
+            const auto t58 = z4 ^ t46;
+            const auto t59 = z3 ^ t54;
+            const auto t60 = t46 ^ t57;
+            const auto t61 = z14 ^ t57;
+            const auto t62 = t52 ^ t58;
+            const auto t63 = t49 ^ t58;
+            const auto t64 = z4 ^ t59;
+            const auto t65 = t61 ^ t62;
+            const auto t66 = z1 ^ t63;
+            const auto s0 = t59 ^ t63;
+            const auto s6 = t56 ^ ~t62;
+            const auto s7 = t48 ^ ~t60;
+            const auto t67 = t64 ^ t65;
+            const auto s3 = t53 ^ t66;
+            const auto s4 = t51 ^ t66;
+            const auto s5 = t47 ^ t65;
+            const auto s1 = t64 ^ ~s3;
+            const auto s2 = t55 ^ ~t67;
+
+            q[7] = s0;
+            q[6] = s1;
+            q[5] = s2;
+            q[4] = s3;
+            q[3] = s4;
+            q[2] = s5;
+            q[1] = s6;
+            q[0] = s7;
+        }
+
+        // x -> A^-1(x ^ 0x63), so that InvSubBytes = inv_affine . SubBytes . inv_affine
+        static inline void inv_affine(std::uint64_t q[8]) {
+            const auto q0 = ~q[0];
+            const auto q1 = ~q[1];
+            const auto q2 = q[2];
+            const auto q3 = q[3];
+            const auto q4 = q[4];
+            const auto q5 = ~q[5];
+            const auto q6 = ~q[6];
+            const auto q7 = q[7];
+            q[7] = q1 ^ q4 ^ q6;
+            q[6] = q0 ^ q3 ^ q5;
+            q[5] = q7 ^ q2 ^ q4;
+            q[4] = q6 ^ q1 ^ q3;
+            q[3] = q5 ^ q0 ^ q2;
+            q[2] = q4 ^ q7 ^ q1;
+            q[1] = q3 ^ q6 ^ q0;
+            q[0] = q2 ^ q5 ^ q7;
+        }
+
+        static inline void inv_sub_bytes(std::uint64_t q[8]) {
+            inv_affine(q);
+            sub_bytes(q);
+            inv_affine(q);
+        }
+
+        static inline void shift_rows(std::uint64_t q[8]) {
+            for (int i = 0; i < 8; i++) {
+                const auto x = q[i];
+                q[i] = (x & 0x000000000000ffff)
+                    | (x & 0x00000000fff00000) >> 4
+                    | (x & 0x00000000000f0000) << 12
+                    | (x & 0x0000ff0000000000) >> 8
+                    | (x & 0x000000ff00000000) << 8
+                    | (x & 0xf000000000000000) >> 12
+                    | (x & 0x0fff000000000000) << 4;
+            }
+        }
+
+        static inline void inv_shift_rows(std::uint64_t q[8]) {
+            for (int i = 0; i < 8; i++) {
+                const auto x = q[i];
+                q[i] = (x & 0x000000000000ffff)
+                    | (x & 0x000000000fff0000) << 4
+                    | (x & 0x00000000f0000000) >> 12
+                    | (x & 0x000000ff00000000) << 8
+                    | (x & 0x0000ff0000000000) >> 8
+                    | (x & 0x000f000000000000) << 12
+                    | (x & 0xfff0000000000000) >> 4;
+            }
+        }
+
+        static inline std::uint64_t rotr32(std::uint64_t x) {
+            return std::rotr(x, 32);
+        }
+
+        static inline void mix_columns(std::uint64_t q[8]) {
+            std::uint64_t r[8];
+            for (int i = 0; i < 8; i++)
+                r[i] = std::rotr(q[i], 16);
+
+            const auto q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+            const auto q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+            q[0] = q7 ^ r[7] ^ r[0] ^ rotr32(q0 ^ r[0]);
+            q[1] = q0 ^ r[0] ^ q7 ^ r[7] ^ r[1] ^ rotr32(q1 ^ r[1]);
+            q[2] = q1 ^ r[1] ^ r[2] ^ rotr32(q2 ^ r[2]);
+            q[3] = q2 ^ r[2] ^ q7 ^ r[7] ^ r[3] ^ rotr32(q3 ^ r[3]);
+            q[4] = q3 ^ r[3] ^ q7 ^ r[7] ^ r[4] ^ rotr32(q4 ^ r[4]);
+            q[5] = q4 ^ r[4] ^ r[5] ^ rotr32(q5 ^ r[5]);
+            q[6] = q5 ^ r[5] ^ r[6] ^ rotr32(q6 ^ r[6]);
+            q[7] = q6 ^ r[6] ^ r[7] ^ rotr32(q7 ^ r[7]);
+        }
+
+        static inline void inv_mix_columns(std::uint64_t q[8]) {
+            std::uint64_t r[8];
+            for (int i = 0; i < 8; i++)
+                r[i] = std::rotr(q[i], 16);
+
+            const auto q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+            const auto q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+            const auto r0 = r[0], r1 = r[1], r2 = r[2], r3 = r[3];
+            const auto r4 = r[4], r5 = r[5], r6 = r[6], r7 = r[7];
+            q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^ rotr32(q0 ^ q5 ^ q6 ^ r0 ^ r5);
+            q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^ rotr32(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6);
+            q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^ rotr32(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7);
+            q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5 ^ rotr32(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7);
+            q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7 ^ rotr32(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6);
+            q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7 ^ rotr32(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7);
+            q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^ rotr32(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7);
+            q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^ rotr32(q4 ^ q5 ^ q7 ^ r4 ^ r7);
+        }
+
+        static inline void swap_bits(std::uint64_t& x, std::uint64_t& y, std::uint64_t lo, int s) {
+            const auto a = x, b = y;
+            x = (a & lo) | (b & lo) << s;
+            y = (a & ~lo) >> s | (b & ~lo);
+        }
+
+        // transposes between byte order and bit planes, it is its own inverse
+        static inline void ortho(std::uint64_t q[8]) {
+            swap_bits(q[0], q[1], 0x5555555555555555, 1);
+            swap_bits(q[2], q[3], 0x5555555555555555, 1);
+            swap_bits(q[4], q[5], 0x5555555555555555, 1);
+            swap_bits(q[6], q[7], 0x5555555555555555, 1);
+
+            swap_bits(q[0], q[2], 0x3333333333333333, 2);
+            swap_bits(q[1], q[3], 0x3333333333333333, 2);
+            swap_bits(q[4], q[6], 0x3333333333333333, 2);
+            swap_bits(q[5], q[7], 0x3333333333333333, 2);
+
+            swap_bits(q[0], q[4], 0x0f0f0f0f0f0f0f0f, 4);
+            swap_bits(q[1], q[5], 0x0f0f0f0f0f0f0f0f, 4);
+            swap_bits(q[2], q[6], 0x0f0f0f0f0f0f0f0f, 4);
+            swap_bits(q[3], q[7], 0x0f0f0f0f0f0f0f0f, 4);
+        }
+
+        // spreads the four little-endian words of a block over two slots
+        static inline void interleave_in(std::uint64_t& q0, std::uint64_t& q1, const std::uint32_t w[4]) {
+            std::uint64_t x[4];
+            for (int i = 0; i < 4; i++) {
+                x[i] = w[i];
+                x[i] = (x[i] | x[i] << 16) & 0x0000ffff0000ffff;
+                x[i] = (x[i] | x[i] << 8) & 0x00ff00ff00ff00ff;
+            }
+            q0 = x[0] | x[2] << 8;
+            q1 = x[1] | x[3] << 8;
+        }
+
+        static inline void interleave_out(std::uint32_t w[4], std::uint64_t q0, std::uint64_t q1) {
+            std::uint64_t x[4];
+            x[0] = q0 & 0x00ff00ff00ff00ff;
+            x[1] = q1 & 0x00ff00ff00ff00ff;
+            x[2] = q0 >> 8 & 0x00ff00ff00ff00ff;
+            x[3] = q1 >> 8 & 0x00ff00ff00ff00ff;
+            for (int i = 0; i < 4; i++) {
+                x[i] = (x[i] | x[i] >> 8) & 0x0000ffff0000ffff;
+                w[i] = (std::uint32_t)x[i] | (std::uint32_t)(x[i] >> 16);
+            }
+        }
+
+        static std::uint32_t load32le(const std::uint8_t p[4]) {
+            return p[0] | p[1] << 8 | p[2] << 16 | (std::uint32_t)p[3] << 24;
+        }
+
+        static void store32le(std::uint8_t p[4], std::uint32_t n) {
+            p[0] = n;
+            p[1] = n >> 8;
+            p[2] = n >> 16;
+            p[3] = n >> 24;
+        }
+
+        static void check_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+            if (in.size() % block_size() != 0)
+                throw std::invalid_argument("cheap_aes: input is not a multiple of the block size");
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+        }
+
+        static_assert(Nb == 4);
+    };
+
+    using aes128 = aes_base<4, 4, 10>;
+    using aes192 = aes_base<6, 4, 12>;
+    using aes256 = aes_base<8, 4, 14>;
+}
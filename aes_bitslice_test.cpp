@@ -0,0 +1,89 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <stdexcept>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes.hpp"
+#include "aes_bitslice.hpp"
+#include "aes_ctr.hpp"
+
+using namespace cheap_aes::bitslice;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+void test_aes128_bitslice()
+{
+    aes128 aes(0x000102030405060708090a0b0c0d0e0f_bytes);
+    auto text = 0x00112233445566778899aabbccddeeff_bytes;
+    auto enc = aes.encrypt(text);
+    runtime_assert(enc == 0x69c4e0d86a7b0430d8cdb78070b4c55a_bytes);
+    runtime_assert(aes.decrypt(enc) == text);
+}
+
+void test_aes192_bitslice()
+{
+    aes192 aes(0x000102030405060708090a0b0c0d0e0f1011121314151617_bytes);
+    auto text = 0x00112233445566778899aabbccddeeff_bytes;
+    auto enc = aes.encrypt(text);
+    runtime_assert(enc == 0xdda97ca4864cdfe06eaf70a0ec0d7191_bytes);
+    runtime_assert(aes.decrypt(enc) == text);
+}
+
+void test_aes256_bitslice()
+{
+    aes256 aes(0x000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f_bytes);
+    auto text = 0x00112233445566778899aabbccddeeff_bytes;
+    auto enc = aes.encrypt(text);
+    runtime_assert(enc == 0x8ea2b7ca516745bfeafc49904b496089_bytes);
+    runtime_assert(aes.decrypt(enc) == text);
+}
+
+// every tail length of an 8-block pass against the table implementation
+template <class AES, class Ref>
+void test_blocks_bitslice()
+{
+    typename AES::key_array key;
+    for (std::size_t i = 0; i < key.size(); i++)
+        key[i] = i * 5 + 2;
+    AES aes(key);
+    Ref ref(key);
+
+    for (std::size_t n : {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 33}) {
+        std::vector<std::uint8_t> text(16*n);
+        for (std::size_t i = 0; i < text.size(); i++)
+            text[i] = i * 7 + 1;
+
+        std::vector<std::uint8_t> enc(text.size()), expected(text.size());
+        aes.encrypt_blocks(text, enc);
+        ref.encrypt_blocks(text, expected);
+        runtime_assert(enc == expected);
+
+        aes.decrypt_blocks(enc, enc);
+        runtime_assert(enc == text);
+    }
+}
+
+// NIST SP 800-38A F.5.1
+void test_ctr_bitslice()
+{
+    aes128 aes(0x2b7e151628aed2a6abf7158809cf4f3c_bytes);
+    auto ctr = 0xf0f1f2f3f4f5f6f7f8f9fafbfcfdfeff_bytes;
+    auto text = 0x6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e5130c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710_bytes;
+    decltype(text) enc;
+    cheap_aes::ctr_crypt(aes, ctr, text, enc);
+    runtime_assert(enc == 0x874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee_bytes);
+    runtime_assert(ctr == 0xf0f1f2f3f4f5f6f7f8f9fafbfcfdff03_bytes);
+}
+
+int main()
+{
+    test_aes128_bitslice();
+    test_aes192_bitslice();
+    test_aes256_bitslice();
+    test_blocks_bitslice<aes128, cheap_aes::aes128>();
+    test_blocks_bitslice<aes192, cheap_aes::aes192>();
+    test_blocks_bitslice<aes256, cheap_aes::aes256>();
+    test_ctr_bitslice();
+}
@@ -0,0 +1,153 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes_cbc_x86.hpp"
+
+using namespace cheap_aes::x86;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+// NIST SP 800-38A F.2
+constexpr auto sp800_38a_iv = 0x000102030405060708090a0b0c0d0e0f_bytes;
+constexpr auto sp800_38a_text =
+    0x6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e5130c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710_bytes;
+
+template <class AES, std::size_t N>
+void test_cbc_vector(const typename AES::key_array& key, const std::array<std::uint8_t, N>& expected)
+{
+    AES aes(key);
+    auto iv = sp800_38a_iv;
+    std::array<std::uint8_t, N> enc;
+    cbc_encrypt(aes, iv, sp800_38a_text, enc);
+    runtime_assert(enc == expected);
+    runtime_assert(std::memcmp(iv.data(), &expected[N-16], 16) == 0);
+
+    // in place, chained over two calls
+    iv = sp800_38a_iv;
+    cbc_decrypt(aes, iv.data(), enc.data(), enc.data(), 16);
+    cbc_decrypt(aes, iv.data(), enc.data() + 16, enc.data() + 16, N - 16);
+    runtime_assert(enc == sp800_38a_text);
+}
+
+void test_cbc_aes128_x86()
+{
+    test_cbc_vector<aes128>(
+        0x2b7e151628aed2a6abf7158809cf4f3c_bytes,
+        0x7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b273bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7_bytes);
+}
+
+void test_cbc_aes256_x86()
+{
+    test_cbc_vector<aes256>(
+        0x603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4_bytes,
+        0xf58c4c04d6e5f1ba779eabfb5f7bfbd69cfc4e967edb808d679f777bc6702c7d39f23369a9d9bacfa530e26304231461b2eb05e2c39be9fcda6c19078c6a9d1b_bytes);
+}
+
+// the 8/4/1-wide decrypt against serial encryption, in place
+void test_cbc_long_x86()
+{
+    aes128 aes(0x000102030405060708090a0b0c0d0e0f_bytes);
+    for (std::size_t n : {1, 3, 4, 5, 8, 9, 12, 13, 16, 17, 100}) {
+        std::vector<std::uint8_t> text(16*n), buf(16*n);
+        for (std::size_t i = 0; i < text.size(); i++)
+            text[i] = i * 11 + 3;
+        auto iv = sp800_38a_iv;
+        cbc_encrypt(aes, iv, text, buf);
+        auto last = iv;
+
+        iv = sp800_38a_iv;
+        cbc_decrypt(aes, iv, buf, buf);
+        runtime_assert(buf == text);
+        runtime_assert(iv == last);
+    }
+}
+
+// streams of different lengths, with empty ones, against one call each;
+// lanes are refilled several times
+void test_cbc_streams_x86()
+{
+    aes128 aes(0x000102030405060708090a0b0c0d0e0f_bytes);
+    const std::size_t lens[] = {5, 0, 1, 17, 3, 3, 8, 2, 40, 11, 6, 1, 0, 9, 2, 25, 4, 1, 13, 7};
+    constexpr std::size_t count = std::size(lens);
+
+    std::vector<std::vector<std::uint8_t>> text(count), enc(count);
+    std::vector<aes128::block_array> iv(count);
+    std::vector<cbc_stream> streams(count);
+    for (std::size_t s = 0; s < count; s++) {
+        text[s].resize(16*lens[s]);
+        enc[s].resize(16*lens[s]);
+        for (std::size_t i = 0; i < text[s].size(); i++)
+            text[s][i] = i * 7 + s;
+        for (std::size_t i = 0; i < 16; i++)
+            iv[s][i] = i + 16*s;
+        streams[s] = { iv[s].data(), text[s].data(), enc[s].data(), text[s].size() };
+    }
+    cbc_encrypt_streams(aes, std::span(streams));
+
+    for (std::size_t s = 0; s < count; s++) {
+        aes128::block_array ref_iv;
+        for (std::size_t i = 0; i < 16; i++)
+            ref_iv[i] = i + 16*s;
+        std::vector<std::uint8_t> ref(text[s].size());
+        cbc_encrypt(aes, ref_iv, text[s], ref);
+        runtime_assert(enc[s] == ref);
+        runtime_assert(iv[s] == ref_iv);
+        runtime_assert(streams[s].len == 0);
+    }
+}
+
+void test_cbc_pad_x86()
+{
+    aes128 aes(0x000102030405060708090a0b0c0d0e0f_bytes);
+    for (std::size_t len : {0, 1, 15, 16, 17, 100}) {
+        std::vector<std::uint8_t> text(len), buf(cbc_padded_size(len));
+        for (std::size_t i = 0; i < len; i++)
+            text[i] = i * 3 + 1;
+
+        // in place, the buffer holds the message and room for the padding
+        std::memcpy(buf.data(), text.data(), len);
+        auto iv = sp800_38a_iv;
+        runtime_assert(cbc_encrypt_pad(aes, iv.data(), buf.data(), buf.data(), len) == buf.size());
+
+        auto check = buf;
+        iv = sp800_38a_iv;
+        cbc_decrypt(aes, iv, check, check);
+        const auto pad = buf.size() - len;
+        for (std::size_t i = len; i < check.size(); i++)
+            runtime_assert(check[i] == pad);
+
+        iv = sp800_38a_iv;
+        std::size_t out_len = 0;
+        runtime_assert(cbc_decrypt_unpad(aes, iv, buf, buf, out_len));
+        runtime_assert(out_len == len);
+        runtime_assert(std::equal(text.begin(), text.end(), buf.begin()));
+    }
+
+    // padding of 0, 17 and a wrong byte inside it
+    for (std::uint8_t bad : {0x00, 0x11, 0xff}) {
+        std::array<std::uint8_t, 32> block;
+        block.fill(0x04);
+        block[31] = bad == 0xff ? 0x04 : bad;
+        if (bad == 0xff)
+            block[29] = 0x05;
+        auto iv = sp800_38a_iv;
+        cbc_encrypt(aes, iv, block, block);
+        iv = sp800_38a_iv;
+        std::size_t out_len = 0;
+        runtime_assert(!cbc_decrypt_unpad(aes, iv, block, block, out_len));
+    }
+}
+
+int main()
+{
+    test_cbc_aes128_x86();
+    test_cbc_aes256_x86();
+    test_cbc_long_x86();
+    test_cbc_streams_x86();
+    test_cbc_pad_x86();
+}
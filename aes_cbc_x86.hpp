@@ -0,0 +1,271 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <immintrin.h>
+#include "aes_sg.hpp"
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    // CBC encryption of len bytes (a multiple of 16), in == out is allowed.
+    // iv is replaced by the last ciphertext block so that calls can be chained.
+    template <class AES>
+    void cbc_encrypt(const AES& aes, std::uint8_t iv[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+        typename stats_t<AES>::call scope(len);
+        auto c = _mm_loadu_si128((const __m128i*)iv);
+        for (; len >= 16; len -= 16, in += 16, out += 16) {
+            c = aes.encrypt_si128(_mm_xor_si128(c, _mm_loadu_si128((const __m128i*)in)));
+            _mm_storeu_si128((__m128i*)out, c);
+        }
+        _mm_storeu_si128((__m128i*)iv, c);
+    }
+
+    template <std::size_t N, class AES>
+    inline void cbc_decrypt_n(const AES& aes, __m128i& prev, const std::uint8_t* in, std::uint8_t* out) {
+        __m128i x[N];
+        for (std::size_t j = 0; j < N; j++)
+            x[j] = _mm_loadu_si128((const __m128i*)in + j);
+        aes.decrypt_si128(x);
+        // the ciphertext is read again rather than kept live through the rounds,
+        // every load still comes before the first store for in-place use
+        x[0] = _mm_xor_si128(x[0], prev);
+        for (std::size_t j = 1; j < N; j++)
+            x[j] = _mm_xor_si128(x[j], _mm_loadu_si128((const __m128i*)in + j - 1));
+        prev = _mm_loadu_si128((const __m128i*)in + N - 1);
+        for (std::size_t j = 0; j < N; j++)
+            _mm_storeu_si128((__m128i*)out + j, x[j]);
+    }
+
+    // CBC decryption, 8 blocks in flight, in == out is allowed
+    template <class AES>
+    void cbc_decrypt(const AES& aes, std::uint8_t iv[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+        typename stats_t<AES>::call scope(len);
+        auto prev = _mm_loadu_si128((const __m128i*)iv);
+        for (; len >= 8*16; len -= 8*16, in += 8*16, out += 8*16)
+            cbc_decrypt_n<8>(aes, prev, in, out);
+        if (len >= 4*16) {
+            cbc_decrypt_n<4>(aes, prev, in, out);
+            len -= 4*16, in += 4*16, out += 4*16;
+        }
+        for (; len >= 16; len -= 16, in += 16, out += 16)
+            cbc_decrypt_n<1>(aes, prev, in, out);
+        _mm_storeu_si128((__m128i*)iv, prev);
+    }
+
+    inline void cbc_check(std::size_t in_size, std::size_t out_size) {
+        if (in_size % 16 != 0)
+            throw std::invalid_argument("cheap_aes: input is not a multiple of the block size");
+        if (out_size < in_size)
+            throw std::invalid_argument("cheap_aes: output is shorter than input");
+    }
+
+    template <class AES>
+    void cbc_encrypt(const AES& aes, typename AES::block_array& iv,
+                     std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+        cbc_check(in.size(), out.size());
+        cbc_encrypt(aes, iv.data(), in.data(), out.data(), in.size());
+    }
+
+    template <class AES>
+    void cbc_decrypt(const AES& aes, typename AES::block_array& iv,
+                     std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+        cbc_check(in.size(), out.size());
+        cbc_decrypt(aes, iv.data(), in.data(), out.data(), in.size());
+    }
+
+    template <bool Decrypt, class AES, class In>
+    void cbc_crypt_sg(const AES& aes, std::uint8_t iv[16], sg_cursor<In> in, sg_cursor<std::uint8_t> out) {
+        const auto len = in.size();
+        cbc_check(len, out.size());
+        typename stats_t<AES>::call scope(len);
+        sg_blocks(in, out, len, [&](const std::uint8_t* i, std::uint8_t* o, std::size_t n) {
+            if constexpr (Decrypt)
+                cbc_decrypt(aes, iv, i, o, n);
+            else
+                cbc_encrypt(aes, iv, i, o, n);
+        });
+    }
+
+    // CBC over fragment lists (aes_sg.hpp), the total is a multiple of 16
+    template <class AES>
+    void cbc_encrypt(const AES& aes, typename AES::block_array& iv, sg_const_list in, sg_list out) {
+        cbc_crypt_sg<false>(aes, iv.data(), sg_cursor(in), sg_cursor(out));
+    }
+
+    template <class AES>
+    void cbc_encrypt(const AES& aes, typename AES::block_array& iv, sg_list buf) {
+        cbc_crypt_sg<false>(aes, iv.data(), sg_cursor(buf), sg_cursor(buf));
+    }
+
+    template <class AES>
+    void cbc_decrypt(const AES& aes, typename AES::block_array& iv, sg_const_list in, sg_list out) {
+        cbc_crypt_sg<true>(aes, iv.data(), sg_cursor(in), sg_cursor(out));
+    }
+
+    template <class AES>
+    void cbc_decrypt(const AES& aes, typename AES::block_array& iv, sg_list buf) {
+        cbc_crypt_sg<true>(aes, iv.data(), sg_cursor(buf), sg_cursor(buf));
+    }
+
+    // One CBC stream of a multi-stream call, iv is chained as in cbc_encrypt.
+    struct cbc_stream
+    {
+        std::uint8_t* iv;
+        const std::uint8_t* in;
+        std::uint8_t* out;
+        std::size_t len;
+    };
+
+    // nblocks blocks of each of N streams, one aesenc per stream per round
+    template <std::size_t N, class AES>
+    inline void cbc_encrypt_lockstep(const AES& aes, __m128i (&c)[8], cbc_stream* (&s)[8], std::size_t nblocks) {
+        const __m128i* in[N];
+        __m128i* out[N];
+        for (std::size_t j = 0; j < N; j++) {
+            in[j] = (const __m128i*)s[j]->in;
+            out[j] = (__m128i*)s[j]->out;
+        }
+
+        // the chaining values stay in registers, out might alias c for all the compiler knows
+        __m128i x[N];
+        for (std::size_t j = 0; j < N; j++)
+            x[j] = c[j];
+        for (std::size_t i = 0; i < nblocks; i++) {
+            for (std::size_t j = 0; j < N; j++)
+                x[j] = _mm_xor_si128(x[j], _mm_loadu_si128(in[j] + i));
+            aes.encrypt_si128(x);
+            for (std::size_t j = 0; j < N; j++)
+                _mm_storeu_si128(out[j] + i, x[j]);
+        }
+
+        for (std::size_t j = 0; j < N; j++) {
+            c[j] = x[j];
+            s[j]->in += 16*nblocks;
+            s[j]->out += 16*nblocks;
+            s[j]->len -= 16*nblocks;
+        }
+    }
+
+    // Encrypts independent CBC streams under one key, up to 8 at a time in
+    // lockstep so that their AES latencies overlap; a lane freed by a short
+    // stream goes to the next one. Each len is a multiple of 16; the in, out
+    // and len fields are consumed.
+    template <class AES>
+    void cbc_encrypt_streams(const AES& aes, std::span<cbc_stream> streams) {
+        std::size_t total = 0;
+        for (auto& x : streams) {
+            if (x.len % 16 != 0)
+                throw std::invalid_argument("cheap_aes: input is not a multiple of the block size");
+            total += x.len;
+        }
+        typename stats_t<AES>::call scope(total);
+
+        cbc_stream* s[8];
+        __m128i c[8];
+        std::size_t m = 0, next = 0;
+        // free lanes take the next pending streams
+        auto fill = [&] {
+            for (; m < 8 && next < streams.size(); next++) {
+                if (streams[next].len == 0)
+                    continue;
+                s[m] = &streams[next];
+                c[m] = _mm_loadu_si128((const __m128i*)streams[next].iv);
+                m++;
+            }
+        };
+
+        fill();
+        while (m > 0) {
+            std::size_t nblocks = s[0]->len / 16;
+            for (std::size_t j = 1; j < m; j++)
+                nblocks = std::min(nblocks, s[j]->len / 16);
+
+            switch (m) {
+            case 1: cbc_encrypt_lockstep<1>(aes, c, s, nblocks); break;
+            case 2: cbc_encrypt_lockstep<2>(aes, c, s, nblocks); break;
+            case 3: cbc_encrypt_lockstep<3>(aes, c, s, nblocks); break;
+            case 4: cbc_encrypt_lockstep<4>(aes, c, s, nblocks); break;
+            case 5: cbc_encrypt_lockstep<5>(aes, c, s, nblocks); break;
+            case 6: cbc_encrypt_lockstep<6>(aes, c, s, nblocks); break;
+            case 7: cbc_encrypt_lockstep<7>(aes, c, s, nblocks); break;
+            default: cbc_encrypt_lockstep<8>(aes, c, s, nblocks); break;
+            }
+
+            // finished streams leave, the rest close up
+            std::size_t k = 0;
+            for (std::size_t j = 0; j < m; j++) {
+                if (s[j]->len == 0) {
+                    _mm_storeu_si128((__m128i*)s[j]->iv, c[j]);
+                } else {
+                    s[k] = s[j];
+                    c[k] = c[j];
+                    k++;
+                }
+            }
+            m = k;
+            fill();
+        }
+    }
+
+    // PKCS#7: len bytes are padded to a whole number of blocks and encrypted.
+    // out has room for cbc_padded_size(len) bytes and may be the same buffer as in.
+    constexpr std::size_t cbc_padded_size(std::size_t len) {
+        return (len / 16 + 1) * 16;
+    }
+
+    template <class AES>
+    std::size_t cbc_encrypt_pad(const AES& aes, std::uint8_t iv[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+        const auto whole = len / 16 * 16;
+        std::uint8_t last[16];
+        std::memset(last, (int)(16 - (len - whole)), 16);
+        std::memcpy(last, in + whole, len - whole);
+
+        cbc_encrypt(aes, iv, in, out, whole);
+        cbc_encrypt(aes, iv, last, out + whole, 16);
+        return whole + 16;
+    }
+
+    // Decrypts and strips PKCS#7 padding, out_len gets the message length.
+    // The padding is checked without branching on its content.
+    template <class AES>
+    bool cbc_decrypt_unpad(const AES& aes, std::uint8_t iv[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                           std::size_t& out_len) {
+        if (len == 0 || len % 16 != 0)
+            return false;
+        cbc_decrypt(aes, iv, in, out, len);
+
+        const auto last = out + len - 16;
+        const unsigned pad = last[15];
+        unsigned bad = (pad - 1) >> 8 | (16 - pad) >> 8;
+        for (unsigned i = 0; i < 16; i++) {
+            // i counts from the end, the bytes inside the padding have to equal pad
+            const unsigned inside = (i - pad) >> 8 & 1;
+            bad |= inside & (last[15 - i] != pad);
+        }
+        out_len = len - (bad ? 0 : pad);
+        return bad == 0;
+    }
+
+    template <class AES>
+    std::size_t cbc_encrypt_pad(const AES& aes, typename AES::block_array& iv,
+                                std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+        if (out.size() < cbc_padded_size(in.size()))
+            throw std::invalid_argument("cheap_aes: output is shorter than the padded input");
+        return cbc_encrypt_pad(aes, iv.data(), in.data(), out.data(), in.size());
+    }
+
+    template <class AES>
+    bool cbc_decrypt_unpad(const AES& aes, typename AES::block_array& iv,
+                           std::span<const std::uint8_t> in, std::span<std::uint8_t> out, std::size_t& out_len) {
+        if (out.size() < in.size())
+            throw std::invalid_argument("cheap_aes: output is shorter than input");
+        return cbc_decrypt_unpad(aes, iv.data(), in.data(), out.data(), in.size(), out_len);
+    }
+}
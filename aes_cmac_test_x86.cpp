@@ -0,0 +1,87 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <stdexcept>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes_cmac_x86.hpp"
+
+using namespace cheap_aes::x86;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+// RFC 4493 4 and NIST SP 800-38B D.3 (AES-256), messages of 0, 16, 40 and 64 bytes
+const auto cmac_text = 0x6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e5130c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710_bytes;
+
+template <class CMAC>
+void test_cmac_vectors(const CMAC& cmac, const std::array<typename CMAC::tag_array, 4>& expected)
+{
+    const std::size_t lens[] = {0, 16, 40, 64};
+    for (int i = 0; i < 4; i++) {
+        std::span<const std::uint8_t> msg(cmac_text.data(), lens[i]);
+        auto tag = cmac.sign(msg);
+        runtime_assert(tag == expected[i]);
+        runtime_assert(cmac.verify(msg, tag));
+        tag[i] ^= 1;
+        runtime_assert(!cmac.verify(msg, tag));
+    }
+}
+
+void test_cmac_rfc4493_x86()
+{
+    cmac128 cmac(0x2b7e151628aed2a6abf7158809cf4f3c_bytes);
+    test_cmac_vectors(cmac, {
+        0xbb1d6929e95937287fa37d129b756746_bytes,
+        0x070a16b46b4d4144f79bdd9dd04a287c_bytes,
+        0xdfa66747de9ae63030ca32611497c827_bytes,
+        0x51f0bebf7e3b9d92fc49741779363cfe_bytes,
+    });
+}
+
+void test_cmac_sp800_38b_x86()
+{
+    cmac256 cmac(0x603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4_bytes);
+    test_cmac_vectors(cmac, {
+        0x028962f61b7bf89efc6b551f4667d983_bytes,
+        0x28a7023f452e8f82bd4bf28d8c37c35c_bytes,
+        0xaaf3d8f1de5640c232f5b169b9c911e6_bytes,
+        0xe1992190549f6ed5696a2c056c315410_bytes,
+    });
+}
+
+// batches of more messages than lanes, with lengths around the block boundaries
+template <class CMAC>
+void test_cmac_batch_x86()
+{
+    typename CMAC::key_array key;
+    for (std::size_t i = 0; i < key.size(); i++)
+        key[i] = i * 3 + 7;
+    CMAC cmac(key);
+
+    std::vector<std::uint8_t> text(16*40);
+    for (std::size_t i = 0; i < text.size(); i++)
+        text[i] = i * 11 + (i >> 7);
+
+    for (std::size_t count : {0, 1, 3, 8, 9, 37}) {
+        std::vector<cmac_message> batch(count);
+        std::vector<typename CMAC::tag_array> tags(count);
+        for (std::size_t n = 0; n < count; n++) {
+            const auto len = n == 5 ? 16*40 : (n * 29 + n / 3) % 113;
+            batch[n] = {&text[text.size() - len], len, tags[n].data()};
+        }
+        cmac.sign(batch);
+
+        for (std::size_t n = 0; n < count; n++)
+            runtime_assert(tags[n] == cmac.sign(std::span(batch[n].msg, batch[n].len)));
+    }
+}
+
+int main()
+{
+    test_cmac_rfc4493_x86();
+    test_cmac_sp800_38b_x86();
+    test_cmac_batch_x86<cmac128>();
+    test_cmac_batch_x86<cmac192>();
+    test_cmac_batch_x86<cmac256>();
+}
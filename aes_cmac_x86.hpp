@@ -0,0 +1,228 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <immintrin.h>
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    // One message of a batch, tag receives its 16-byte CMAC.
+    struct cmac_message
+    {
+        const std::uint8_t* msg;
+        std::size_t len;
+        std::uint8_t* tag;
+    };
+
+    // AES-CMAC (RFC 4493, NIST SP 800-38B). The subkeys K1 and K2 are
+    // derived once in set(). A single chain is serial, so a batch of
+    // messages is signed up to 8 chains at a time in lockstep.
+    template <class AES>
+    class cmac_base
+    {
+    public:
+        static constexpr int key_size() { return AES::key_size(); };
+        static constexpr int tag_size() { return 16; };
+        using key_array = typename AES::key_array;
+        using tag_array = std::array<std::uint8_t, tag_size()>;
+
+    private:
+        AES aes;
+        __m128i k1, k2;
+
+    public:
+        cmac_base() {}
+
+        explicit cmac_base(const std::uint8_t key[AES::key_size()]) {
+            set(key);
+        }
+
+        explicit cmac_base(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void set(const std::uint8_t key[AES::key_size()]) {
+            aes.set(key);
+            k1 = dbl(aes.encrypt_si128(_mm_setzero_si128()));
+            k2 = dbl(k1);
+        }
+
+        void set(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void sign(const std::uint8_t* msg, std::size_t len, std::uint8_t tag[16]) const {
+            typename stats_t<AES>::call scope(len);
+            const auto n = body_blocks(len);
+            auto y = _mm_setzero_si128();
+            for (std::size_t i = 0; i < n; i++)
+                y = aes.encrypt_si128(_mm_xor_si128(y, _mm_loadu_si128((const __m128i*)msg + i)));
+
+            std::uint8_t last[16];
+            last_block(msg + 16*n, len - 16*n, last);
+            y = aes.encrypt_si128(_mm_xor_si128(y, _mm_loadu_si128((const __m128i*)last)));
+            _mm_storeu_si128((__m128i*)tag, y);
+        }
+
+        tag_array sign(std::span<const std::uint8_t> msg) const {
+            tag_array tag;
+            sign(msg.data(), msg.size(), &tag[0]);
+            return tag;
+        }
+
+        // the tag is compared in constant time
+        bool verify(const std::uint8_t* msg, std::size_t len, const std::uint8_t tag[16]) const {
+            std::uint8_t expected[16];
+            sign(msg, len, expected);
+
+            std::uint8_t diff = 0;
+            for (int i = 0; i < 16; i++)
+                diff |= expected[i] ^ tag[i];
+            return diff == 0;
+        }
+
+        bool verify(std::span<const std::uint8_t> msg, const tag_array& tag) const {
+            return verify(msg.data(), msg.size(), &tag[0]);
+        }
+
+        // Signs every message of the batch. Up to 8 chains share each AES
+        // round, and a lane whose message ends takes the next one waiting.
+        void sign(std::span<const cmac_message> batch) const {
+            std::size_t total = 0;
+            for (auto& m : batch)
+                total += m.len;
+            typename stats_t<AES>::call scope(total);
+
+            const cmac_message* lane[8];
+            const std::uint8_t* in[8];
+            std::size_t left[8];
+            alignas(16) std::uint8_t last[8][16];
+            __m128i y[8];
+            std::size_t m = 0, next = 0;
+
+            for (;;) {
+                for (; m < 8 && next < batch.size(); m++, next++) {
+                    lane[m] = &batch[next];
+                    in[m] = batch[next].msg;
+                    left[m] = body_blocks(batch[next].len);
+                    y[m] = _mm_setzero_si128();
+                }
+                if (m == 0)
+                    break;
+
+                // the blocks that every lane still has before its last one
+                auto nblocks = left[0];
+                for (std::size_t j = 1; j < m; j++)
+                    nblocks = std::min(nblocks, left[j]);
+                chain(m, y, in, nblocks);
+
+                // then one step in which the lanes out of blocks take their last
+                const std::uint8_t* step[8];
+                bool done[8];
+                for (std::size_t j = 0; j < m; j++) {
+                    left[j] -= nblocks;
+                    in[j] += 16*nblocks;
+                    done[j] = left[j] == 0;
+                    if (done[j]) {
+                        last_block(in[j], lane[j]->msg + lane[j]->len - in[j], last[j]);
+                        step[j] = last[j];
+                    } else {
+                        step[j] = in[j];
+                        left[j]--;
+                        in[j] += 16;
+                    }
+                }
+                chain(m, y, step, 1);
+
+                // finished lanes leave, the rest close up
+                std::size_t k = 0;
+                for (std::size_t j = 0; j < m; j++) {
+                    if (done[j]) {
+                        _mm_storeu_si128((__m128i*)lane[j]->tag, y[j]);
+                    } else {
+                        lane[k] = lane[j];
+                        in[k] = in[j];
+                        left[k] = left[j];
+                        y[k] = y[j];
+                        k++;
+                    }
+                }
+                m = k;
+            }
+        }
+
+    private:
+        // the blocks before the last one, which may be partial or empty
+        static std::size_t body_blocks(std::size_t len) {
+            return len == 0 ? 0 : (len - 1) / 16;
+        }
+
+        // M_last: a whole block masked with K1, otherwise padded with 10* and masked with K2
+        void last_block(const std::uint8_t* p, std::size_t rest, std::uint8_t out[16]) const {
+            if (rest == 16) {
+                _mm_storeu_si128((__m128i*)out, _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), k1));
+            } else {
+                std::uint8_t b[16] = {};
+                std::memcpy(b, p, rest);
+                b[rest] = 0x80;
+                _mm_storeu_si128((__m128i*)out, _mm_xor_si128(_mm_loadu_si128((const __m128i*)b), k2));
+            }
+        }
+
+        // nblocks blocks of N chains, one aesenc per chain per round
+        template <std::size_t N>
+        inline void chain_n(__m128i (&y)[8], const std::uint8_t* (&in)[8], std::size_t nblocks) const {
+            __m128i x[N];
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                x[j] = y[j];
+            for (std::size_t i = 0; i < nblocks; i++) {
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < N; j++)
+                    x[j] = _mm_xor_si128(x[j], _mm_loadu_si128((const __m128i*)in[j] + i));
+                aes.encrypt_si128(x);
+            }
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                y[j] = x[j];
+        }
+
+        void chain(std::size_t m, __m128i (&y)[8], const std::uint8_t* (&in)[8], std::size_t nblocks) const {
+            switch (m) {
+            case 1: chain_n<1>(y, in, nblocks); break;
+            case 2: chain_n<2>(y, in, nblocks); break;
+            case 3: chain_n<3>(y, in, nblocks); break;
+            case 4: chain_n<4>(y, in, nblocks); break;
+            case 5: chain_n<5>(y, in, nblocks); break;
+            case 6: chain_n<6>(y, in, nblocks); break;
+            case 7: chain_n<7>(y, in, nblocks); break;
+            default: chain_n<8>(y, in, nblocks); break;
+            }
+        }
+
+        static __m128i bswap(__m128i x) {
+            return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+        }
+
+        // doubling in GF(2^128) of the big-endian block, without a branch on the key
+        static __m128i dbl(__m128i l) {
+            auto x = bswap(l);
+            const auto carry = _mm_slli_si128(_mm_srli_epi64(x, 63), 8);
+            const auto msb = _mm_srai_epi32(_mm_shuffle_epi32(x, 0xff), 31);
+            x = _mm_or_si128(_mm_slli_epi64(x, 1), carry);
+            x = _mm_xor_si128(x, _mm_and_si128(msb, _mm_set_epi64x(0, 0x87)));
+            return bswap(x);
+        }
+    };
+
+    using cmac128 = cmac_base<aes128>;
+    using cmac192 = cmac_base<aes192>;
+    using cmac256 = cmac_base<aes256>;
+}
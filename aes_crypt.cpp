@@ -0,0 +1,512 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+//
+// aes-crypt: CTR/GCM/XTS en/decryption of files and pipes.
+// Regular files are mapped and processed in place in the mapping of the
+// output; pipes go through two large buffers, reading the next one while
+// the current one is processed and written. A gcm decryption is read whole,
+// its plaintext is not released before the tag is checked.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "aes_dispatch.hpp"
+#include "aes_parallel_x86.hpp"
+
+using namespace cheap_aes::x86;
+
+namespace
+{
+    enum class mode { ctr, gcm, xts };
+
+    struct options
+    {
+        bool decrypt = false;
+        mode m = mode::ctr;
+        std::vector<std::uint8_t> key, iv;
+        std::uint64_t sector = 0;
+        std::size_t unit = 512;
+        unsigned threads = 1;
+        bool quiet = false;
+        std::string in = "-", out = "-";
+    };
+
+    constexpr std::size_t buffer_size = 8 << 20;
+
+    [[noreturn]] void usage()
+    {
+        std::fputs(
+            "usage: aes-crypt (-e | -d) -m ctr|gcm|xts -k key [options] [in [out]]\n"
+            "  -k hex   key: 16/24/32 bytes, 32/64 bytes (data and tweak keys) for xts\n"
+            "  -i hex   ctr: initial counter block (16 bytes)\n"
+            "           gcm: IV, the tag follows the ciphertext\n"
+            "  -s n     xts: number of the first sector (default 0)\n"
+            "  -u n     xts: sector size in bytes (default 512)\n"
+            "  -t n     worker threads (default 1)\n"
+            "  -q       no throughput summary\n"
+            "in and out default to stdin and stdout, out may be the same file as in.\n"
+            "Pipes are double buffered, except for gcm decryption, which reads the\n"
+            "whole input before it writes anything. A failed gcm decryption leaves\n"
+            "out empty, or unchanged when it is in.\n",
+            stderr);
+        std::exit(2);
+    }
+
+    // runs while the options are parsed, so a bad argument ends in usage()
+    std::vector<std::uint8_t> parse_hex(const char* s)
+    {
+        auto nibble = [](char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            std::fputs("aes-crypt: bad hex digit\n", stderr);
+            usage();
+        };
+        const auto len = std::strlen(s);
+        if (len % 2 != 0) {
+            std::fputs("aes-crypt: odd number of hex digits\n", stderr);
+            usage();
+        }
+        std::vector<std::uint8_t> out(len / 2);
+        for (std::size_t i = 0; i < out.size(); i++)
+            out[i] = nibble(s[2*i]) << 4 | nibble(s[2*i + 1]);
+        return out;
+    }
+
+    [[noreturn]] void fail(const std::string& what)
+    {
+        throw std::system_error(errno, std::generic_category(), "aes-crypt: " + what);
+    }
+
+    struct file
+    {
+        int fd = -1;
+        ~file() { if (fd > 2) ::close(fd); }
+    };
+
+    struct mapping
+    {
+        void* p = MAP_FAILED;
+        std::size_t len = 0;
+
+        mapping(int fd, std::size_t len, bool write) : len(len) {
+            if (len == 0)
+                return;
+            p = ::mmap(nullptr, len, write ? PROT_READ | PROT_WRITE : PROT_READ,
+                       write ? MAP_SHARED : MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            if (p == MAP_FAILED)
+                fail("mmap");
+            ::madvise(p, len, MADV_SEQUENTIAL);
+        }
+        ~mapping() { if (p != MAP_FAILED) ::munmap(p, len); }
+
+        std::uint8_t* data() const { return len ? (std::uint8_t*)p : nullptr; }
+    };
+
+    struct aligned_buffer
+    {
+        std::uint8_t* p;
+        explicit aligned_buffer(std::size_t size) : p((std::uint8_t*)std::aligned_alloc(4096, size)) {
+            if (!p)
+                throw std::bad_alloc();
+        }
+        ~aligned_buffer() { std::free(p); }
+    };
+
+    std::size_t read_full(int fd, std::uint8_t* p, std::size_t len)
+    {
+        std::size_t done = 0;
+        while (done < len) {
+            const auto n = ::read(fd, p + done, len - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                fail("read");
+            if (n == 0)
+                break;
+            done += n;
+        }
+        return done;
+    }
+
+    void write_full(int fd, const std::uint8_t* p, std::size_t len)
+    {
+        while (len > 0) {
+            const auto n = ::write(fd, p, len);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                fail("write");
+            p += n;
+            len -= n;
+        }
+    }
+
+    // CTR keeps its counter between buffers
+    template <class AES>
+    class ctr_engine
+    {
+    private:
+        AES aes;
+        typename AES::block_array counter{};
+        thread_pool& pool;
+
+    public:
+        static constexpr bool authenticated = false;
+
+        ctr_engine(const options& opt, thread_pool& pool) : aes(opt.key.data()), pool(pool) {
+            if (opt.iv.size() != 16)
+                throw std::invalid_argument("aes-crypt: ctr needs a 16 byte counter block (-i)");
+            std::memcpy(counter.data(), opt.iv.data(), 16);
+        }
+
+        bool streams() const { return true; }
+        std::size_t granule() const { return 16; }
+        std::size_t out_size(std::size_t len) const { return len; }
+
+        void update(const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+            parallel_ctr_crypt(pool, aes, counter.data(), in, out, len);
+        }
+
+        std::size_t finish(std::uint8_t*) { return 0; }
+
+        bool whole(const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+            update(in, out, len);
+            return true;
+        }
+    };
+
+    // XTS numbers the sectors on from -s, a last partial sector is stolen from
+    template <class AES>
+    class xts_engine
+    {
+    private:
+        xts_base<AES> xts;
+        std::uint64_t sector;
+        std::size_t unit;
+        bool decrypt;
+        thread_pool& pool;
+
+    public:
+        static constexpr bool authenticated = false;
+
+        xts_engine(const options& opt, thread_pool& pool)
+            : xts(opt.key.data()), sector(opt.sector), unit(opt.unit), decrypt(opt.decrypt), pool(pool) {
+            if (unit < 16)
+                throw std::invalid_argument("aes-crypt: xts sector size is shorter than a block");
+        }
+
+        bool streams() const { return true; }
+        std::size_t granule() const { return unit; }
+
+        std::size_t out_size(std::size_t len) const {
+            if (const auto tail = len % unit; tail > 0 && tail < 16)
+                throw std::invalid_argument("aes-crypt: last sector is shorter than a block");
+            return len;
+        }
+
+        void update(const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+            const auto whole_len = len / unit * unit;
+            if (decrypt)
+                parallel_decrypt_sectors(pool, xts, sector, unit, in, out, whole_len);
+            else
+                parallel_encrypt_sectors(pool, xts, sector, unit, in, out, whole_len);
+            sector += whole_len / unit;
+
+            if (const auto tail = len - whole_len; tail > 0) {
+                std::uint8_t tweak[16] = {};
+                for (int i = 0; i < 8; i++)
+                    tweak[i] = sector >> (8*i);
+                if (decrypt)
+                    xts.decrypt(tweak, in + whole_len, out + whole_len, tail);
+                else
+                    xts.encrypt(tweak, in + whole_len, out + whole_len, tail);
+                sector++;
+            }
+        }
+
+        std::size_t finish(std::uint8_t*) { return 0; }
+
+        bool whole(const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+            update(in, out, len);
+            return true;
+        }
+    };
+
+    // The tag goes after the ciphertext. Sealing streams and appends it at
+    // the end, opening needs the whole message so that no plaintext is
+    // released before the tag is checked.
+    template <class AES>
+    class gcm_engine
+    {
+    private:
+        gcm_base<AES> gcm;
+        std::vector<std::uint8_t> iv;
+        bool decrypt;
+        thread_pool& pool;
+        gcm_stream<AES> stream;
+
+        static const std::vector<std::uint8_t>& check_iv(const std::vector<std::uint8_t>& iv) {
+            if (iv.empty())
+                throw std::invalid_argument("aes-crypt: gcm needs an IV (-i)");
+            return iv;
+        }
+
+    public:
+        static constexpr bool authenticated = true;
+
+        gcm_engine(const options& opt, thread_pool& pool)
+            : gcm(opt.key.data()), iv(check_iv(opt.iv)), decrypt(opt.decrypt), pool(pool),
+              stream(gcm, iv.data(), iv.size(), nullptr, 0) {}
+
+        bool streams() const { return !decrypt; }
+        std::size_t granule() const { return 16; }
+
+        std::size_t out_size(std::size_t len) const {
+            if (!decrypt)
+                return len + 16;
+            if (len < 16)
+                throw std::invalid_argument("aes-crypt: input is shorter than the tag");
+            return len - 16;
+        }
+
+        // sealing a pipe, on one thread
+        void update(const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+            stream.update(in, out, len);
+        }
+
+        std::size_t finish(std::uint8_t* out) {
+            stream.finalize(out);
+            return 16;
+        }
+
+        bool whole(const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+            if (!decrypt) {
+                std::uint8_t tag[16];
+                parallel_seal(pool, gcm, iv.data(), iv.size(), nullptr, 0, in, out, len, tag);
+                std::memcpy(out + len, tag, 16);
+                return true;
+            }
+            std::uint8_t tag[16];
+            std::memcpy(tag, in + len - 16, 16);
+            return parallel_open(pool, gcm, iv.data(), iv.size(), nullptr, 0, in, out, len - 16, tag);
+        }
+
+        // the tag checked over the ciphertext alone, nothing is decrypted
+        bool authentic(const std::uint8_t* in, std::size_t len) const {
+            std::uint8_t j0[16], expected[16];
+            gcm.pre_counter(iv.data(), iv.size(), j0);
+            auto y = _mm_setzero_si128();
+            gcm.hash().update(y, in, len - 16);
+            gcm.finish(j0, y, 0, len - 16, expected);
+
+            std::uint8_t diff = 0;
+            for (int i = 0; i < 16; i++)
+                diff |= expected[i] ^ in[len - 16 + i];
+            return diff == 0;
+        }
+    };
+
+    bool same_file(const struct stat& a, const struct stat& b)
+    {
+        return a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+    }
+
+    // regular file to regular file through mappings, in place when they are the same
+    template <class Engine>
+    std::size_t run_mapped(Engine& engine, const options& opt, int in_fd, std::size_t len)
+    {
+        struct stat in_st, out_st;
+        ::fstat(in_fd, &in_st);
+        const auto out_len = engine.out_size(len);
+        const bool in_place = ::stat(opt.out.c_str(), &out_st) == 0 && same_file(in_st, out_st);
+
+        // in place the input is gone once decrypted, so the tag goes first
+        if constexpr (Engine::authenticated) {
+            if (in_place && opt.decrypt) {
+                mapping src(in_fd, len, false);
+                if (!engine.authentic(src.data(), len))
+                    throw std::runtime_error("aes-crypt: authentication failed");
+            }
+        }
+
+        file out;
+        out.fd = in_place ? ::open(opt.out.c_str(), O_RDWR)
+                          : ::open(opt.out.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (out.fd < 0)
+            fail(opt.out);
+        if ((!in_place || out_len > len) && ::ftruncate(out.fd, out_len) != 0)
+            fail("ftruncate");
+
+        bool ok;
+        {
+            mapping dst(out.fd, std::max(len, out_len), true);
+            if (in_place) {
+                ok = engine.whole(dst.data(), dst.data(), len);
+            } else {
+                mapping src(in_fd, len, false);
+                ok = engine.whole(src.data(), dst.data(), len);
+            }
+        }
+        if (::ftruncate(out.fd, ok ? out_len : 0) != 0)
+            fail("ftruncate");
+        if (!ok)
+            throw std::runtime_error("aes-crypt: authentication failed");
+        return len;
+    }
+
+    // pipes: the next buffer is read while the current one is processed and
+    // written, a gcm decryption is read whole first
+    template <class Engine>
+    std::size_t run_stream(Engine& engine, int in_fd, int out_fd)
+    {
+        if (!engine.streams()) {
+            std::vector<std::uint8_t> in;
+            std::size_t len = 0;
+            for (;;) {
+                in.resize(len + buffer_size);
+                const auto n = read_full(in_fd, in.data() + len, buffer_size);
+                len += n;
+                if (n < buffer_size)
+                    break;
+            }
+            std::vector<std::uint8_t> out(engine.out_size(len));
+            if (!engine.whole(in.data(), out.data(), len))
+                throw std::runtime_error("aes-crypt: authentication failed");
+            write_full(out_fd, out.data(), out.size());
+            return len;
+        } else {
+            const auto size = buffer_size / engine.granule() * engine.granule();
+            aligned_buffer buf[2] = { aligned_buffer(size), aligned_buffer(size) };
+            std::size_t total = 0;
+            auto n = read_full(in_fd, buf[0].p, size);
+            for (int cur = 0; n > 0; cur ^= 1) {
+                auto next = std::async(std::launch::async, read_full, in_fd, buf[cur ^ 1].p, size);
+                engine.update(buf[cur].p, buf[cur].p, n);
+                write_full(out_fd, buf[cur].p, n);
+                total += n;
+                n = next.get();
+            }
+            std::uint8_t tail[16];
+            write_full(out_fd, tail, engine.finish(tail));
+            return total;
+        }
+    }
+
+    template <class Engine>
+    std::size_t run(const options& opt)
+    {
+        thread_pool pool(opt.threads);
+        Engine engine(opt, pool);
+
+        file in;
+        in.fd = opt.in == "-" ? 0 : ::open(opt.in.c_str(), O_RDONLY);
+        if (in.fd < 0)
+            fail(opt.in);
+
+        struct stat st;
+        if (::fstat(in.fd, &st) != 0)
+            fail(opt.in);
+        // a length the mode cannot take fails before out is opened
+        if (S_ISREG(st.st_mode))
+            engine.out_size(st.st_size);
+        struct stat out_st;
+        const bool out_regular = opt.out != "-" && (::stat(opt.out.c_str(), &out_st) != 0 || S_ISREG(out_st.st_mode));
+        if (S_ISREG(st.st_mode) && out_regular)
+            return run_mapped(engine, opt, in.fd, st.st_size);
+
+        file out;
+        out.fd = opt.out == "-" ? 1 : ::open(opt.out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out.fd < 0)
+            fail(opt.out);
+        return run_stream(engine, in.fd, out.fd);
+    }
+
+    // E128/E192/E256 by the size of the key
+    template <class E128, class E192, class E256>
+    std::size_t run_key(const options& opt)
+    {
+        switch (opt.key.size()) {
+        case 16: return run<E128>(opt);
+        case 24: return run<E192>(opt);
+        case 32: return run<E256>(opt);
+        }
+        throw std::invalid_argument("aes-crypt: bad key size");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    bool direction = false;
+    int c;
+    while ((c = ::getopt(argc, argv, "edm:k:i:s:u:t:q")) != -1) {
+        switch (c) {
+        case 'e': opt.decrypt = false; direction = true; break;
+        case 'd': opt.decrypt = true; direction = true; break;
+        case 'm':
+            if (std::strcmp(optarg, "ctr") == 0) opt.m = mode::ctr;
+            else if (std::strcmp(optarg, "gcm") == 0) opt.m = mode::gcm;
+            else if (std::strcmp(optarg, "xts") == 0) opt.m = mode::xts;
+            else usage();
+            break;
+        case 'k': opt.key = parse_hex(optarg); break;
+        case 'i': opt.iv = parse_hex(optarg); break;
+        case 's': opt.sector = std::strtoull(optarg, nullptr, 0); break;
+        case 'u': opt.unit = std::strtoull(optarg, nullptr, 0); break;
+        case 't': opt.threads = std::max(1ul, std::strtoul(optarg, nullptr, 0)); break;
+        case 'q': opt.quiet = true; break;
+        default: usage();
+        }
+    }
+    if (!direction || opt.key.empty() || argc - optind > 2)
+        usage();
+    // IEEE 1619 defines XTS-AES-128 and XTS-AES-256 only
+    if (opt.m == mode::xts && opt.key.size() != 32 && opt.key.size() != 64) {
+        std::fputs("aes-crypt: xts takes a 32 or 64 byte key\n", stderr);
+        usage();
+    }
+    if (optind < argc)
+        opt.in = argv[optind];
+    if (optind + 1 < argc)
+        opt.out = argv[optind + 1];
+
+    try {
+        const auto start = std::chrono::steady_clock::now();
+        std::size_t len = 0;
+        switch (opt.m) {
+        // CTR goes through the widest kernel the CPU has. GCM only ever
+        // encrypts with its key, the XTS data key also decrypts.
+        case mode::ctr:
+            len = run_key<ctr_engine<cheap_aes::dispatch::aes128>,
+                          ctr_engine<cheap_aes::dispatch::aes192>,
+                          ctr_engine<cheap_aes::dispatch::aes256>>(opt);
+            break;
+        case mode::gcm:
+            len = run_key<gcm_engine<aes128_enc>, gcm_engine<aes192_enc>, gcm_engine<aes256_enc>>(opt);
+            break;
+        case mode::xts:
+            len = opt.key.size() == 32 ? run<xts_engine<aes128>>(opt) : run<xts_engine<aes256>>(opt);
+            break;
+        }
+        const std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+
+        if (!opt.quiet)
+            std::fprintf(stderr, "aes-crypt: %zu bytes in %.3f s, %.1f MB/s (%u thread%s)\n",
+                         len, t.count(), len / t.count() / 1e6, opt.threads, opt.threads == 1 ? "" : "s");
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
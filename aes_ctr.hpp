@@ -0,0 +1,52 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include "aes_stats.hpp"
+
+namespace cheap_aes
+{
+    // which trailing part of the counter block is incremented (big-endian)
+    enum class ctr_inc { be32, be64, be128 };
+
+    // CTR en/decryption of len bytes with any backend that has encrypt_blocks,
+    // 8 keystream blocks per call. in == out is allowed.
+    // counter is advanced past every block used, including a partial last block.
+    template <ctr_inc Inc = ctr_inc::be128, class AES>
+    constexpr void ctr_crypt(const AES& aes, std::uint8_t counter[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+        constexpr int width = Inc == ctr_inc::be32 ? 4 : Inc == ctr_inc::be64 ? 8 : 16;
+        typename stats_t<AES>::call scope(len);
+
+        while (len > 0) {
+            std::uint8_t ks[8*16];
+            const auto n = std::min<std::size_t>((len + 15) / 16, 8);
+            for (std::size_t i = 0; i < n; i++) {
+                std::copy(counter, counter + 16, &ks[16*i]);
+                for (int j = 15; j >= 16 - width; j--)
+                    if (++counter[j] != 0)
+                        break;
+            }
+            aes.encrypt_blocks(ks, ks, n);
+
+            const auto m = std::min<std::size_t>(len, 16*n);
+            for (std::size_t i = 0; i < m; i++)
+                out[i] = in[i] ^ ks[i];
+            in += m;
+            out += m;
+            len -= m;
+        }
+    }
+
+    template <ctr_inc Inc = ctr_inc::be128, class AES>
+    constexpr void ctr_crypt(const AES& aes, typename AES::block_array& counter,
+                             std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+        if (out.size() < in.size())
+            throw std::invalid_argument("cheap_aes: output is shorter than input");
+        ctr_crypt<Inc>(aes, &counter[0], in.data(), out.data(), in.size());
+    }
+}
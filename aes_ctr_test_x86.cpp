@@ -0,0 +1,171 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes_ctr_x86.hpp"
+
+using namespace cheap_aes::x86;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+// NIST SP 800-38A F.5
+constexpr auto sp800_38a_iv = 0xf0f1f2f3f4f5f6f7f8f9fafbfcfdfeff_bytes;
+constexpr auto sp800_38a_text =
+    0x6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e5130c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710_bytes;
+
+template <class AES, std::size_t N>
+void test_ctr_vector(const typename AES::key_array& key, const std::array<std::uint8_t, N>& expected)
+{
+    AES aes(key);
+    auto ctr = sp800_38a_iv;
+    std::array<std::uint8_t, N> enc;
+    ctr_crypt(aes, ctr, sp800_38a_text, enc);
+    runtime_assert(enc == expected);
+    runtime_assert(ctr == 0xf0f1f2f3f4f5f6f7f8f9fafbfcfdff03_bytes);
+
+    // in place, split at a partial block
+    ctr = sp800_38a_iv;
+    ctr_crypt(aes, ctr.data(), enc.data(), enc.data(), 16);
+    ctr_crypt(aes, ctr.data(), enc.data() + 16, enc.data() + 16, N - 16);
+    runtime_assert(enc == sp800_38a_text);
+}
+
+void test_ctr_aes128_x86()
+{
+    test_ctr_vector<aes128>(
+        0x2b7e151628aed2a6abf7158809cf4f3c_bytes,
+        0x874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee_bytes);
+}
+
+void test_ctr_aes192_x86()
+{
+    test_ctr_vector<aes192>(
+        0x8e73b0f7da0e6452c810f32b809079e562f8ead2522c6b7b_bytes,
+        0x1abc932417521ca24f2b0459fe7e6e0b090339ec0aa6faefd5ccc2c6f4ce8e941e36b26bd1ebc670d1bd1d665620abf74f78a7f6d29809585a97daec58c6b050_bytes);
+}
+
+void test_ctr_aes256_x86()
+{
+    test_ctr_vector<aes256>(
+        0x603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4_bytes,
+        0x601ec313775789a5b7a7f504bbf3d228f443e3ca4d62b59aca84e990cacaf5c52b0930daa23de94ce87017ba2d84988ddfc9c58db67aada613c2dd08457941a6_bytes);
+}
+
+// reference: one block at a time with a byte-wise big-endian increment over the last width bytes
+void ctr_reference(const aes128& aes, std::uint8_t counter[16], int width,
+                   const std::uint8_t* in, std::uint8_t* out, std::size_t len)
+{
+    for (std::size_t i = 0; i < len; i += 16) {
+        std::uint8_t ks[16];
+        aes.encrypt(counter, ks);
+        for (std::size_t j = 0; j < 16 && i + j < len; j++)
+            out[i+j] = in[i+j] ^ ks[j];
+        for (int j = 15; j >= 16 - width; j--)
+            if (++counter[j] != 0)
+                break;
+    }
+}
+
+template <ctr_inc Inc>
+void test_ctr_wrap(int width, const aes128::block_array& iv)
+{
+    aes128 aes(0x000102030405060708090a0b0c0d0e0f_bytes);
+    for (std::size_t len : {0, 1, 15, 16, 17, 64, 100, 128, 129, 200, 1000}) {
+        std::vector<std::uint8_t> text(len);
+        for (std::size_t i = 0; i < len; i++)
+            text[i] = i * 13 + 5;
+
+        auto ctr = iv;
+        std::vector<std::uint8_t> enc(len);
+        ctr_crypt<Inc>(aes, ctr, text, enc);
+
+        auto ref_ctr = iv;
+        std::vector<std::uint8_t> ref(len);
+        ctr_reference(aes, ref_ctr.data(), width, text.data(), ref.data(), len);
+
+        runtime_assert(enc == ref);
+        runtime_assert(ctr == ref_ctr);
+    }
+}
+
+void test_ctr_inc_x86()
+{
+    test_ctr_wrap<ctr_inc::be32>(4, 0x0011223344556677aabbccddfffffffa_bytes);
+    test_ctr_wrap<ctr_inc::be64>(8, 0x00112233aabbccddfffffffffffffffa_bytes);
+    test_ctr_wrap<ctr_inc::be128>(16, 0x0011223344556677fffffffffffffffa_bytes);
+    test_ctr_wrap<ctr_inc::be128>(16, 0xfffffffffffffffffffffffffffffffa_bytes);
+}
+
+// chunk sizes that leave the keystream at every offset, and large ones for the 8-block path
+const std::size_t stream_chunks[] = {1, 0, 15, 3, 16, 200, 7, 129, 1, 1, 33, 1024, 5};
+
+void test_ctr_stream_x86()
+{
+    static_assert(std::is_trivially_copyable_v<ctr_stream<aes128>>);
+
+    aes128 aes(0x2b7e151628aed2a6abf7158809cf4f3c_bytes);
+    std::vector<std::uint8_t> text(4000), ref(text.size()), out(text.size());
+    for (std::size_t i = 0; i < text.size(); i++)
+        text[i] = i * 7 + 1;
+    auto ref_ctr = sp800_38a_iv;
+    ctr_crypt(aes, ref_ctr, text, ref);
+
+    ctr_stream<aes128> stream(aes, sp800_38a_iv);
+    std::size_t off = 0;
+    for (std::size_t i = 0; off < text.size(); i++) {
+        const auto n = std::min(stream_chunks[i % std::size(stream_chunks)], text.size() - off);
+        stream.update(&text[off], &out[off], n);
+        off += n;
+
+        // a copy carries on from the same point
+        if (i == 5) {
+            auto copy = stream;
+            std::uint8_t x[40];
+            copy.update(&text[off], x, sizeof(x));
+            runtime_assert(std::memcmp(x, &ref[off], sizeof(x)) == 0);
+        }
+    }
+    runtime_assert(out == ref);
+
+    std::uint8_t c[16];
+    stream.store(c);
+    runtime_assert(std::memcmp(c, ref_ctr.data(), 16) == 0);
+}
+
+// non-temporal stores give the bytes and the final counter of the cached path
+void test_ctr_streaming_x86()
+{
+    const aes256 aes(0x603deb1015ca71be2b73aef0857d77811f352c073b6108d77d9814a09acb5f1f_bytes);
+    alignas(64) static std::uint8_t text[3000], out[3000];
+    for (std::size_t i = 0; i < sizeof(text); i++)
+        text[i] = i * 3 + 9;
+
+    for (std::size_t off : {0, 16, 48, 5}) {
+        for (std::size_t len : {0, 15, 16, 100, 128, 1000, 2900}) {
+            std::vector<std::uint8_t> ref(len);
+            auto ref_ctr = sp800_38a_iv;
+            ctr_crypt(aes, ref_ctr.data(), text + off, ref.data(), len, store_hint::cached);
+
+            auto ctr = sp800_38a_iv;
+            ctr_crypt(aes, ctr.data(), text + off, out + off, len, store_hint::streaming);
+            runtime_assert(std::memcmp(out + off, ref.data(), len) == 0);
+            runtime_assert(ctr == ref_ctr);
+        }
+    }
+}
+
+int main()
+{
+    test_ctr_aes128_x86();
+    test_ctr_aes192_x86();
+    test_ctr_aes256_x86();
+    test_ctr_inc_x86();
+    test_ctr_stream_x86();
+    test_ctr_streaming_x86();
+}
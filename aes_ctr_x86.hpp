@@ -0,0 +1,218 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <immintrin.h>
+#include "aes_ctr.hpp"
+#include "aes_sg.hpp"
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    using cheap_aes::ctr_inc;
+
+    template <ctr_inc Inc = ctr_inc::be128>
+    class ctr_counter
+    {
+    private:
+        // byte reversed counter block, lane 0 is the least significant end
+        __m128i ctr;
+
+    public:
+        ctr_counter() : ctr(_mm_setzero_si128()) {}
+
+        explicit ctr_counter(const std::uint8_t block[16]) {
+            ctr = bswap(_mm_loadu_si128((const __m128i*)block));
+        }
+
+        void store(std::uint8_t block[16]) const {
+            _mm_storeu_si128((__m128i*)block, bswap(ctr));
+        }
+
+        __m128i next() {
+            auto block = bswap(ctr);
+            ctr = add_carry(ctr, 1);
+            return block;
+        }
+
+        // moves on by n blocks, as n calls of next() would
+        void skip(std::uint64_t n) {
+            if constexpr (Inc == ctr_inc::be32)
+                n = (std::uint32_t)n;
+            ctr = add_carry(ctr, n);
+        }
+
+        template <std::size_t N>
+        void next(__m128i (&blocks)[N]) {
+            if constexpr (Inc == ctr_inc::be128) {
+                // rare case: the low 64 bits wrap inside this batch
+                if ((std::uint64_t)_mm_cvtsi128_si64(ctr) > ~std::uint64_t(0) - N) {
+                    for (std::size_t j = 0; j < N; j++)
+                        blocks[j] = next();
+                    return;
+                }
+            }
+            for (std::size_t j = 0; j < N; j++)
+                blocks[j] = bswap(add(ctr, j));
+            ctr = add(ctr, N);
+        }
+
+    private:
+        static __m128i bswap(__m128i x) {
+            return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+        }
+
+        static __m128i add(__m128i c, std::uint64_t n) {
+            if constexpr (Inc == ctr_inc::be32)
+                return _mm_add_epi32(c, _mm_set_epi64x(0, n));
+            else
+                return _mm_add_epi64(c, _mm_set_epi64x(0, n));
+        }
+
+        static __m128i add_carry(__m128i c, std::uint64_t n) {
+            auto r = add(c, n);
+            if constexpr (Inc == ctr_inc::be128) {
+                if ((std::uint64_t)_mm_cvtsi128_si64(r) < n)
+                    r = _mm_add_epi64(r, _mm_set_epi64x(1, 0));
+            }
+            return r;
+        }
+    };
+
+    template <std::size_t N, class AES, ctr_inc Inc>
+    inline void ctr_xor_n(const AES& aes, ctr_counter<Inc>& ctr, const std::uint8_t* in, std::uint8_t* out) {
+        __m128i ks[N];
+        ctr.next(ks);
+        aes.encrypt_si128(ks);
+        for (std::size_t j = 0; j < N; j++) {
+            auto x = _mm_loadu_si128((const __m128i*)in + j);
+            _mm_storeu_si128((__m128i*)out + j, _mm_xor_si128(x, ks[j]));
+        }
+    }
+
+    // CTR en/decryption of len bytes, in == out is allowed.
+    // counter is advanced past every block used, including a partial last block.
+    template <ctr_inc Inc = ctr_inc::be128, class AES>
+    void ctr_crypt(const AES& aes, std::uint8_t counter[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                   store_hint hint = store_hint::automatic) {
+        typename stats_t<AES>::call scope(len);
+        ctr_counter<Inc> ctr(counter);
+
+        if (use_streaming(hint, out, len)) {
+            const auto n = len / 16;
+            stream_blocks(in, out, n, [&]<std::size_t N>(__m128i (&s)[N]) {
+                __m128i ks[N];
+                ctr.next(ks);
+                aes.encrypt_si128(ks);
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < N; j++)
+                    s[j] = _mm_xor_si128(s[j], ks[j]);
+            });
+            len -= 16*n, in += 16*n, out += 16*n;
+        }
+
+        for (; len >= 8*16; len -= 8*16, in += 8*16, out += 8*16)
+            ctr_xor_n<8>(aes, ctr, in, out);
+        if (len >= 4*16) {
+            ctr_xor_n<4>(aes, ctr, in, out);
+            len -= 4*16, in += 4*16, out += 4*16;
+        }
+        for (; len >= 16; len -= 16, in += 16, out += 16)
+            ctr_xor_n<1>(aes, ctr, in, out);
+
+        if (len > 0) {
+            std::uint8_t ks[16];
+            _mm_storeu_si128((__m128i*)ks, aes.encrypt_si128(ctr.next()));
+            for (std::size_t i = 0; i < len; i++)
+                out[i] = in[i] ^ ks[i];
+        }
+
+        ctr.store(counter);
+    }
+
+    template <ctr_inc Inc = ctr_inc::be128, class AES>
+    void ctr_crypt(const AES& aes, typename AES::block_array& counter,
+                   std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                   store_hint hint = store_hint::automatic) {
+        if (out.size() < in.size())
+            throw std::invalid_argument("cheap_aes: output is shorter than input");
+        ctr_crypt<Inc>(aes, counter.data(), in.data(), out.data(), in.size(), hint);
+    }
+
+    template <ctr_inc Inc, class AES, class In>
+    void ctr_crypt_sg(const AES& aes, std::uint8_t counter[16], sg_cursor<In> in, sg_cursor<std::uint8_t> out) {
+        const auto len = in.size();
+        sg_check(len, out.size());
+        typename stats_t<AES>::call scope(len);
+        sg_blocks(in, out, len, [&](const std::uint8_t* i, std::uint8_t* o, std::size_t n) {
+            ctr_crypt<Inc>(aes, counter, i, o, n);
+        });
+    }
+
+    // CTR over fragment lists (aes_sg.hpp), the counter runs on across fragments
+    template <ctr_inc Inc = ctr_inc::be128, class AES>
+    void ctr_crypt(const AES& aes, typename AES::block_array& counter, sg_const_list in, sg_list out) {
+        ctr_crypt_sg<Inc>(aes, counter.data(), sg_cursor(in), sg_cursor(out));
+    }
+
+    template <ctr_inc Inc = ctr_inc::be128, class AES>
+    void ctr_crypt(const AES& aes, typename AES::block_array& counter, sg_list buf) {
+        ctr_crypt_sg<Inc>(aes, counter.data(), sg_cursor(buf), sg_cursor(buf));
+    }
+
+    // CTR over a message that arrives in pieces of any size. The unused
+    // keystream of a partial block is kept for the next update, whole
+    // blocks go through ctr_crypt. The stream refers to aes, which has to
+    // outlive it, and is trivially copyable.
+    template <class AES, ctr_inc Inc = ctr_inc::be128>
+    class ctr_stream
+    {
+    private:
+        const AES* aes;
+        std::uint8_t counter[16];
+        std::uint8_t ks[16];
+        unsigned used = 16;
+
+    public:
+        ctr_stream(const AES& aes, const std::uint8_t counter[16]) : aes(&aes) {
+            std::memcpy(this->counter, counter, 16);
+        }
+
+        ctr_stream(const AES& aes, const typename AES::block_array& counter) : ctr_stream(aes, counter.data()) {}
+
+        // in == out is allowed
+        void update(const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+            typename stats_t<AES>::call scope(len);
+            for (; used < 16 && len > 0; len--)
+                *out++ = *in++ ^ ks[used++];
+
+            if (const auto n = len / 16 * 16; n > 0) {
+                ctr_crypt<Inc>(*aes, counter, in, out, n);
+                in += n, out += n, len -= n;
+            }
+
+            if (len > 0) {
+                std::memset(ks, 0, 16);
+                ctr_crypt<Inc>(*aes, counter, ks, ks, 16);
+                for (used = 0; used < len; used++)
+                    out[used] = in[used] ^ ks[used];
+            }
+        }
+
+        void update(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            update(in.data(), out.data(), in.size());
+        }
+
+        // the counter block after the last one used, as ctr_crypt leaves it
+        void store(std::uint8_t block[16]) const {
+            std::memcpy(block, counter, 16);
+        }
+    };
+}
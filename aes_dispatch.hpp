@@ -0,0 +1,480 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <variant>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include "aes.hpp"
+#include "aes_ctr.hpp"
+
+// The AES-NI and SSSE3 backends are compiled for their own ISA here, so
+// that a binary built without -maes still runs the portable kernel on
+// older CPUs. Include this header before aes_x86.hpp in such a translation unit.
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("ssse3"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("ssse3")
+#endif
+#include "aes_vperm_x86.hpp"
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("aes,ssse3,pclmul"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("aes,ssse3,pclmul")
+#endif
+#include "aes_x86.hpp"
+#include "aes_ctr_x86.hpp"
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#if defined(__GNUC__)
+#define CHEAP_AES_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CHEAP_AES_TARGET(isa)
+#endif
+
+namespace cheap_aes::dispatch
+{
+    enum class kernel { portable, vperm, aesni, vaes256, vaes512 };
+
+    struct cpu_features
+    {
+        bool aes = false;
+        bool ssse3 = false;
+        bool pclmul = false;
+        bool avx2 = false;
+        bool avx512f = false;
+        bool vaes = false;
+    };
+
+    inline void cpuid(unsigned leaf, unsigned subleaf, unsigned r[4]) {
+#if defined(_MSC_VER)
+        int x[4];
+        __cpuidex(x, leaf, subleaf);
+        for (int i = 0; i < 4; i++)
+            r[i] = x[i];
+#else
+        __cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+#endif
+    }
+
+    inline std::uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        unsigned lo, hi;
+        __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        return (std::uint64_t)hi << 32 | lo;
+#endif
+    }
+
+    inline cpu_features detect_cpu() {
+        cpu_features f;
+        unsigned r[4];
+
+        cpuid(0, 0, r);
+        const auto max_leaf = r[0];
+        if (max_leaf < 1)
+            return f;
+
+        cpuid(1, 0, r);
+        f.pclmul = r[2] >> 1 & 1;
+        f.ssse3 = r[2] >> 9 & 1;
+        f.aes = r[2] >> 25 & 1;
+        const bool osxsave = r[2] >> 27 & 1;
+        const bool avx = r[2] >> 28 & 1;
+
+        // the OS has to save the YMM / ZMM state as well
+        const auto xcr0 = osxsave ? xgetbv0() : 0;
+        const bool ymm = avx && (xcr0 & 0x06) == 0x06;
+        const bool zmm = ymm && (xcr0 & 0xe6) == 0xe6;
+
+        if (max_leaf >= 7) {
+            cpuid(7, 0, r);
+            f.avx2 = ymm && (r[1] >> 5 & 1);
+            f.avx512f = zmm && (r[1] >> 16 & 1);
+            f.vaes = ymm && (r[2] >> 9 & 1);
+        }
+        return f;
+    }
+
+    inline bool supported(kernel k, const cpu_features& f) {
+        switch (k) {
+        case kernel::portable:
+            return true;
+        case kernel::vperm:
+            return f.ssse3;
+        case kernel::aesni:
+            return f.aes && f.ssse3 && f.pclmul;
+        case kernel::vaes256:
+            return supported(kernel::aesni, f) && f.avx2 && f.vaes;
+        case kernel::vaes512:
+            return supported(kernel::aesni, f) && f.avx512f && f.vaes;
+        }
+        return false;
+    }
+
+    // CPUID runs once, on first use
+    inline const cpu_features& host_cpu() {
+        static const cpu_features f = detect_cpu();
+        return f;
+    }
+
+    inline bool supported(kernel k) {
+        return supported(k, host_cpu());
+    }
+
+    inline kernel best_kernel() {
+        static const kernel k = [] {
+            for (auto k : { kernel::vaes512, kernel::vaes256, kernel::aesni, kernel::vperm })
+                if (supported(k))
+                    return k;
+            return kernel::portable;
+        }();
+        return k;
+    }
+
+    inline const char* kernel_name(kernel k) {
+        switch (k) {
+        case kernel::portable: return "portable";
+        case kernel::vperm: return "vperm";
+        case kernel::aesni: return "aesni";
+        case kernel::vaes256: return "vaes256";
+        case kernel::vaes512: return "vaes512";
+        }
+        return "unknown";
+    }
+
+    // 4 blocks per instruction, 8 instructions in flight
+    template <int Nr>
+    struct vaes512
+    {
+        static constexpr std::size_t stride = 8 * 4;
+
+        // processes the leading multiple of stride blocks, returns the count
+        template <bool Inverse>
+        CHEAP_AES_TARGET("aes,ssse3,pclmul,vaes,avx512f")
+        static std::size_t crypt(const __m128i w[Nr+1], const std::uint8_t* in, std::uint8_t* out, std::size_t n) {
+            __m512i k[Nr+1];
+            broadcast(w, k);
+
+            const auto done = n / stride * stride;
+            for (std::size_t i = 0; i < done; i += stride, in += 16*stride, out += 16*stride) {
+                __m512i s[8];
+                for (int j = 0; j < 8; j++)
+                    s[j] = _mm512_loadu_si512(in + 64*j);
+                rounds<Inverse>(k, s);
+                for (int j = 0; j < 8; j++)
+                    _mm512_storeu_si512(out + 64*j, s[j]);
+            }
+            return done;
+        }
+
+        CHEAP_AES_TARGET("aes,ssse3,pclmul,vaes,avx512f")
+        static std::size_t ctr(const __m128i w[Nr+1], std::uint8_t counter[16],
+                               const std::uint8_t* in, std::uint8_t* out, std::size_t n) {
+            __m512i k[Nr+1];
+            broadcast(w, k);
+
+            x86::ctr_counter<x86::ctr_inc::be128> cb(counter);
+            const auto done = n / stride * stride;
+            for (std::size_t i = 0; i < done; i += stride, in += 16*stride, out += 16*stride) {
+                __m128i c[stride];
+                cb.next(c);
+                __m512i s[8];
+                for (int j = 0; j < 8; j++) {
+                    auto x = _mm512_castsi128_si512(c[4*j]);
+                    x = _mm512_inserti32x4(x, c[4*j+1], 1);
+                    x = _mm512_inserti32x4(x, c[4*j+2], 2);
+                    s[j] = _mm512_inserti32x4(x, c[4*j+3], 3);
+                }
+                rounds<false>(k, s);
+                for (int j = 0; j < 8; j++)
+                    _mm512_storeu_si512(out + 64*j, _mm512_xor_si512(s[j], _mm512_loadu_si512(in + 64*j)));
+            }
+            cb.store(counter);
+            return done;
+        }
+
+        // the unmasked _mm512_broadcast_i32x4 trips -Wuninitialized inside GCC 12's header
+        CHEAP_AES_TARGET("aes,ssse3,pclmul,vaes,avx512f")
+        static inline void broadcast(const __m128i w[Nr+1], __m512i (&k)[Nr+1]) {
+            for (int i = 0; i <= Nr; i++)
+                k[i] = _mm512_maskz_broadcast_i32x4(0xffff, w[i]);
+        }
+
+        template <bool Inverse>
+        CHEAP_AES_TARGET("aes,ssse3,pclmul,vaes,avx512f")
+        static inline void rounds(const __m512i (&k)[Nr+1], __m512i (&s)[8]) {
+            for (int j = 0; j < 8; j++)
+                s[j] = _mm512_xor_si512(s[j], k[0]);
+            for (int i = 1; i < Nr; i++)
+                for (int j = 0; j < 8; j++)
+                    s[j] = Inverse ? _mm512_aesdec_epi128(s[j], k[i]) : _mm512_aesenc_epi128(s[j], k[i]);
+            for (int j = 0; j < 8; j++)
+                s[j] = Inverse ? _mm512_aesdeclast_epi128(s[j], k[Nr]) : _mm512_aesenclast_epi128(s[j], k[Nr]);
+        }
+    };
+
+    // 2 blocks per instruction, 8 instructions in flight
+    template <int Nr>
+    struct vaes256
+    {
+        static constexpr std::size_t stride = 8 * 2;
+
+        template <bool Inverse>
+        CHEAP_AES_TARGET("aes,ssse3,pclmul,vaes,avx2")
+        static std::size_t crypt(const __m128i w[Nr+1], const std::uint8_t* in, std::uint8_t* out, std::size_t n) {
+            __m256i k[Nr+1];
+            for (int i = 0; i <= Nr; i++)
+                k[i] = _mm256_broadcastsi128_si256(w[i]);
+
+            const auto done = n / stride * stride;
+            for (std::size_t i = 0; i < done; i += stride, in += 16*stride, out += 16*stride) {
+                __m256i s[8];
+                for (int j = 0; j < 8; j++)
+                    s[j] = _mm256_loadu_si256((const __m256i*)in + j);
+                rounds<Inverse>(k, s);
+                for (int j = 0; j < 8; j++)
+                    _mm256_storeu_si256((__m256i*)out + j, s[j]);
+            }
+            return done;
+        }
+
+        CHEAP_AES_TARGET("aes,ssse3,pclmul,vaes,avx2")
+        static std::size_t ctr(const __m128i w[Nr+1], std::uint8_t counter[16],
+                               const std::uint8_t* in, std::uint8_t* out, std::size_t n) {
+            __m256i k[Nr+1];
+            for (int i = 0; i <= Nr; i++)
+                k[i] = _mm256_broadcastsi128_si256(w[i]);
+
+            x86::ctr_counter<x86::ctr_inc::be128> cb(counter);
+            const auto done = n / stride * stride;
+            for (std::size_t i = 0; i < done; i += stride, in += 16*stride, out += 16*stride) {
+                __m128i c[stride];
+                cb.next(c);
+                __m256i s[8];
+                for (int j = 0; j < 8; j++)
+                    s[j] = _mm256_inserti128_si256(_mm256_castsi128_si256(c[2*j]), c[2*j+1], 1);
+                rounds<false>(k, s);
+                for (int j = 0; j < 8; j++) {
+                    auto x = _mm256_loadu_si256((const __m256i*)in + j);
+                    _mm256_storeu_si256((__m256i*)out + j, _mm256_xor_si256(s[j], x));
+                }
+            }
+            cb.store(counter);
+            return done;
+        }
+
+        template <bool Inverse>
+        CHEAP_AES_TARGET("aes,ssse3,pclmul,vaes,avx2")
+        static inline void rounds(const __m256i (&k)[Nr+1], __m256i (&s)[8]) {
+            for (int j = 0; j < 8; j++)
+                s[j] = _mm256_xor_si256(s[j], k[0]);
+            for (int i = 1; i < Nr; i++)
+                for (int j = 0; j < 8; j++)
+                    s[j] = Inverse ? _mm256_aesdec_epi128(s[j], k[i]) : _mm256_aesenc_epi128(s[j], k[i]);
+            for (int j = 0; j < 8; j++)
+                s[j] = Inverse ? _mm256_aesdeclast_epi128(s[j], k[Nr]) : _mm256_aesenclast_epi128(s[j], k[Nr]);
+        }
+    };
+
+    // Same surface as the two backends, the kernel is chosen per object
+    // (best_kernel() unless given) and bulk calls are routed to it.
+    template <int Nk, int Nb, int Nr>
+    class aes_base
+    {
+    public:
+        static constexpr int key_size() { return 4 * Nk; };
+        static constexpr int block_size() { return 4 * Nb; };
+        using key_array = std::array<std::uint8_t, key_size()>;
+        using block_array = std::array<std::uint8_t, block_size()>;
+
+    private:
+        using soft_aes = cheap_aes::aes_base<Nk, Nb, Nr>;
+        using perm_aes = vperm::aes_base<Nk, Nb, Nr>;
+        using hard_aes = x86::aes_base<Nk, Nb, Nr>;
+        using backend_type = std::variant<soft_aes, perm_aes, hard_aes>;
+
+        kernel k;
+        // only the schedule of the backend behind k, the VAES kernels use the AES-NI one
+        backend_type impl;
+
+    public:
+        explicit aes_base(kernel k = best_kernel()) : k(k), impl(backend(k)) {
+            if (!supported(k))
+                throw std::invalid_argument("cheap_aes: kernel is not supported by this CPU");
+        }
+
+        explicit aes_base(const std::uint8_t key[4*Nk], kernel k = best_kernel()) : aes_base(k) {
+            set(key);
+        }
+
+        explicit aes_base(const key_array& key, kernel k = best_kernel()) : aes_base(k) {
+            set(&key[0]);
+        }
+
+        kernel get_kernel() const {
+            return k;
+        }
+
+        void set(const std::uint8_t key[4*Nk]) {
+            std::visit([&](auto& aes) { aes.set(key); }, impl);
+        }
+
+        void set(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void encrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
+            encrypt_blocks(in, out, 1);
+        }
+
+        block_array encrypt(const block_array& in) const {
+            block_array out;
+            encrypt_blocks(&in[0], &out[0], 1);
+            return out;
+        }
+
+        void decrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
+            decrypt_blocks(in, out, 1);
+        }
+
+        block_array decrypt(const block_array& in) const {
+            block_array out;
+            decrypt_blocks(&in[0], &out[0], 1);
+            return out;
+        }
+
+        void encrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks) const {
+            crypt<false>(in, out, nblocks);
+        }
+
+        void encrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check(in, out, true);
+            crypt<false>(in.data(), out.data(), in.size() / block_size());
+        }
+
+        void decrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks) const {
+            crypt<true>(in, out, nblocks);
+        }
+
+        void decrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check(in, out, true);
+            crypt<true>(in.data(), out.data(), in.size() / block_size());
+        }
+
+        // CTR with a big-endian 128-bit counter, see x86::ctr_crypt
+        void ctr_crypt(std::uint8_t counter[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            std::size_t done = 0;
+            switch (k) {
+            case kernel::portable:
+                cheap_aes::ctr_crypt(soft(), counter, in, out, len);
+                return;
+            case kernel::vperm:
+                cheap_aes::ctr_crypt(perm(), counter, in, out, len);
+                return;
+            case kernel::aesni:
+                break;
+            case kernel::vaes256:
+                done = vaes256<Nr>::ctr(hard().round_keys(), counter, in, out, len / 16);
+                break;
+            case kernel::vaes512:
+                done = vaes512<Nr>::ctr(hard().round_keys(), counter, in, out, len / 16);
+                break;
+            }
+            x86::ctr_crypt<x86::ctr_inc::be128>(hard(), counter, in + 16*done, out + 16*done, len - 16*done);
+        }
+
+        void ctr_crypt(block_array& counter, std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check(in, out, false);
+            ctr_crypt(&counter[0], in.data(), out.data(), in.size());
+        }
+
+    private:
+        template <bool Inverse>
+        void crypt(const std::uint8_t* in, std::uint8_t* out, std::size_t n) const {
+            std::size_t done = 0;
+            switch (k) {
+            case kernel::portable:
+                if (Inverse)
+                    soft().decrypt_blocks(in, out, n);
+                else
+                    soft().encrypt_blocks(in, out, n);
+                return;
+            case kernel::vperm:
+                if (Inverse)
+                    perm().decrypt_blocks(in, out, n);
+                else
+                    perm().encrypt_blocks(in, out, n);
+                return;
+            case kernel::aesni:
+                break;
+            case kernel::vaes256:
+                done = vaes256<Nr>::template crypt<Inverse>(keys<Inverse>(), in, out, n);
+                break;
+            case kernel::vaes512:
+                done = vaes512<Nr>::template crypt<Inverse>(keys<Inverse>(), in, out, n);
+                break;
+            }
+            if (Inverse)
+                hard().decrypt_blocks(in + 16*done, out + 16*done, n - done);
+            else
+                hard().encrypt_blocks(in + 16*done, out + 16*done, n - done);
+        }
+
+        const soft_aes& soft() const { return std::get<soft_aes>(impl); }
+        const perm_aes& perm() const { return std::get<perm_aes>(impl); }
+        const hard_aes& hard() const { return std::get<hard_aes>(impl); }
+
+        static backend_type backend(kernel k) {
+            switch (k) {
+            case kernel::portable:
+                return backend_type(std::in_place_type<soft_aes>);
+            case kernel::vperm:
+                return backend_type(std::in_place_type<perm_aes>);
+            default:
+                return backend_type(std::in_place_type<hard_aes>);
+            }
+        }
+
+        template <bool Inverse>
+        const __m128i* keys() const {
+            return Inverse ? hard().inv_round_keys() : hard().round_keys();
+        }
+
+        static void check(std::span<const std::uint8_t> in, std::span<std::uint8_t> out, bool whole_blocks) {
+            if (whole_blocks && in.size() % block_size() != 0)
+                throw std::invalid_argument("cheap_aes: input is not a multiple of the block size");
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+        }
+    };
+
+    using aes128 = aes_base<4, 4, 10>;
+    using aes192 = aes_base<6, 4, 12>;
+    using aes256 = aes_base<8, 4, 14>;
+}
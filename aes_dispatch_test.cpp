@@ -0,0 +1,94 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <stdexcept>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes_dispatch.hpp"
+
+using namespace cheap_aes::dispatch;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+// an object keeps the schedule of its own backend only, less than any two of them
+static_assert(sizeof(aes256) < sizeof(cheap_aes::aes256) + sizeof(cheap_aes::vperm::aes256));
+
+constexpr kernel all_kernels[] = { kernel::portable, kernel::vperm, kernel::aesni, kernel::vaes256, kernel::vaes512 };
+
+template <class AES>
+void test_dispatch_vector(const typename AES::key_array& key, const typename AES::block_array& expected)
+{
+    auto text = 0x00112233445566778899aabbccddeeff_bytes;
+    for (auto k : all_kernels) {
+        if (!supported(k))
+            continue;
+        AES aes(key, k);
+        runtime_assert(aes.get_kernel() == k);
+        runtime_assert(aes.encrypt(text) == expected);
+        runtime_assert(aes.decrypt(expected) == text);
+    }
+}
+
+// every available kernel has to agree with the portable one
+template <class AES>
+void test_dispatch_cross(const typename AES::key_array& key)
+{
+    AES ref(key, kernel::portable);
+    for (auto k : all_kernels) {
+        if (!supported(k))
+            continue;
+        AES aes(key, k);
+        for (std::size_t n : {0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 64, 100}) {
+            std::vector<std::uint8_t> text(n * 16 + 5);
+            for (std::size_t i = 0; i < text.size(); i++)
+                text[i] = i * 7 + 1;
+            std::span<const std::uint8_t> blocks(text.data(), n * 16);
+
+            std::vector<std::uint8_t> enc(n * 16), ref_enc(n * 16);
+            aes.encrypt_blocks(blocks, enc);
+            ref.encrypt_blocks(blocks, ref_enc);
+            runtime_assert(enc == ref_enc);
+
+            aes.decrypt_blocks(enc, enc);
+            runtime_assert(std::ranges::equal(enc, blocks));
+
+            auto ctr = 0x0011223344556677fffffffffffffff0_bytes;
+            auto ref_ctr = ctr;
+            std::vector<std::uint8_t> ks(text.size()), ref_ks(text.size());
+            aes.ctr_crypt(ctr, text, ks);
+            ref.ctr_crypt(ref_ctr, text, ref_ks);
+            runtime_assert(ks == ref_ks);
+            runtime_assert(ctr == ref_ctr);
+        }
+    }
+}
+
+void test_dispatch_best()
+{
+    auto k = best_kernel();
+    runtime_assert(supported(k));
+    runtime_assert(aes128().get_kernel() == k);
+    for (auto x : all_kernels) {
+        if (supported(x))
+            continue;
+        bool thrown = false;
+        try {
+            aes128 aes(x);
+        } catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        runtime_assert(thrown);
+    }
+}
+
+int main()
+{
+    test_dispatch_best();
+    test_dispatch_vector<aes128>(0x000102030405060708090a0b0c0d0e0f_bytes, 0x69c4e0d86a7b0430d8cdb78070b4c55a_bytes);
+    test_dispatch_vector<aes192>(0x000102030405060708090a0b0c0d0e0f1011121314151617_bytes, 0xdda97ca4864cdfe06eaf70a0ec0d7191_bytes);
+    test_dispatch_vector<aes256>(0x000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f_bytes, 0x8ea2b7ca516745bfeafc49904b496089_bytes);
+    test_dispatch_cross<aes128>(0x000102030405060708090a0b0c0d0e0f_bytes);
+    test_dispatch_cross<aes192>(0x000102030405060708090a0b0c0d0e0f1011121314151617_bytes);
+    test_dispatch_cross<aes256>(0x000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f_bytes);
+}
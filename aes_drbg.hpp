@@ -0,0 +1,295 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#if defined(__unix__)
+#include <pthread.h>
+#endif
+#include "aes.hpp"
+
+namespace cheap_aes
+{
+    // NIST SP 800-90A CTR_DRBG without a derivation function, on any backend
+    // with set and encrypt_blocks. The entropy input is seed_size() bytes of
+    // full entropy; personalization and additional input are at most as long.
+    template <class AES>
+    class ctr_drbg
+    {
+    public:
+        static constexpr int seed_size() { return AES::key_size() + 16; };
+        // 2^19 bits per request, 2^48 requests between reseeds
+        static constexpr std::size_t max_request() { return std::size_t(1) << 16; };
+        static constexpr std::uint64_t reseed_interval() { return std::uint64_t(1) << 48; };
+        using seed_array = std::array<std::uint8_t, seed_size()>;
+
+    private:
+        AES aes;
+        std::uint8_t v[16] = {};
+        std::uint64_t counter = 0;
+
+    public:
+        constexpr ctr_drbg() {}
+
+        constexpr explicit ctr_drbg(const seed_array& entropy, std::span<const std::uint8_t> personalization = {}) {
+            instantiate(entropy, personalization);
+        }
+
+        constexpr void instantiate(const seed_array& entropy, std::span<const std::uint8_t> personalization = {}) {
+            const std::uint8_t zero[AES::key_size()] = {};
+            aes.set(zero);
+            std::fill(v, v + 16, 0);
+            reseed(entropy, personalization);
+        }
+
+        constexpr void reseed(const seed_array& entropy, std::span<const std::uint8_t> additional = {}) {
+            auto seed = padded(additional);
+            for (int i = 0; i < seed_size(); i++)
+                seed[i] ^= entropy[i];
+            update(&seed[0]);
+            counter = 1;
+        }
+
+        // len bytes of output, 8 counter blocks per encrypt_blocks round
+        constexpr void generate(std::uint8_t* out, std::size_t len, std::span<const std::uint8_t> additional = {}) {
+            if (len > max_request())
+                throw std::invalid_argument("cheap_aes: DRBG request is too long");
+            if (counter == 0 || counter > reseed_interval())
+                throw std::logic_error("cheap_aes: DRBG needs a reseed");
+
+            const auto input = padded(additional);
+            if (!additional.empty())
+                update(&input[0]);
+
+            const auto n = len / 16;
+            counter_blocks(out, n);
+            aes.encrypt_blocks(out, out, n);
+            if (len % 16 != 0) {
+                std::uint8_t b[16] = {};
+                counter_blocks(b, 1);
+                aes.encrypt_blocks(b, b, 1);
+                std::copy(b, b + len % 16, out + 16*n);
+            }
+
+            update(&input[0]);
+            counter++;
+        }
+
+        constexpr void generate(std::span<std::uint8_t> out, std::span<const std::uint8_t> additional = {}) {
+            generate(out.data(), out.size(), additional);
+        }
+
+        // requests since the last (re)seed, plus one
+        constexpr std::uint64_t reseed_counter() const {
+            return counter;
+        }
+
+    private:
+        static constexpr seed_array padded(std::span<const std::uint8_t> input) {
+            if (input.size() > (std::size_t)seed_size())
+                throw std::invalid_argument("cheap_aes: DRBG input is longer than the seed");
+            seed_array x{};
+            std::copy(input.begin(), input.end(), x.begin());
+            return x;
+        }
+
+        // CTR_DRBG_Update: the next Key and V from seed_size() bytes of keystream
+        constexpr void update(const std::uint8_t provided[seed_size()]) {
+            constexpr int nblocks = (seed_size() + 15) / 16;
+            std::uint8_t temp[16*nblocks] = {};
+            counter_blocks(temp, nblocks);
+            aes.encrypt_blocks(temp, temp, nblocks);
+            for (int i = 0; i < seed_size(); i++)
+                temp[i] ^= provided[i];
+            aes.set(temp);
+            std::copy(temp + AES::key_size(), temp + seed_size(), v);
+        }
+
+        // V+1 .. V+n as big-endian 128-bit numbers, V is left at V+n
+        constexpr void counter_blocks(std::uint8_t* out, std::size_t n) {
+            auto hi = get_be64(v);
+            auto lo = get_be64(v + 8);
+            for (std::size_t i = 0; i < n; i++) {
+                hi += ++lo == 0;
+                put_be64(out + 16*i, hi);
+                put_be64(out + 16*i + 8, lo);
+            }
+            put_be64(v, hi);
+            put_be64(v + 8, lo);
+        }
+
+        static constexpr std::uint64_t get_be64(const std::uint8_t* p) {
+            std::uint64_t x = 0;
+            for (int i = 0; i < 8; i++)
+                x = x << 8 | p[i];
+            return x;
+        }
+
+        // a byteswap and one store at run time, where the byte loop stays 8 stores
+        static constexpr void put_be64(std::uint8_t* p, std::uint64_t x) {
+            if (std::is_constant_evaluated() || std::endian::native != std::endian::little) {
+                for (int i = 7; i >= 0; i--, x >>= 8)
+                    p[i] = (std::uint8_t)x;
+            } else {
+                x = (x & 0x00000000ffffffff) << 32 | (x & 0xffffffff00000000) >> 32;
+                x = (x & 0x0000ffff0000ffff) << 16 | (x & 0xffff0000ffff0000) >> 16;
+                x = (x & 0x00ff00ff00ff00ff) << 8 | (x & 0xff00ff00ff00ff00) >> 8;
+                std::memcpy(p, &x, 8);
+            }
+        }
+    };
+
+    // how much one thread's generator gives out before it reseeds
+    struct drbg_budget
+    {
+        std::uint64_t bytes = std::uint64_t(1) << 30;
+        std::chrono::nanoseconds time = std::chrono::minutes(1);
+    };
+
+    // fork() generations seen by this process, for a child not to repeat its parent's output
+    inline std::atomic<unsigned> drbg_forks{0};
+
+    inline unsigned drbg_fork_count() {
+#if defined(__unix__)
+        static const int registered = ::pthread_atfork(nullptr, nullptr, [] {
+            drbg_forks.fetch_add(1, std::memory_order_relaxed);
+        });
+        (void)registered;
+#endif
+        return drbg_forks.load(std::memory_order_relaxed);
+    }
+
+    // Random bytes from a CTR_DRBG of each thread, seeded from std::random_device.
+    // Requests are served without locks from a buffer of Buffer bytes that one
+    // generate call refills, and served bytes are cleared. A thread reseeds at
+    // a refill once it has used up the budget, and in a child after fork().
+    template <class AES, std::size_t Buffer = 4096>
+    class thread_drbg
+    {
+        static_assert(Buffer % 64 == 0 && Buffer <= ctr_drbg<AES>::max_request());
+
+    private:
+        struct alignas(64) state
+        {
+            std::uint8_t buf[Buffer];
+            std::size_t pos = Buffer;
+            ctr_drbg<AES> drbg;
+            bool seeded = false;
+            unsigned forks = 0;
+            std::uint64_t given = 0;
+            std::chrono::steady_clock::time_point seeded_at;
+            std::uint64_t reseeds = 0;
+        };
+
+        inline static std::atomic<std::uint64_t> budget_bytes{drbg_budget().bytes};
+        inline static std::atomic<std::int64_t> budget_ns{drbg_budget().time.count()};
+
+    public:
+        // applies to every thread from its next refill
+        static void set_budget(const drbg_budget& b) {
+            budget_bytes.store(b.bytes, std::memory_order_relaxed);
+            budget_ns.store(b.time.count(), std::memory_order_relaxed);
+        }
+
+        static drbg_budget budget() {
+            return { budget_bytes.load(std::memory_order_relaxed),
+                     std::chrono::nanoseconds(budget_ns.load(std::memory_order_relaxed)) };
+        }
+
+        static void fill(std::uint8_t* out, std::size_t len) {
+            auto& s = local();
+            if (s.forks != drbg_fork_count())
+                discard(s);
+
+            while (len > 0) {
+                if (s.pos == Buffer)
+                    refill(s);
+                const auto n = std::min(len, Buffer - s.pos);
+                std::memcpy(out, s.buf + s.pos, n);
+                std::memset(s.buf + s.pos, 0, n);
+                s.pos += n;
+                out += n;
+                len -= n;
+            }
+        }
+
+        static void fill(std::span<std::uint8_t> out) {
+            fill(out.data(), out.size());
+        }
+
+        template <class T>
+        static T get() requires std::is_trivially_copyable_v<T> {
+            T x;
+            fill((std::uint8_t*)&x, sizeof(x));
+            return x;
+        }
+
+        // drops this thread's buffered output and reseeds before the next request
+        static void reseed() {
+            discard(local());
+        }
+
+        // this thread's seedings, the first one included
+        static std::uint64_t reseeds() {
+            return local().reseeds;
+        }
+
+    private:
+        static state& local() {
+            thread_local state s;
+            return s;
+        }
+
+        static void discard(state& s) {
+            std::memset(s.buf + s.pos, 0, Buffer - s.pos);
+            s.pos = Buffer;
+            s.seeded = false;
+        }
+
+        static void refill(state& s) {
+            const auto now = std::chrono::steady_clock::now();
+            if (!s.seeded || s.given >= budget_bytes.load(std::memory_order_relaxed) ||
+                now - s.seeded_at >= std::chrono::nanoseconds(budget_ns.load(std::memory_order_relaxed))) {
+                const auto e = entropy();
+                if (s.reseeds == 0)
+                    s.drbg.instantiate(e);
+                else
+                    s.drbg.reseed(e);
+                s.seeded = true;
+                s.forks = drbg_fork_count();
+                s.given = 0;
+                s.seeded_at = now;
+                s.reseeds++;
+            }
+            s.drbg.generate(s.buf, Buffer);
+            s.given += Buffer;
+            s.pos = 0;
+        }
+
+        static typename ctr_drbg<AES>::seed_array entropy() {
+            std::random_device rd;
+            typename ctr_drbg<AES>::seed_array e;
+            for (std::size_t i = 0; i < e.size(); i += 4) {
+                const std::uint32_t x = rd();
+                std::memcpy(&e[i], &x, 4);
+            }
+            return e;
+        }
+    };
+
+    using ctr_drbg128 = ctr_drbg<aes128>;
+    using ctr_drbg192 = ctr_drbg<aes192>;
+    using ctr_drbg256 = ctr_drbg<aes256>;
+    using thread_drbg256 = thread_drbg<aes256>;
+}
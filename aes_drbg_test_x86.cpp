@@ -0,0 +1,187 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <array>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes_drbg.hpp"
+#include "aes_drbg_x86.hpp"
+#if defined(__unix__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace cheap_aes;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+// CAVP CTR_DRBG [AES-128 no df], no prediction resistance, COUNT = 0:
+// instantiate, reseed, generate twice and return the second output
+template <class DRBG>
+constexpr std::array<std::uint8_t, 64> cavp_aes128_no_df()
+{
+    DRBG drbg(0xed1e7f21ef66ea5d8e2a85b9337245445b71d6393a4eecb0e63c193d0f72f9a9_bytes);
+    drbg.reseed(0x303fb519f0a4e17d6df0b6426aa0ecb2a36079bd48be47ad2a8dbfe48da3efad_bytes);
+    std::array<std::uint8_t, 64> out{};
+    drbg.generate(out);
+    drbg.generate(out);
+    return out;
+}
+
+constexpr auto cavp_expected = 0xf80111d08e874672f32f42997133a5210f7a9375e22cea70587f9cfafebe0f6a6aa2eb68e7dd9164536d53fa020fcab20f54caddfab7d6d91e5ffec1dfd8deaa_bytes;
+
+static_assert(cavp_aes128_no_df<ctr_drbg128>() == cavp_expected);
+
+void test_drbg_cavp_x86()
+{
+    runtime_assert(cavp_aes128_no_df<x86::ctr_drbg128>() == cavp_expected);
+}
+
+std::vector<std::uint8_t> make_bytes(std::size_t len, int a, int b)
+{
+    std::vector<std::uint8_t> x(len);
+    for (std::size_t i = 0; i < len; i++)
+        x[i] = i * a + b;
+    return x;
+}
+
+// personalization, additional input, a reseed with additional input and
+// partial blocks; the last 16 bytes of each output
+template <class Soft, class Hard>
+void test_drbg_inputs_x86(const std::array<std::array<std::uint8_t, 16>, 3>& expected)
+{
+    const auto seed_size = Soft::seed_size();
+    typename Soft::seed_array e1, e2;
+    const auto b1 = make_bytes(seed_size, 7, 1), b2 = make_bytes(seed_size, 11, 9);
+    std::copy(b1.begin(), b1.end(), e1.begin());
+    std::copy(b2.begin(), b2.end(), e2.begin());
+    const auto pers = make_bytes(20, 3, 5);
+    const auto add = make_bytes(seed_size, 5, 2);
+    const std::uint8_t add2[] = {1, 2, 3};
+
+    Soft soft(e1, pers);
+    Hard hard(e1, pers);
+    const std::size_t lens[] = {100, 37, 64};
+    for (int i = 0; i < 3; i++) {
+        if (i == 2) {
+            soft.reseed(e2, add2);
+            hard.reseed(e2, add2);
+        }
+        const std::span<const std::uint8_t> input = i == 1 ? std::span<const std::uint8_t>(add) : std::span<const std::uint8_t>();
+        std::vector<std::uint8_t> a(lens[i]), b(lens[i]);
+        soft.generate(a, input);
+        hard.generate(b, input);
+        runtime_assert(a == b);
+        runtime_assert(std::equal(expected[i].begin(), expected[i].end(), a.end() - 16));
+    }
+    runtime_assert(soft.reseed_counter() == 2 && hard.reseed_counter() == 2);
+}
+
+template <class F>
+bool throws(F&& f)
+{
+    try {
+        f();
+    } catch (const std::exception&) {
+        return true;
+    }
+    return false;
+}
+
+void test_drbg_errors_x86()
+{
+    x86::ctr_drbg256 drbg;
+    std::vector<std::uint8_t> out(x86::ctr_drbg256::max_request() + 1);
+    runtime_assert(throws([&] { drbg.generate(out.data(), 16); }));
+
+    drbg.instantiate(x86::ctr_drbg256::seed_array{});
+    runtime_assert(throws([&] { drbg.generate(out); }));
+    drbg.generate(out.data(), out.size() - 1);
+    const auto long_input = make_bytes(x86::ctr_drbg256::seed_size() + 1, 1, 0);
+    runtime_assert(throws([&] { drbg.generate(out.data(), 16, long_input); }));
+    runtime_assert(throws([&] { drbg.reseed(x86::ctr_drbg256::seed_array{}, long_input); }));
+}
+
+// every thread its own stream, and a reseed once the budget is spent
+void test_thread_drbg_x86()
+{
+    using drbg = x86::thread_drbg256;
+    std::vector<std::array<std::uint8_t, 32>> outs(4);
+    std::vector<std::thread> threads;
+    for (auto& out : outs)
+        threads.emplace_back([&out] { drbg::fill(out); });
+    for (auto& t : threads)
+        t.join();
+    std::set<std::array<std::uint8_t, 32>> distinct(outs.begin(), outs.end());
+    runtime_assert(distinct.size() == outs.size());
+
+    const auto saved = drbg::budget();
+    drbg::set_budget({ 3 * 4096, saved.time });
+    drbg::reseed();
+    std::vector<std::uint8_t> buf(10 * 4096 + 5);
+    const auto before = drbg::reseeds();
+    for (std::size_t off = 0; off < buf.size(); off += 77)
+        drbg::fill(&buf[off], std::min<std::size_t>(77, buf.size() - off));
+    // 11 refills, a seed for each 3
+    runtime_assert(drbg::reseeds() - before == 4);
+    drbg::set_budget(saved);
+
+    const auto a = drbg::get<std::uint64_t>(), b = drbg::get<std::uint64_t>();
+    runtime_assert(a != b);
+}
+
+#if defined(__unix__)
+// a child after fork() must not give out what its parent does
+void test_thread_drbg_fork_x86()
+{
+    using drbg = x86::thread_drbg256;
+    std::uint8_t x[16];
+    drbg::fill(x, 1);
+
+    int fds[2];
+    runtime_assert(::pipe(fds) == 0);
+    const auto pid = ::fork();
+    if (pid == 0) {
+        drbg::fill(x, 16);
+        ::_exit(::write(fds[1], x, 16) == 16 ? 0 : 1);
+    }
+    std::uint8_t y[16];
+    drbg::fill(x, 16);
+    runtime_assert(::read(fds[0], y, 16) == 16);
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    ::close(fds[0]);
+    ::close(fds[1]);
+    runtime_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    runtime_assert(!std::equal(x, x + 16, y));
+}
+#endif
+
+int main()
+{
+    test_drbg_cavp_x86();
+    test_drbg_inputs_x86<ctr_drbg128, x86::ctr_drbg128>({
+        0x4f9e0e1d2ce12747b46138afcec2cb26_bytes,
+        0x73fa106fba9e052e796b8e892a59482a_bytes,
+        0xbac19f3609dd848417287ea43d89eeab_bytes,
+    });
+    test_drbg_inputs_x86<ctr_drbg192, x86::ctr_drbg192>({
+        0xc6a0537930775704751953edea66bc99_bytes,
+        0x56dcd928343ee163e0226165e09ace01_bytes,
+        0xbf3260b5dbebfb4532d601bc9a2d491b_bytes,
+    });
+    test_drbg_inputs_x86<ctr_drbg256, x86::ctr_drbg256>({
+        0xd53a8227747f1c8c4bc38631f4a8246d_bytes,
+        0x62c31674a6c80db2ef7e28fa9d701eb0_bytes,
+        0x0c58b2b7b9a8a41941a299168fc82dd6_bytes,
+    });
+    test_drbg_errors_x86();
+    test_thread_drbg_x86();
+#if defined(__unix__)
+    test_thread_drbg_fork_x86();
+#endif
+}
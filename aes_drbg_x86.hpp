@@ -0,0 +1,15 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include "aes_drbg.hpp"
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    // the DRBG only encrypts, so the contexts keep no decryption schedule
+    using ctr_drbg128 = cheap_aes::ctr_drbg<aes128_enc>;
+    using ctr_drbg192 = cheap_aes::ctr_drbg<aes192_enc>;
+    using ctr_drbg256 = cheap_aes::ctr_drbg<aes256_enc>;
+    using thread_drbg256 = cheap_aes::thread_drbg<aes256_enc>;
+}
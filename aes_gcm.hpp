@@ -0,0 +1,246 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include "aes.hpp"
+
+namespace cheap_aes
+{
+    // GHASH of NIST SP 800-38D, bit by bit so that it runs in constexpr
+    class ghash
+    {
+    public:
+        using block_array = std::array<std::uint8_t, 16>;
+
+    private:
+        std::uint64_t hh = 0, hl = 0;
+
+    public:
+        constexpr ghash() {}
+
+        constexpr explicit ghash(const std::uint8_t h[16]) {
+            set(h);
+        }
+
+        constexpr explicit ghash(const block_array& h) {
+            set(&h[0]);
+        }
+
+        constexpr void set(const std::uint8_t h[16]) {
+            hh = load64(&h[0]);
+            hl = load64(&h[8]);
+        }
+
+        constexpr void set(const block_array& h) {
+            set(&h[0]);
+        }
+
+        // y = (y ^ X) * H for each block X, the last partial block is zero padded
+        constexpr void update(block_array& y, const std::uint8_t* data, std::size_t len) const {
+            while (len > 0) {
+                auto n = std::min<std::size_t>(len, 16);
+                for (std::size_t i = 0; i < n; i++)
+                    y[i] ^= data[i];
+                mul_h(y);
+                data += n;
+                len -= n;
+            }
+        }
+
+        // absorbs [len(A)]64 || [len(C)]64, lengths are in bytes
+        constexpr void update_lengths(block_array& y, std::uint64_t aad_len, std::uint64_t len) const {
+            std::uint8_t block[16];
+            store64(&block[0], aad_len * 8);
+            store64(&block[8], len * 8);
+            update(y, block, 16);
+        }
+
+        // GHASH(H, A, C)
+        constexpr block_array digest(std::span<const std::uint8_t> aad, std::span<const std::uint8_t> c) const {
+            block_array y = {};
+            update(y, aad.data(), aad.size());
+            update(y, c.data(), c.size());
+            update_lengths(y, aad.size(), c.size());
+            return y;
+        }
+
+    private:
+        constexpr void mul_h(block_array& y) const {
+            const auto xh = load64(&y[0]);
+            const auto xl = load64(&y[8]);
+            std::uint64_t zh = 0, zl = 0;
+            std::uint64_t vh = hh, vl = hl;
+
+            for (int i = 0; i < 128; i++) {
+                const auto bit = i < 64 ? xh >> (63 - i) : xl >> (127 - i);
+                if (bit & 1) {
+                    zh ^= vh;
+                    zl ^= vl;
+                }
+                const auto lsb = vl & 1;
+                vl = vl >> 1 | vh << 63;
+                vh >>= 1;
+                if (lsb)
+                    vh ^= 0xe100000000000000;
+            }
+
+            store64(&y[0], zh);
+            store64(&y[8], zl);
+        }
+
+        static constexpr std::uint64_t load64(const std::uint8_t p[8]) {
+            std::uint64_t n = 0;
+            for (int i = 0; i < 8; i++)
+                n = n << 8 | p[i];
+            return n;
+        }
+
+        static constexpr void store64(std::uint8_t p[8], std::uint64_t n) {
+            for (int i = 7; i >= 0; i--, n >>= 8)
+                p[i] = n & 0xff;
+        }
+    };
+
+    template <class AES>
+    class gcm_base
+    {
+    public:
+        static constexpr int key_size() { return AES::key_size(); };
+        static constexpr int tag_size() { return 16; };
+        using key_array = typename AES::key_array;
+        using tag_array = std::array<std::uint8_t, tag_size()>;
+
+    private:
+        AES aes;
+        ghash gh;
+
+    public:
+        constexpr gcm_base() {}
+
+        constexpr explicit gcm_base(const std::uint8_t key[AES::key_size()]) {
+            set(key);
+        }
+
+        constexpr explicit gcm_base(const key_array& key) {
+            set(&key[0]);
+        }
+
+        constexpr void set(const std::uint8_t key[AES::key_size()]) {
+            aes.set(key);
+            std::uint8_t zero[16] = {};
+            std::uint8_t h[16];
+            aes.encrypt(zero, h);
+            gh.set(h);
+        }
+
+        constexpr void set(const key_array& key) {
+            set(&key[0]);
+        }
+
+        constexpr void seal(const std::uint8_t* iv, std::size_t iv_len,
+                            const std::uint8_t* aad, std::size_t aad_len,
+                            const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                            std::uint8_t tag[16]) const {
+            typename stats_t<AES>::call scope(len);
+            std::uint8_t j0[16];
+            make_j0(iv, iv_len, j0);
+            ctr32(j0, in, out, len);
+            make_tag(j0, aad, aad_len, out, len, tag);
+        }
+
+        // returns false and clears out when the tag does not match
+        constexpr bool open(const std::uint8_t* iv, std::size_t iv_len,
+                            const std::uint8_t* aad, std::size_t aad_len,
+                            const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                            const std::uint8_t tag[16]) const {
+            typename stats_t<AES>::call scope(len);
+            std::uint8_t j0[16];
+            make_j0(iv, iv_len, j0);
+            std::uint8_t expected[16];
+            make_tag(j0, aad, aad_len, in, len, expected);
+
+            std::uint8_t diff = 0;
+            for (int i = 0; i < 16; i++)
+                diff |= expected[i] ^ tag[i];
+            if (diff != 0) {
+                std::fill(out, out + len, 0);
+                return false;
+            }
+
+            ctr32(j0, in, out, len);
+            return true;
+        }
+
+        constexpr void seal(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                            std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                            tag_array& tag) const {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            seal(iv.data(), iv.size(), aad.data(), aad.size(), in.data(), out.data(), in.size(), &tag[0]);
+        }
+
+        constexpr bool open(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                            std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                            const tag_array& tag) const {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            return open(iv.data(), iv.size(), aad.data(), aad.size(), in.data(), out.data(), in.size(), &tag[0]);
+        }
+
+    private:
+        constexpr void make_j0(const std::uint8_t* iv, std::size_t iv_len, std::uint8_t j0[16]) const {
+            if (iv_len == 12) {
+                std::copy(iv, iv + 12, j0);
+                j0[12] = j0[13] = j0[14] = 0;
+                j0[15] = 1;
+            } else {
+                ghash::block_array y = {};
+                gh.update(y, iv, iv_len);
+                gh.update_lengths(y, 0, iv_len);
+                std::ranges::copy(y, j0);
+            }
+        }
+
+        constexpr void make_tag(const std::uint8_t j0[16], const std::uint8_t* aad, std::size_t aad_len,
+                                const std::uint8_t* c, std::size_t len, std::uint8_t tag[16]) const {
+            ghash::block_array y = {};
+            gh.update(y, aad, aad_len);
+            gh.update(y, c, len);
+            gh.update_lengths(y, aad_len, len);
+
+            std::uint8_t s[16];
+            aes.encrypt(j0, s);
+            for (int i = 0; i < 16; i++)
+                tag[i] = y[i] ^ s[i];
+        }
+
+        constexpr void ctr32(const std::uint8_t j0[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            std::uint8_t cb[16];
+            std::copy(j0, j0 + 16, cb);
+
+            for (std::size_t i = 0; i < len; i += 16) {
+                inc32(cb);
+                std::uint8_t ks[16];
+                aes.encrypt(cb, ks);
+                for (std::size_t j = 0; j < 16 && i + j < len; j++)
+                    out[i+j] = in[i+j] ^ ks[j];
+            }
+        }
+
+        static constexpr void inc32(std::uint8_t cb[16]) {
+            for (int i = 15; i >= 12; i--)
+                if (++cb[i] != 0)
+                    break;
+        }
+    };
+
+    using gcm128 = gcm_base<aes128>;
+    using gcm192 = gcm_base<aes192>;
+    using gcm256 = gcm_base<aes256>;
+}
@@ -0,0 +1,161 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes_gcm.hpp"
+#include "aes_gcm_x86.hpp"
+
+using namespace cheap_aes::x86;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+// The Galois/Counter Mode of Operation (GCM), test cases 3-6, 10 and 16
+const auto gcm_iv = 0xcafebabefacedbaddecaf888_bytes;
+const auto gcm_aad = 0xfeedfacedeadbeeffeedfacedeadbeefabaddad2_bytes;
+const auto gcm_text = 0xd9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255_bytes;
+
+template <class GCM, std::size_t N>
+void test_gcm_vector(const GCM& gcm, std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad, std::size_t len,
+                     const std::array<std::uint8_t, N>& expected, const typename GCM::tag_array& expected_tag)
+{
+    std::span<const std::uint8_t> text(gcm_text.data(), len);
+    std::vector<std::uint8_t> enc(len);
+    typename GCM::tag_array tag;
+    gcm.seal(iv, aad, text, enc, tag);
+    runtime_assert(std::equal(enc.begin(), enc.end(), expected.begin(), expected.end()));
+    runtime_assert(tag == expected_tag);
+
+    std::vector<std::uint8_t> dec(len);
+    runtime_assert(gcm.open(iv, aad, enc, dec, tag));
+    runtime_assert(std::ranges::equal(dec, text));
+
+    tag[15] ^= 1;
+    runtime_assert(!gcm.open(iv, aad, enc, dec, tag));
+    runtime_assert(std::ranges::all_of(dec, [](auto x) { return x == 0; }));
+}
+
+void test_gcm128_x86()
+{
+    gcm128 gcm(0xfeffe9928665731c6d6a8f9467308308_bytes);
+    test_gcm_vector(gcm, gcm_iv, {}, 64,
+                    0x42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985_bytes,
+                    0x4d5c2af327cd64a62cf35abd2ba6fab4_bytes);
+    test_gcm_vector(gcm, gcm_iv, gcm_aad, 60,
+                    0x42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091_bytes,
+                    0x5bc94fbc3221a5db94fae95ae7121a47_bytes);
+    test_gcm_vector(gcm, 0xcafebabefacedbad_bytes, gcm_aad, 60,
+                    0x61353b4c2806934a777ff51fa22a4755699b2a714fcdc6f83766e5f97b6c742373806900e49f24b22b097544d4896b424989b5e1ebac0f07c23f4598_bytes,
+                    0x3612d2e79e3b0785561be14aaca2fccb_bytes);
+    test_gcm_vector(gcm, 0x9313225df88406e555909c5aff5269aa6a7a9538534f7da1e4c303d2a318a728c3c0c95156809539fcf0e2429a6b525416aedbf5a0de6a57a637b39b_bytes, gcm_aad, 60,
+                    0x8ce24998625615b603a033aca13fb894be9112a5c3a211a8ba262a3cca7e2ca701e4a9a4fba43c90ccdcb281d48c7c6fd62875d2aca417034c34aee5_bytes,
+                    0x619cc5aefffe0bfa462af43c1699d050_bytes);
+}
+
+void test_gcm192_x86()
+{
+    gcm192 gcm(0xfeffe9928665731c6d6a8f9467308308feffe9928665731c_bytes);
+    test_gcm_vector(gcm, gcm_iv, gcm_aad, 60,
+                    0x3980ca0b3c00e841eb06fac4872a2757859e1ceaa6efd984628593b40ca1e19c7d773d00c144c525ac619d18c84a3f4718e2448b2fe324d9ccda2710_bytes,
+                    0x2519498e80f1478f37ba55bd6d27618c_bytes);
+}
+
+void test_gcm256_x86()
+{
+    gcm256 gcm(0xfeffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308_bytes);
+    test_gcm_vector(gcm, gcm_iv, gcm_aad, 60,
+                    0x522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662_bytes,
+                    0x76fc6ece0f4e1768cddf8853bb2d551b_bytes);
+}
+
+// the 8-wide stitched paths against the portable implementation
+void test_gcm_long_x86()
+{
+    auto key = 0x000102030405060708090a0b0c0d0e0f_bytes;
+    gcm128 gcm(key);
+    cheap_aes::gcm128 ref(key);
+
+    for (std::size_t len : {0, 1, 16, 127, 128, 129, 255, 256, 300, 1024, 1031}) {
+        for (std::size_t aad_len : {0, 5, 16, 200}) {
+            std::vector<std::uint8_t> text(len), aad(aad_len);
+            for (std::size_t i = 0; i < len; i++)
+                text[i] = i * 11 + 3;
+            for (std::size_t i = 0; i < aad_len; i++)
+                aad[i] = i * 5 + 1;
+
+            std::vector<std::uint8_t> enc(len), ref_enc(len);
+            gcm128::tag_array tag, ref_tag;
+            gcm.seal(gcm_iv, aad, text, enc, tag);
+            ref.seal(gcm_iv, aad, text, ref_enc, ref_tag);
+            runtime_assert(enc == ref_enc);
+            runtime_assert(tag == ref_tag);
+
+            runtime_assert(gcm.open(gcm_iv, aad, enc, enc, tag));
+            runtime_assert(enc == text);
+        }
+    }
+}
+
+// uploads in pieces of any size, with the GHASH block and keystream split across them
+void test_gcm_stream_x86()
+{
+    static_assert(std::is_trivially_copyable_v<gcm_stream<aes256>>);
+
+    gcm256 gcm(0xfeffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308_bytes);
+    std::vector<std::uint8_t> text(3000), aad(37);
+    for (std::size_t i = 0; i < text.size(); i++)
+        text[i] = i * 11 + 3;
+    for (std::size_t i = 0; i < aad.size(); i++)
+        aad[i] = i * 5 + 1;
+
+    const std::size_t chunks[] = {1, 0, 15, 3, 16, 200, 7, 129, 1, 1, 33, 1024, 5};
+    for (std::size_t len : {0, 1, 16, 100, 128, 1000, 3000}) {
+        std::span<const std::uint8_t> msg(text.data(), len);
+        std::vector<std::uint8_t> ref(len), enc(len), dec(len);
+        gcm256::tag_array ref_tag;
+        gcm.seal(gcm_iv, aad, msg, ref, ref_tag);
+
+        gcm_stream<aes256> seal(gcm, gcm_iv, aad);
+        gcm_stream<aes256, true> open(gcm, gcm_iv, aad);
+        for (std::size_t i = 0, off = 0; off < len; i++) {
+            const auto n = std::min(chunks[i % std::size(chunks)], len - off);
+            seal.update(&msg[off], &enc[off], n);
+            open.update(&enc[off], &dec[off], n);
+            off += n;
+        }
+        runtime_assert(enc == ref);
+        runtime_assert(std::ranges::equal(dec, msg));
+
+        auto bad = open;
+        runtime_assert(seal.finalize() == ref_tag);
+        runtime_assert(open.verify(ref_tag));
+        ref_tag[0] ^= 1;
+        runtime_assert(!bad.verify(ref_tag));
+    }
+}
+
+void test_ghash_x86()
+{
+    ghash gh(0x66e94bd4ef8a2c3b884cfa59ca342b2e_bytes);
+    runtime_assert(gh.digest({}, 0x0388dace60b6a392f328c2b971b2fe78_bytes) == 0xf38cbb1ad69223dcc3457ae5b6b0f885_bytes);
+
+    std::vector<std::uint8_t> data(1000);
+    for (std::size_t i = 0; i < data.size(); i++)
+        data[i] = i * 3;
+    cheap_aes::ghash ref(0x66e94bd4ef8a2c3b884cfa59ca342b2e_bytes);
+    runtime_assert(gh.digest(data, data) == ref.digest(data, data));
+}
+
+int main()
+{
+    test_ghash_x86();
+    test_gcm128_x86();
+    test_gcm192_x86();
+    test_gcm256_x86();
+    test_gcm_long_x86();
+    test_gcm_stream_x86();
+}
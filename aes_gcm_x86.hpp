@@ -0,0 +1,587 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <immintrin.h>
+#include "aes_x86.hpp"
+#include "aes_ctr_x86.hpp"
+#include "aes_sg.hpp"
+
+namespace cheap_aes::x86
+{
+    // GHASH with PCLMULQDQ. Blocks are kept byte reflected, and H^1..H^8 are
+    // precomputed so that 8 blocks share a single reduction.
+    class ghash
+    {
+    public:
+        using block_array = std::array<std::uint8_t, 16>;
+
+        // unreduced products of 8 blocks
+        struct batch
+        {
+            __m128i x[8];
+            __m128i lo, mid, hi;
+        };
+
+    private:
+        __m128i h[8];
+
+    public:
+        ghash() {}
+
+        explicit ghash(const std::uint8_t hkey[16]) {
+            set(hkey);
+        }
+
+        explicit ghash(const block_array& hkey) {
+            set(&hkey[0]);
+        }
+
+        void set(const std::uint8_t hkey[16]) {
+            h[0] = bswap(_mm_loadu_si128((const __m128i*)hkey));
+            for (int i = 1; i < 8; i++)
+                h[i] = mul(h[i-1], h[0]);
+        }
+
+        void set(const block_array& hkey) {
+            set(&hkey[0]);
+        }
+
+        // y is the running digest in byte reflected form, starting from zero.
+        // the last partial block is zero padded.
+        void update(__m128i& y, const std::uint8_t* data, std::size_t len) const {
+            for (; len >= 8*16; len -= 8*16, data += 8*16) {
+                __m128i c[8];
+                for (int j = 0; j < 8; j++)
+                    c[j] = _mm_loadu_si128((const __m128i*)data + j);
+                batch b;
+                begin(b, y, c);
+                for (int j = 0; j < 8; j++)
+                    step(b, j);
+                y = end(b);
+            }
+            for (; len >= 16; len -= 16, data += 16)
+                update_si128(y, _mm_loadu_si128((const __m128i*)data));
+            if (len > 0) {
+                std::uint8_t buf[16] = {};
+                std::memcpy(buf, data, len);
+                update_si128(y, _mm_loadu_si128((const __m128i*)buf));
+            }
+        }
+
+        void update_si128(__m128i& y, __m128i block) const {
+            y = mul(_mm_xor_si128(y, bswap(block)), h[0]);
+        }
+
+        // absorbs [len(A)]64 || [len(C)]64, lengths are in bytes
+        void update_lengths(__m128i& y, std::uint64_t aad_len, std::uint64_t len) const {
+            y = mul(_mm_xor_si128(y, _mm_set_epi64x(aad_len * 8, len * 8)), h[0]);
+        }
+
+        static void digest(__m128i y, std::uint8_t out[16]) {
+            _mm_storeu_si128((__m128i*)out, bswap(y));
+        }
+
+        // GHASH(H, A, C)
+        block_array digest(std::span<const std::uint8_t> aad, std::span<const std::uint8_t> c) const {
+            auto y = _mm_setzero_si128();
+            update(y, aad.data(), aad.size());
+            update(y, c.data(), c.size());
+            update_lengths(y, aad.size(), c.size());
+            block_array out;
+            digest(y, &out[0]);
+            return out;
+        }
+
+        // aggregated update y = (y ^ c0) H^8 ^ c1 H^7 ^ ... ^ c7 H,
+        // split in steps so that it can be interleaved with AES rounds
+        void begin(batch& b, __m128i y, const __m128i (&c)[8]) const {
+            for (int j = 0; j < 8; j++)
+                b.x[j] = bswap(c[j]);
+            b.x[0] = _mm_xor_si128(b.x[0], y);
+            b.lo = b.mid = b.hi = _mm_setzero_si128();
+        }
+
+        void step(batch& b, int j) const {
+            mul_acc(b.x[j], h[7-j], b.lo, b.mid, b.hi);
+        }
+
+        static __m128i end(const batch& b) {
+            return reduce(b.lo, b.mid, b.hi);
+        }
+
+        static __m128i bswap(__m128i x) {
+            return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+        }
+
+        // H^n for n >= 1, to join digests of message parts: y = y H^n ^ y_part
+        __m128i power(std::uint64_t n) const {
+            auto x = h[0];
+            for (int b = 62 - std::countl_zero(n); b >= 0; b--) {
+                x = mul(x, x);
+                if (n >> b & 1)
+                    x = mul(x, h[0]);
+            }
+            return x;
+        }
+
+        static __m128i mul(__m128i a, __m128i b) {
+            auto lo = _mm_setzero_si128();
+            auto mid = _mm_setzero_si128();
+            auto hi = _mm_setzero_si128();
+            mul_acc(a, b, lo, mid, hi);
+            return reduce(lo, mid, hi);
+        }
+
+    private:
+        static inline void mul_acc(__m128i a, __m128i b, __m128i& lo, __m128i& mid, __m128i& hi) {
+            lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, b, 0x00));
+            hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, b, 0x11));
+            mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x01));
+            mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x10));
+        }
+
+        // Intel, "Carry-Less Multiplication Instruction and its Usage for
+        // Computing the GCM Mode", shift left by one bit and reduce
+        static inline __m128i reduce(__m128i lo, __m128i mid, __m128i hi) {
+            lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+            hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+            auto t7 = _mm_srli_epi32(lo, 31);
+            auto t8 = _mm_srli_epi32(hi, 31);
+            lo = _mm_slli_epi32(lo, 1);
+            hi = _mm_slli_epi32(hi, 1);
+            auto t9 = _mm_srli_si128(t7, 12);
+            t8 = _mm_slli_si128(t8, 4);
+            t7 = _mm_slli_si128(t7, 4);
+            lo = _mm_or_si128(lo, t7);
+            hi = _mm_or_si128(hi, t8);
+            hi = _mm_or_si128(hi, t9);
+
+            t7 = _mm_slli_epi32(lo, 31);
+            t8 = _mm_slli_epi32(lo, 30);
+            t9 = _mm_slli_epi32(lo, 25);
+            t7 = _mm_xor_si128(t7, t8);
+            t7 = _mm_xor_si128(t7, t9);
+            t8 = _mm_srli_si128(t7, 4);
+            t7 = _mm_slli_si128(t7, 12);
+            lo = _mm_xor_si128(lo, t7);
+
+            auto t2 = _mm_srli_epi32(lo, 1);
+            auto t4 = _mm_srli_epi32(lo, 2);
+            auto t5 = _mm_srli_epi32(lo, 7);
+            t2 = _mm_xor_si128(t2, t4);
+            t2 = _mm_xor_si128(t2, t5);
+            t2 = _mm_xor_si128(t2, t8);
+            lo = _mm_xor_si128(lo, t2);
+            return _mm_xor_si128(hi, lo);
+        }
+    };
+
+    template <class AES, bool Decrypt>
+    class gcm_stream;
+
+    template <class AES>
+    class gcm_base
+    {
+    public:
+        static constexpr int key_size() { return AES::key_size(); };
+        static constexpr int tag_size() { return 16; };
+        using key_array = typename AES::key_array;
+        using tag_array = std::array<std::uint8_t, tag_size()>;
+
+    private:
+        AES aes;
+        ghash gh;
+
+        template <class, bool>
+        friend class gcm_stream;
+
+    public:
+        gcm_base() {}
+
+        explicit gcm_base(const std::uint8_t key[AES::key_size()]) {
+            set(key);
+        }
+
+        explicit gcm_base(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void set(const std::uint8_t key[AES::key_size()]) {
+            aes.set(key);
+            std::uint8_t h[16];
+            _mm_storeu_si128((__m128i*)h, aes.encrypt_si128(_mm_setzero_si128()));
+            gh.set(h);
+        }
+
+        void set(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void seal(const std::uint8_t* iv, std::size_t iv_len,
+                  const std::uint8_t* aad, std::size_t aad_len,
+                  const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                  std::uint8_t tag[16]) const {
+            typename stats_t<AES>::call scope(len);
+            std::uint8_t j0[16];
+            make_j0(iv, iv_len, j0);
+            auto y = _mm_setzero_si128();
+            gh.update(y, aad, aad_len);
+            crypt<false>(j0, in, out, len, y);
+            gh.update_lengths(y, aad_len, len);
+            make_tag(j0, y, tag);
+        }
+
+        // decrypts and hashes in one pass, out is cleared when the tag does not match
+        bool open(const std::uint8_t* iv, std::size_t iv_len,
+                  const std::uint8_t* aad, std::size_t aad_len,
+                  const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                  const std::uint8_t tag[16]) const {
+            typename stats_t<AES>::call scope(len);
+            std::uint8_t j0[16];
+            make_j0(iv, iv_len, j0);
+            auto y = _mm_setzero_si128();
+            gh.update(y, aad, aad_len);
+            crypt<true>(j0, in, out, len, y);
+            gh.update_lengths(y, aad_len, len);
+            std::uint8_t expected[16];
+            make_tag(j0, y, expected);
+
+            std::uint8_t diff = 0;
+            for (int i = 0; i < 16; i++)
+                diff |= expected[i] ^ tag[i];
+            if (diff != 0) {
+                std::memset(out, 0, len);
+                return false;
+            }
+            return true;
+        }
+
+        void seal(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                  std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                  tag_array& tag) const {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            seal(iv.data(), iv.size(), aad.data(), aad.size(), in.data(), out.data(), in.size(), &tag[0]);
+        }
+
+        bool open(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                  std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                  const tag_array& tag) const {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            return open(iv.data(), iv.size(), aad.data(), aad.size(), in.data(), out.data(), in.size(), &tag[0]);
+        }
+
+        // over fragment lists (aes_sg.hpp), the AAD is one piece
+        void seal(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                  sg_const_list in, sg_list out, tag_array& tag) const {
+            seal_sg(iv, aad, sg_cursor(in), sg_cursor(out), tag);
+        }
+
+        void seal(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                  sg_list buf, tag_array& tag) const {
+            seal_sg(iv, aad, sg_cursor(buf), sg_cursor(buf), tag);
+        }
+
+        bool open(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                  sg_const_list in, sg_list out, const tag_array& tag) const {
+            return open_sg(iv, aad, sg_cursor(in), sg_cursor(out), tag);
+        }
+
+        bool open(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                  sg_list buf, const tag_array& tag) const {
+            return open_sg(iv, aad, sg_cursor(buf), sg_cursor(buf), tag);
+        }
+
+        // Entry points for callers that split a message into parts, such as
+        // the parallel driver. A part starts at a block offset and is whole
+        // blocks unless it is the last one; y gets its GHASH from zero.
+        void pre_counter(const std::uint8_t* iv, std::size_t iv_len, std::uint8_t j0[16]) const {
+            make_j0(iv, iv_len, j0);
+        }
+
+        template <bool Decrypt>
+        void crypt_part(const std::uint8_t j0[16], std::uint64_t block,
+                        const std::uint8_t* in, std::uint8_t* out, std::size_t len, __m128i& y) const {
+            typename stats_t<AES>::call scope(len);
+            y = _mm_setzero_si128();
+            crypt<Decrypt>(j0, in, out, len, y, block);
+        }
+
+        // y is the joined digest of the AAD and the ciphertext
+        void finish(const std::uint8_t j0[16], __m128i y, std::uint64_t aad_len, std::uint64_t len, std::uint8_t tag[16]) const {
+            gh.update_lengths(y, aad_len, len);
+            make_tag(j0, y, tag);
+        }
+
+        const ghash& hash() const {
+            return gh;
+        }
+
+    private:
+        template <class In>
+        void seal_sg(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                     sg_cursor<In> in, sg_cursor<std::uint8_t> out, tag_array& tag) const {
+            const auto len = in.size();
+            sg_check(len, out.size());
+            typename stats_t<AES>::call scope(len);
+            std::uint8_t j0[16];
+            make_j0(iv.data(), iv.size(), j0);
+            auto y = _mm_setzero_si128();
+            gh.update(y, aad.data(), aad.size());
+            crypt_sg<false>(j0, in, out, len, y);
+            gh.update_lengths(y, aad.size(), len);
+            make_tag(j0, y, &tag[0]);
+        }
+
+        template <class In>
+        bool open_sg(std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                     sg_cursor<In> in, sg_cursor<std::uint8_t> out, const tag_array& tag) const {
+            const auto len = in.size();
+            sg_check(len, out.size());
+            typename stats_t<AES>::call scope(len);
+            const auto start = out;
+            std::uint8_t j0[16];
+            make_j0(iv.data(), iv.size(), j0);
+            auto y = _mm_setzero_si128();
+            gh.update(y, aad.data(), aad.size());
+            crypt_sg<true>(j0, in, out, len, y);
+            gh.update_lengths(y, aad.size(), len);
+            std::uint8_t expected[16];
+            make_tag(j0, y, expected);
+
+            std::uint8_t diff = 0;
+            for (int i = 0; i < 16; i++)
+                diff |= expected[i] ^ tag[i];
+            if (diff != 0) {
+                auto clear = start;
+                clear.fill(0, len);
+                return false;
+            }
+            return true;
+        }
+
+        // whole-block runs and gathered blocks go through crypt at their block offset;
+        // only the last one can be partial, where the GHASH padding belongs
+        template <bool Decrypt, class In>
+        void crypt_sg(const std::uint8_t j0[16], sg_cursor<In>& in, sg_cursor<std::uint8_t>& out, std::size_t len,
+                      __m128i& y) const {
+            std::uint64_t block = 0;
+            sg_blocks(in, out, len, [&](const std::uint8_t* i, std::uint8_t* o, std::size_t n) {
+                crypt<Decrypt>(j0, i, o, n, y, block);
+                block += n / 16;
+            });
+        }
+
+        void make_j0(const std::uint8_t* iv, std::size_t iv_len, std::uint8_t j0[16]) const {
+            if (iv_len == 12) {
+                std::memcpy(j0, iv, 12);
+                j0[12] = j0[13] = j0[14] = 0;
+                j0[15] = 1;
+            } else {
+                auto y = _mm_setzero_si128();
+                gh.update(y, iv, iv_len);
+                gh.update_lengths(y, 0, iv_len);
+                ghash::digest(y, j0);
+            }
+        }
+
+        void make_tag(const std::uint8_t j0[16], __m128i y, std::uint8_t tag[16]) const {
+            auto s = aes.encrypt_si128(_mm_loadu_si128((const __m128i*)j0));
+            _mm_storeu_si128((__m128i*)tag, _mm_xor_si128(ghash::bswap(y), s));
+        }
+
+        // 8 keystream blocks, with the GHASH of 8 ciphertext blocks in the AES rounds
+        void stitch8(ctr_counter<ctr_inc::be32>& ctr, __m128i (&ks)[8], __m128i& y, const __m128i (&c)[8]) const {
+            ctr.next(ks);
+            ghash::batch b;
+            gh.begin(b, y, c);
+            aes.encrypt_si128(ks, [&](int round) {
+                if (round <= 8)
+                    gh.step(b, round - 1);
+            });
+            y = ghash::end(b);
+        }
+
+        template <bool Decrypt>
+        void crypt(const std::uint8_t j0[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len, __m128i& y,
+                   std::uint64_t block = 0) const {
+            ctr_counter<ctr_inc::be32> ctr(j0);
+            ctr.skip(1 + block);
+
+            __m128i ks[8], c[8];
+            if constexpr (Decrypt) {
+                for (; len >= 8*16; len -= 8*16, in += 8*16, out += 8*16) {
+                    for (int j = 0; j < 8; j++)
+                        c[j] = _mm_loadu_si128((const __m128i*)in + j);
+                    stitch8(ctr, ks, y, c);
+                    for (int j = 0; j < 8; j++)
+                        _mm_storeu_si128((__m128i*)out + j, _mm_xor_si128(c[j], ks[j]));
+                }
+            } else if (len >= 8*16) {
+                // the ciphertext of one batch is hashed while the next one is encrypted
+                ctr.next(ks);
+                aes.encrypt_si128(ks);
+                for (int j = 0; j < 8; j++) {
+                    c[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in + j), ks[j]);
+                    _mm_storeu_si128((__m128i*)out + j, c[j]);
+                }
+                len -= 8*16, in += 8*16, out += 8*16;
+
+                for (; len >= 8*16; len -= 8*16, in += 8*16, out += 8*16) {
+                    stitch8(ctr, ks, y, c);
+                    for (int j = 0; j < 8; j++) {
+                        c[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in + j), ks[j]);
+                        _mm_storeu_si128((__m128i*)out + j, c[j]);
+                    }
+                }
+
+                ghash::batch b;
+                gh.begin(b, y, c);
+                for (int j = 0; j < 8; j++)
+                    gh.step(b, j);
+                y = ghash::end(b);
+            }
+
+            for (; len >= 16; len -= 16, in += 16, out += 16) {
+                auto x = _mm_loadu_si128((const __m128i*)in);
+                auto r = _mm_xor_si128(x, aes.encrypt_si128(ctr.next()));
+                _mm_storeu_si128((__m128i*)out, r);
+                gh.update_si128(y, Decrypt ? x : r);
+            }
+
+            if (len > 0) {
+                std::uint8_t buf[16] = {};
+                std::memcpy(buf, in, len);
+                auto x = _mm_loadu_si128((const __m128i*)buf);
+                auto r = _mm_xor_si128(x, aes.encrypt_si128(ctr.next()));
+                std::uint8_t rb[16];
+                _mm_storeu_si128((__m128i*)rb, r);
+                std::memcpy(out, rb, len);
+                if constexpr (Decrypt) {
+                    gh.update_si128(y, x);
+                } else {
+                    std::memset(rb + len, 0, 16 - len);
+                    gh.update_si128(y, _mm_loadu_si128((const __m128i*)rb));
+                }
+            }
+        }
+    };
+
+    // GCM over a message that arrives in pieces of any size, after one piece
+    // of AAD. The keystream and ciphertext of a partial block are kept for
+    // the next update, whole blocks take the stitched 8-block path. The
+    // stream refers to gcm, which has to outlive it, and is trivially copyable.
+    // Decrypted output is unauthenticated until verify() returns true.
+    template <class AES, bool Decrypt = false>
+    class gcm_stream
+    {
+    private:
+        const gcm_base<AES>* gcm;
+        __m128i y;
+        std::uint8_t j0[16];
+        std::uint8_t ks[16];
+        std::uint8_t part[16];
+        unsigned used = 0;
+        std::uint64_t block = 0;
+        std::uint64_t aad_len;
+        std::uint64_t len = 0;
+
+    public:
+        gcm_stream(const gcm_base<AES>& gcm, const std::uint8_t* iv, std::size_t iv_len,
+                   const std::uint8_t* aad, std::size_t aad_len)
+            : gcm(&gcm), y(_mm_setzero_si128()), aad_len(aad_len) {
+            gcm.make_j0(iv, iv_len, j0);
+            gcm.gh.update(y, aad, aad_len);
+        }
+
+        gcm_stream(const gcm_base<AES>& gcm, std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad)
+            : gcm_stream(gcm, iv.data(), iv.size(), aad.data(), aad.size()) {}
+
+        // in == out is allowed
+        void update(const std::uint8_t* in, std::uint8_t* out, std::size_t n) {
+            typename stats_t<AES>::call scope(n);
+            len += n;
+            if (used > 0) {
+                for (; used < 16 && n > 0; n--, used++) {
+                    const auto x = *in++;
+                    *out = x ^ ks[used];
+                    part[used] = Decrypt ? x : *out;
+                    out++;
+                }
+                if (used < 16)
+                    return;
+                gcm->gh.update_si128(y, _mm_loadu_si128((const __m128i*)part));
+                used = 0;
+            }
+
+            if (const auto whole = n / 16 * 16; whole > 0) {
+                gcm->template crypt<Decrypt>(j0, in, out, whole, y, block);
+                block += whole / 16;
+                in += whole, out += whole, n -= whole;
+            }
+
+            if (n > 0) {
+                ctr_counter<ctr_inc::be32> ctr(j0);
+                ctr.skip(1 + block++);
+                _mm_storeu_si128((__m128i*)ks, gcm->aes.encrypt_si128(ctr.next()));
+                for (; used < n; used++) {
+                    const auto x = in[used];
+                    out[used] = x ^ ks[used];
+                    part[used] = Decrypt ? x : out[used];
+                }
+            }
+        }
+
+        void update(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            update(in.data(), out.data(), in.size());
+        }
+
+        // the tag of everything so far; the stream is done with after this
+        void finalize(std::uint8_t tag[16]) {
+            if (used > 0) {
+                std::memset(part + used, 0, 16 - used);
+                gcm->gh.update_si128(y, _mm_loadu_si128((const __m128i*)part));
+                used = 0;
+            }
+            gcm->gh.update_lengths(y, aad_len, len);
+            gcm->make_tag(j0, y, tag);
+        }
+
+        typename gcm_base<AES>::tag_array finalize() {
+            typename gcm_base<AES>::tag_array tag;
+            finalize(&tag[0]);
+            return tag;
+        }
+
+        // finalize() compared with tag in constant time
+        bool verify(const std::uint8_t tag[16]) requires Decrypt {
+            std::uint8_t expected[16];
+            finalize(expected);
+
+            std::uint8_t diff = 0;
+            for (int i = 0; i < 16; i++)
+                diff |= expected[i] ^ tag[i];
+            return diff == 0;
+        }
+
+        bool verify(const typename gcm_base<AES>::tag_array& tag) requires Decrypt {
+            return verify(&tag[0]);
+        }
+    };
+
+    using gcm128 = gcm_base<aes128>;
+    using gcm192 = gcm_base<aes192>;
+    using gcm256 = gcm_base<aes256>;
+}
@@ -0,0 +1,126 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <bit>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "aes_hash_x86.hpp"
+#if defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace cheap_aes::x86;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+std::vector<std::uint8_t> make_text(std::size_t len)
+{
+    std::vector<std::uint8_t> text(len);
+    for (std::size_t i = 0; i < len; i++)
+        text[i] = i * 13 + (i >> 8);
+    return text;
+}
+
+// every prefix of a buffer hashes apart, under each seed apart
+void test_hash_lengths_x86()
+{
+    const aes_hash h1(aes_hash::seed_array{1}), h2(aes_hash::seed_array{2});
+    const auto text = make_text(1000);
+    std::set<std::uint64_t> seen;
+    for (std::size_t len = 0; len <= text.size(); len++) {
+        const auto a = h1.hash(text.data(), len);
+        runtime_assert(a == h1.hash(text.data(), len));
+        runtime_assert(seen.insert(a).second);
+        runtime_assert(seen.insert(h2.hash(text.data(), len)).second);
+    }
+
+    // zeros of each length too, where only the length tells them apart
+    const std::vector<std::uint8_t> zeros(300);
+    std::set<std::uint64_t> zero_seen;
+    for (std::size_t len = 0; len <= zeros.size(); len++)
+        runtime_assert(zero_seen.insert(h1.hash(zeros.data(), len)).second);
+}
+
+// a flip of any bit moves about half of the 64 output bits
+void test_hash_avalanche_x86()
+{
+    const aes_hash h(aes_hash::seed_array{3, 4, 5});
+    for (std::size_t len : {1, 3, 4, 7, 8, 15, 16, 17, 31, 100, 128, 129, 300}) {
+        auto text = make_text(len);
+        const auto base = h.hash(text.data(), len);
+        std::size_t total = 0;
+        for (std::size_t bit = 0; bit < 8 * len; bit++) {
+            text[bit / 8] ^= 1 << bit % 8;
+            const auto changed = std::popcount(base ^ h.hash(text.data(), len));
+            text[bit / 8] ^= 1 << bit % 8;
+            runtime_assert(changed >= 8);
+            total += changed;
+        }
+        const auto mean = (double)total / (8 * len);
+        runtime_assert(mean > 28 && mean < 36);
+    }
+}
+
+void test_hash_checksum_x86()
+{
+    const aes_hash h(aes_hash::seed_array{6});
+    const auto text = make_text(1 << 20);
+    const auto d = h.checksum(text);
+    std::uint64_t low;
+    std::memcpy(&low, d.data(), 8);
+    runtime_assert(low == h.hash(text.data(), text.size()));
+
+    auto other = text;
+    other[other.size() / 2] ^= 0x80;
+    runtime_assert(h.checksum(other) != d);
+}
+
+#if defined(__unix__)
+// short inputs that end at an unmapped page are read without a fault
+void test_hash_page_end_x86()
+{
+    const auto page = (std::size_t)::sysconf(_SC_PAGESIZE);
+    auto p = (std::uint8_t*)::mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    runtime_assert(p != MAP_FAILED);
+    runtime_assert(::mprotect(p + page, page, PROT_NONE) == 0);
+
+    const aes_hash h(aes_hash::seed_array{7});
+    for (std::size_t len = 0; len <= 40; len++) {
+        std::memset(p + page - len, 0x3c, len);
+        const std::vector<std::uint8_t> copy(p + page - len, p + page);
+        runtime_assert(h.hash(p + page - len, len) == h.hash(copy.data(), len));
+    }
+    ::munmap(p, 2 * page);
+}
+#endif
+
+void test_hasher_x86()
+{
+    std::unordered_map<std::string, int, aes_hasher<std::string>> words;
+    for (int i = 0; i < 1000; i++)
+        words[std::to_string(i * 7919)] = i;
+    for (int i = 0; i < 1000; i++)
+        runtime_assert(words.at(std::to_string(i * 7919)) == i);
+
+    std::unordered_map<std::uint64_t, int, aes_hasher<std::uint64_t>> ids;
+    for (int i = 0; i < 1000; i++)
+        ids[std::uint64_t(i) << 32] = i;
+    runtime_assert(ids.size() == 1000 && ids.at(std::uint64_t(999) << 32) == 999);
+    runtime_assert(aes_hasher<std::string>()("abc") == aes_hasher<std::string_view>()("abc"));
+}
+
+int main()
+{
+    test_hash_lengths_x86();
+    test_hash_avalanche_x86();
+    test_hash_checksum_x86();
+#if defined(__unix__)
+    test_hash_page_end_x86();
+#endif
+    test_hasher_x86();
+}
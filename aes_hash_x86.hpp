@@ -0,0 +1,155 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <immintrin.h>
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    // A fast non-cryptographic hash of AES rounds, for hash tables and
+    // checksums. 8 lanes take 128 bytes a step, one aesenc each with the
+    // data as the round key; the lanes are folded together and three more
+    // rounds with the length finish it. The seed is expanded as an AES-128
+    // key and its round keys start the lanes. It is not a MAC.
+    class aes_hash
+    {
+    public:
+        using seed_array = aes128::key_array;
+        using digest_array = std::array<std::uint8_t, 16>;
+
+    private:
+        __m128i k[11];
+
+    public:
+        explicit aes_hash(const seed_array& seed) {
+            const aes128_enc aes(seed);
+            std::memcpy(k, aes.round_keys(), sizeof(k));
+        }
+
+        std::uint64_t hash(const void* p, std::size_t len) const {
+            return (std::uint64_t)_mm_cvtsi128_si64(hash_si128((const std::uint8_t*)p, len));
+        }
+
+        std::uint64_t hash(std::string_view s) const {
+            return hash(s.data(), s.size());
+        }
+
+        std::uint64_t operator()(std::string_view s) const {
+            return hash(s.data(), s.size());
+        }
+
+        // all 128 bits, whose low 64 are hash()
+        digest_array checksum(const void* p, std::size_t len) const {
+            digest_array d;
+            _mm_storeu_si128((__m128i*)&d[0], hash_si128((const std::uint8_t*)p, len));
+            return d;
+        }
+
+        digest_array checksum(std::span<const std::uint8_t> data) const {
+            return checksum(data.data(), data.size());
+        }
+
+        __m128i hash_si128(const std::uint8_t* p, std::size_t len) const {
+            if (len <= 16)
+                return finish(_mm_aesenc_si128(k[1], load_short(p, len)), len);
+
+            __m128i a[8];
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < 8; j++)
+                a[j] = k[j+1];
+
+            // the blocks before the last one, which ends at len and may overlap them
+            const auto nblocks = (len - 1) / 16;
+            std::size_t i = 0;
+            for (; i + 8 <= nblocks; i += 8) {
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < 8; j++)
+                    a[j] = _mm_aesenc_si128(a[j], _mm_loadu_si128((const __m128i*)p + i + j));
+            }
+            // the rest and the last block into lanes 0 to r, by constant index
+            // for the lanes to stay in registers
+            const auto r = nblocks - i;
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < 8; j++) {
+                if (j < r)
+                    a[j] = _mm_aesenc_si128(a[j], _mm_loadu_si128((const __m128i*)p + i + j));
+                else if (j == r)
+                    a[j] = _mm_aesenc_si128(a[j], _mm_loadu_si128((const __m128i*)(p + len - 16)));
+            }
+
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < 4; j++)
+                a[j] = _mm_aesenc_si128(a[j], a[j+4]);
+            a[0] = _mm_aesenc_si128(a[0], a[2]);
+            a[1] = _mm_aesenc_si128(a[1], a[3]);
+            return finish(_mm_aesenc_si128(a[0], a[1]), len);
+        }
+
+    private:
+        __m128i finish(__m128i s, std::size_t len) const {
+            s = _mm_xor_si128(s, _mm_set_epi64x(0, (long long)len));
+            s = _mm_aesenc_si128(s, k[9]);
+            s = _mm_aesenc_si128(s, k[10]);
+            return _mm_aesenc_si128(s, k[0]);
+        }
+
+        // up to 16 bytes without reading past them; the two loads overlap
+        // but cover every byte, so one length never maps two inputs together
+        static __m128i load_short(const std::uint8_t* p, std::size_t len) {
+            if (len >= 8) {
+                std::uint64_t lo, hi;
+                std::memcpy(&lo, p, 8);
+                std::memcpy(&hi, p + len - 8, 8);
+                return _mm_set_epi64x((long long)hi, (long long)lo);
+            }
+            if (len >= 4) {
+                std::uint32_t lo, hi;
+                std::memcpy(&lo, p, 4);
+                std::memcpy(&hi, p + len - 4, 4);
+                return _mm_set_epi64x(hi, lo);
+            }
+            if (len > 0)
+                return _mm_cvtsi32_si128(p[0] | p[len/2] << 8 | p[len-1] << 16);
+            return _mm_setzero_si128();
+        }
+    };
+
+    // the hash of aes_hasher, seeded from std::random_device once a process
+    inline const aes_hash& default_aes_hash() {
+        static const aes_hash h([] {
+            std::random_device rd;
+            aes_hash::seed_array seed;
+            for (std::size_t i = 0; i < seed.size(); i += 4) {
+                const std::uint32_t x = rd();
+                std::memcpy(&seed[i], &x, 4);
+            }
+            return seed;
+        }());
+        return h;
+    }
+
+    // A std::hash stand-in for unordered containers: strings by their
+    // characters, other types by their bytes where those are unique.
+    template <class T>
+    struct aes_hasher
+    {
+        std::size_t operator()(const T& x) const {
+            if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+                const std::string_view s = x;
+                return (std::size_t)default_aes_hash().hash(s.data(), s.size());
+            } else {
+                static_assert(std::has_unique_object_representations_v<T>, "aes_hasher: T has padding or no byte-wise equality");
+                return (std::size_t)default_aes_hash().hash(&x, sizeof(x));
+            }
+        }
+    };
+}
@@ -0,0 +1,175 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "aes_keystore_x86.hpp"
+#include "aes_mb_x86.hpp"
+
+using namespace cheap_aes::x86;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+template <class AES>
+std::vector<typename AES::key_array> make_keys(std::size_t count)
+{
+    std::vector<typename AES::key_array> keys(count);
+    for (std::size_t n = 0; n < count; n++)
+        for (std::size_t i = 0; i < keys[n].size(); i++)
+            keys[n][i] = n * 131 + i * 7 + (n >> 8) * (i + 1);
+    return keys;
+}
+
+bool same_block(__m128i a, __m128i b)
+{
+    return std::memcmp(&a, &b, 16) == 0;
+}
+
+// more keys than one chunk holds, added one by one and in batches
+template <class AES>
+void test_keystore_slots_x86()
+{
+    constexpr std::size_t count = key_store<AES>::chunk_size() / sizeof(AES) + 100;
+    const auto keys = make_keys<AES>(count);
+    key_store<AES> store;
+    std::vector<key_handle> handles(count);
+    store.add(std::span(keys).first(37), std::span(handles).first(37));
+    for (std::size_t n = 37; n < 50; n++)
+        handles[n] = store.add(keys[n]);
+    store.add(std::span(keys).subspan(50), std::span(handles).subspan(50));
+    runtime_assert(store.size() == count);
+
+    const auto x = _mm_set_epi32(1, 2, 3, 4);
+    for (std::size_t n = 0; n < count; n += 97) {
+        const AES aes(keys[n]);
+        runtime_assert(same_block(store.get(handles[n]).encrypt_si128(x), aes.encrypt_si128(x)));
+        runtime_assert(same_block(store.get(handles[n]).decrypt_si128(x), aes.decrypt_si128(x)));
+    }
+
+    // a released place goes to the next key, the old handle is refused
+    const auto old = handles[5];
+    store.release(old);
+    runtime_assert(!store.contains(old) && store.size() == count - 1);
+    const auto h = store.add(keys[5]);
+    runtime_assert(h.index == old.index && h.generation != old.generation);
+    bool thrown = false;
+    try {
+        store.get(old);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    runtime_assert(thrown);
+}
+
+// repeated key bytes share one schedule until their last release
+void test_keystore_cache_x86()
+{
+    const auto keys = make_keys<aes128>(3);
+    key_store<aes128> store(true);
+    const auto a = store.add(keys[0]);
+    const auto b = store.add(keys[1]);
+    const auto c = store.add(keys[0]);
+    runtime_assert(a == c && a != b && store.size() == 2);
+
+    std::vector<key_handle> batch(4);
+    const std::vector<aes128::key_array> batch_keys = { keys[2], keys[1], keys[2], keys[0] };
+    store.add(batch_keys, batch);
+    runtime_assert(batch[0] == batch[2] && batch[1] == b && batch[3] == a && store.size() == 3);
+
+    store.release(a);
+    store.release(c);
+    runtime_assert(store.contains(a) && store.size() == 3);
+    store.release(batch[3]);
+    runtime_assert(!store.contains(a) && store.size() == 2);
+    const auto d = store.add(keys[0]);
+    runtime_assert(d != a && store.contains(d));
+
+    // a store without the cache expands every add
+    key_store<aes128> plain;
+    runtime_assert(plain.add(keys[0]) != plain.add(keys[0]) && plain.size() == 2);
+}
+
+// the contexts of a store drive the multi-buffer lanes as they are
+void test_keystore_mb_x86()
+{
+    const auto keys = make_keys<aes256>(11);
+    key_store<aes256> store;
+    std::vector<key_handle> handles(keys.size());
+    store.add(keys, handles);
+
+    std::vector<std::vector<std::uint8_t>> bufs(keys.size(), std::vector<std::uint8_t>(64, 0x5a));
+    std::vector<mb_job<aes256>> jobs(keys.size());
+    mb_manager<aes256> mb;
+    for (std::size_t n = 0; n < keys.size(); n++) {
+        jobs[n].aes = &store.get(handles[n]);
+        jobs[n].in = jobs[n].out = bufs[n].data();
+        jobs[n].len = bufs[n].size();
+        mb.submit(jobs[n]);
+    }
+    mb.flush();
+    for (std::size_t n = 0; n < keys.size(); n++) {
+        std::vector<std::uint8_t> ref(64, 0x5a);
+        aes256(keys[n]).encrypt_blocks(ref, ref);
+        runtime_assert(bufs[n] == ref);
+    }
+}
+
+// round i of a group's 8 keys side by side, and the group kernels
+template <class AES>
+void test_keystore_round_major_x86()
+{
+    using store_type = key_store<AES, key_layout::round_major>;
+    constexpr int Nr = AES::key_size() / 4 + 6;
+    const auto keys = make_keys<AES>(8 * 300 + 5);
+    store_type store;
+    std::vector<key_handle> handles(keys.size());
+    store.add(keys, handles);
+
+    for (std::size_t n = 0; n < keys.size(); n += 53) {
+        const AES aes(keys[n]);
+        const auto g = store_type::group_of(handles[n]);
+        const auto lane = store_type::lane_of(handles[n]);
+        for (int i = 0; i <= Nr; i++) {
+            if constexpr (has_round_keys<AES>)
+                runtime_assert(same_block(store.group_round_keys(g)[8*i + lane], aes.round_keys()[i]));
+            if constexpr (has_inv_round_keys<AES>)
+                runtime_assert(same_block(store.group_inv_round_keys(g)[8*i + lane], aes.inv_round_keys()[i]));
+        }
+    }
+
+    // the last group is part full
+    for (std::size_t g : {0, 7, 300}) {
+        __m128i s[8], ref[8];
+        for (int j = 0; j < 8; j++)
+            s[j] = ref[j] = _mm_set_epi32(j, 9, 8, 7);
+        if constexpr (has_round_keys<AES>) {
+            store.encrypt_group(g, s);
+            for (std::size_t j = 0; j < 8 && 8*g + j < keys.size(); j++)
+                runtime_assert(same_block(s[j], AES(keys[8*g + j]).encrypt_si128(ref[j])));
+        } else {
+            store.decrypt_group(g, s);
+            for (std::size_t j = 0; j < 8 && 8*g + j < keys.size(); j++)
+                runtime_assert(same_block(s[j], AES(keys[8*g + j]).decrypt_si128(ref[j])));
+        }
+    }
+
+    // a released lane is cleared
+    store.release(handles[3]);
+    runtime_assert(store_type::group_of(handles[3]) == 0);
+    if constexpr (has_round_keys<AES>)
+        runtime_assert(same_block(store.group_round_keys(0)[8*Nr + 3], _mm_setzero_si128()));
+    else
+        runtime_assert(same_block(store.group_inv_round_keys(0)[8*Nr + 3], _mm_setzero_si128()));
+}
+
+int main()
+{
+    test_keystore_slots_x86<aes128>();
+    test_keystore_slots_x86<aes256_enc>();
+    test_keystore_cache_x86();
+    test_keystore_mb_x86();
+    test_keystore_round_major_x86<aes128>();
+    test_keystore_round_major_x86<aes192_enc>();
+    test_keystore_round_major_x86<aes256_dec>();
+}
@@ -0,0 +1,279 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <immintrin.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    // slots: a whole context per key. round_major: groups of 8 keys with
+    // round i of the 8 side by side, as the multi-lane kernels read them.
+    enum class key_layout { slots, round_major };
+
+    // A key of a key_store. The generation tells the handles of a released
+    // key from those of the next key in its place.
+    struct key_handle
+    {
+        std::uint32_t index = ~std::uint32_t(0);
+        std::uint32_t generation = 0;
+
+        bool operator==(const key_handle&) const = default;
+    };
+
+    // Expanded schedules of many keys packed into 2 MiB chunks, which Linux
+    // may back with huge pages, instead of contexts spread over the heap.
+    // With the cache, adding key bytes that are already in the store takes
+    // a reference to their schedule instead of expanding it again; the
+    // cache keeps the key bytes. Not synchronized.
+    template <class AES, key_layout Layout = key_layout::slots>
+    class key_store
+    {
+    public:
+        using key_array = typename AES::key_array;
+        static constexpr std::size_t chunk_size() { return std::size_t(2) << 20; };
+        static constexpr std::size_t group_size() { return Layout == key_layout::slots ? 1 : 8; };
+
+    private:
+        static constexpr int Nr = AES::key_size() / 4 + 6;
+        static constexpr bool has_w = has_round_keys<AES>;
+        static constexpr bool has_dw = has_inv_round_keys<AES>;
+
+        // a context, or the w then dw round-major blocks of a group
+        static constexpr std::size_t unit_size = Layout == key_layout::slots ? sizeof(AES) : (has_w + has_dw) * (Nr+1) * 8 * 16;
+        static constexpr std::size_t units_per_chunk = chunk_size() / unit_size;
+
+        struct chunk_free
+        {
+            void operator()(std::byte* p) const {
+                ::operator delete(p, std::align_val_t(chunk_size()));
+            }
+        };
+
+        struct key_hash
+        {
+            std::size_t operator()(const key_array& key) const {
+                return std::hash<std::string_view>()(std::string_view((const char*)key.data(), key.size()));
+            }
+        };
+
+        std::vector<std::unique_ptr<std::byte, chunk_free>> chunks;
+        std::vector<std::uint32_t> generations;
+        std::vector<std::uint32_t> refs;
+        std::vector<std::uint32_t> free_list;
+        std::size_t live = 0;
+        bool cache;
+        std::unordered_map<key_array, std::uint32_t, key_hash> by_key;
+        std::vector<key_array> key_of;
+
+        static_assert(sizeof(AES) % 64 == 0 && unit_size % 64 == 0);
+
+    public:
+        explicit key_store(bool cache_keys = false) : cache(cache_keys) {}
+
+        key_store(const key_store&) = delete;
+        key_store& operator=(const key_store&) = delete;
+
+        key_handle add(const key_array& key) {
+            key_handle h;
+            add(std::span(&key, 1), std::span(&h, 1));
+            return h;
+        }
+
+        // new schedules are expanded 8 at a time by AES::set_keys
+        void add(std::span<const key_array> keys, std::span<key_handle> handles) {
+            if (handles.size() < keys.size())
+                throw std::invalid_argument("cheap_aes: fewer handles than keys");
+
+            AES batch[8];
+            key_array batch_keys[8];
+            std::uint32_t batch_index[8];
+            std::size_t n = 0;
+            for (std::size_t i = 0; i < keys.size(); i++) {
+                if (cache) {
+                    const auto it = by_key.find(keys[i]);
+                    if (it != by_key.end()) {
+                        refs[it->second]++;
+                        handles[i] = { it->second, generations[it->second] };
+                        continue;
+                    }
+                }
+                const auto index = allocate(keys[i]);
+                handles[i] = { index, generations[index] };
+                batch_keys[n] = keys[i];
+                batch_index[n] = index;
+                if (++n == 8) {
+                    store(batch, batch_keys, batch_index, n);
+                    n = 0;
+                }
+            }
+            store(batch, batch_keys, batch_index, n);
+        }
+
+        // drops one reference; the last one clears the schedule and frees its place
+        void release(key_handle h) {
+            check(h);
+            if (--refs[h.index] > 0)
+                return;
+            generations[h.index]++;
+            clear(h.index);
+            if (cache)
+                by_key.erase(key_of[h.index]);
+            free_list.push_back(h.index);
+            live--;
+        }
+
+        bool contains(key_handle h) const {
+            return h.index < refs.size() && refs[h.index] > 0 && generations[h.index] == h.generation;
+        }
+
+        // schedules held, each shared key counted once
+        std::size_t size() const {
+            return live;
+        }
+
+        // the context of a key, for any API that takes one
+        const AES& get(key_handle h) const requires (Layout == key_layout::slots) {
+            check(h);
+            return *std::launder((const AES*)unit(h.index));
+        }
+
+        // the group of a key and its lane in it
+        static std::size_t group_of(key_handle h) requires (Layout == key_layout::round_major) {
+            return h.index / 8;
+        }
+
+        static std::size_t lane_of(key_handle h) requires (Layout == key_layout::round_major) {
+            return h.index % 8;
+        }
+
+        // round i of lane j at [8*i + j]; the lanes without a key are zero
+        const __m128i* group_round_keys(std::size_t group) const requires (Layout == key_layout::round_major && has_w) {
+            return (const __m128i*)unit(8 * group);
+        }
+
+        const __m128i* group_inv_round_keys(std::size_t group) const requires (Layout == key_layout::round_major && has_dw) {
+            return (const __m128i*)unit(8 * group) + (has_w ? 8*(Nr+1) : 0);
+        }
+
+        // block j under the key of lane j, one contiguous load per round
+        void encrypt_group(std::size_t group, __m128i (&s)[8]) const requires (Layout == key_layout::round_major && has_w) {
+            AES::stats_type::blocks(8);
+            const auto k = group_round_keys(group);
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < 8; j++)
+                s[j] = _mm_xor_si128(s[j], k[j]);
+            for (int i = 1; i < Nr; i++) {
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < 8; j++)
+                    s[j] = _mm_aesenc_si128(s[j], k[8*i + j]);
+            }
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < 8; j++)
+                s[j] = _mm_aesenclast_si128(s[j], k[8*Nr + j]);
+        }
+
+        void decrypt_group(std::size_t group, __m128i (&s)[8]) const requires (Layout == key_layout::round_major && has_dw) {
+            AES::stats_type::blocks(8);
+            const auto k = group_inv_round_keys(group);
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < 8; j++)
+                s[j] = _mm_xor_si128(s[j], k[j]);
+            for (int i = 1; i < Nr; i++) {
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < 8; j++)
+                    s[j] = _mm_aesdec_si128(s[j], k[8*i + j]);
+            }
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < 8; j++)
+                s[j] = _mm_aesdeclast_si128(s[j], k[8*Nr + j]);
+        }
+
+    private:
+        void check(key_handle h) const {
+            if (!contains(h))
+                throw std::invalid_argument("cheap_aes: stale key handle");
+        }
+
+        std::byte* unit(std::size_t index) const {
+            const auto u = index / group_size();
+            return chunks[u / units_per_chunk].get() + (u % units_per_chunk) * unit_size;
+        }
+
+        // a free place, or a new one with a new chunk when the last is full
+        std::uint32_t allocate(const key_array& key) {
+            std::uint32_t index;
+            if (!free_list.empty()) {
+                index = free_list.back();
+                free_list.pop_back();
+            } else {
+                index = (std::uint32_t)refs.size();
+                if (index / group_size() == chunks.size() * units_per_chunk)
+                    add_chunk();
+                generations.push_back(0);
+                refs.push_back(0);
+                if (cache)
+                    key_of.emplace_back();
+            }
+            refs[index] = 1;
+            live++;
+            if (cache) {
+                key_of[index] = key;
+                by_key.emplace(key, index);
+            }
+            return index;
+        }
+
+        void add_chunk() {
+            auto p = (std::byte*)::operator new(chunk_size(), std::align_val_t(chunk_size()));
+#if defined(__linux__)
+            ::madvise(p, chunk_size(), MADV_HUGEPAGE);
+#endif
+            std::memset(p, 0, chunk_size());
+            chunks.emplace_back(p);
+        }
+
+        void store(AES (&batch)[8], const key_array (&batch_keys)[8], const std::uint32_t (&index)[8], std::size_t n) {
+            AES::set_keys(std::span(batch, n), std::span(batch_keys, n));
+            for (std::size_t j = 0; j < n; j++) {
+                if constexpr (Layout == key_layout::slots) {
+                    new (unit(index[j])) AES(batch[j]);
+                } else {
+                    const auto lane = index[j] % 8;
+                    auto k = (__m128i*)unit(index[j]);
+                    for (int i = 0; i <= Nr; i++) {
+                        if constexpr (has_w)
+                            k[8*i + lane] = batch[j].round_keys()[i];
+                        if constexpr (has_dw)
+                            k[(has_w ? 8*(Nr+1) : 0) + 8*i + lane] = batch[j].inv_round_keys()[i];
+                    }
+                }
+            }
+        }
+
+        void clear(std::size_t index) {
+            if constexpr (Layout == key_layout::slots) {
+                std::memset(unit(index), 0, unit_size);
+            } else {
+                const auto lane = index % 8;
+                auto k = (__m128i*)unit(index);
+                for (int i = 0; i < (has_w + has_dw) * (Nr+1); i++)
+                    k[8*i + lane] = _mm_setzero_si128();
+            }
+        }
+    };
+}
@@ -0,0 +1,249 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "aes_stats.hpp"
+#include "aes_cbc_x86.hpp"
+#include "aes_ctr_x86.hpp"
+#include "aes_mb_x86.hpp"
+
+using namespace cheap_aes::x86;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+// one job's buffers and what the single-key APIs make of them
+template <class AES>
+struct job_case
+{
+    std::vector<std::uint8_t> in, out, ref;
+    typename AES::block_array iv, ref_iv;
+    mb_job<AES> job;
+    int completions = 0;
+};
+
+template <class AES>
+void reference(const AES& aes, job_case<AES>& c)
+{
+    c.ref.resize(c.in.size());
+    c.ref_iv = c.iv;
+    switch (c.job.mode) {
+    case mb_mode::ecb_encrypt: aes.encrypt_blocks(c.in, c.ref); break;
+    case mb_mode::ecb_decrypt: aes.decrypt_blocks(c.in, c.ref); break;
+    case mb_mode::cbc_encrypt: cbc_encrypt(aes, c.ref_iv, c.in, c.ref); break;
+    case mb_mode::cbc_decrypt: cbc_decrypt(aes, c.ref_iv, c.in, c.ref); break;
+    case mb_mode::ctr: ctr_crypt(aes, c.ref_iv, c.in, c.ref); break;
+    }
+}
+
+// more jobs than lanes, with different keys, modes and lengths in one batch
+template <class AES>
+void test_mb_mixed_x86()
+{
+    constexpr std::size_t count = 29;
+    const mb_mode modes[] = {
+        mb_mode::ecb_encrypt, mb_mode::ctr, mb_mode::cbc_decrypt, mb_mode::cbc_encrypt, mb_mode::ecb_decrypt,
+    };
+
+    std::vector<AES> keys(5);
+    for (std::size_t k = 0; k < keys.size(); k++) {
+        typename AES::key_array key;
+        for (std::size_t i = 0; i < key.size(); i++)
+            key[i] = i * 13 + k * 101;
+        keys[k].set(key);
+    }
+
+    std::vector<job_case<AES>> cases(count);
+    mb_manager<AES> mb;
+    for (std::size_t n = 0; n < count; n++) {
+        auto& c = cases[n];
+        const auto mode = modes[n % std::size(modes)];
+        auto len = (n * 37 % 23) * 16;
+        if (mode == mb_mode::ctr)
+            len += n % 16;
+        if (n == 7)
+            len = 0;
+
+        c.in.resize(len);
+        c.out.resize(len);
+        for (std::size_t i = 0; i < len; i++)
+            c.in[i] = i * 7 + n;
+        for (std::size_t i = 0; i < 16; i++)
+            c.iv[i] = i + 16*n;
+        // a counter about to wrap its low 64 bits
+        if (n == 1)
+            std::memset(&c.iv[8], 0xff, 8);
+
+        c.job.aes = &keys[n % keys.size()];
+        c.job.mode = mode;
+        c.job.in = c.in.data();
+        c.job.out = c.out.data();
+        c.job.len = len;
+        c.job.iv = c.iv.data();
+        c.job.user = &c;
+        reference(keys[n % keys.size()], c);
+        mb.submit(c.job);
+    }
+    runtime_assert(mb.pending() == count);
+
+    mb.flush([](mb_job<AES>& job) {
+        runtime_assert(job.done);
+        static_cast<job_case<AES>*>(job.user)->completions++;
+    });
+    runtime_assert(mb.pending() == 0);
+
+    for (auto& c : cases) {
+        runtime_assert(c.completions == 1);
+        runtime_assert(c.out == c.ref);
+        if (c.job.mode != mb_mode::ecb_encrypt && c.job.mode != mb_mode::ecb_decrypt)
+            runtime_assert(c.iv == c.ref_iv);
+    }
+}
+
+// in place, and a completion that submits the follow-up job
+void test_mb_chain_x86()
+{
+    aes128 aes(std::array<std::uint8_t, 16>{1, 2, 3});
+    std::vector<std::uint8_t> text(16*19), buf;
+    for (std::size_t i = 0; i < text.size(); i++)
+        text[i] = i * 5 + 1;
+    buf = text;
+
+    aes128::block_array iv{}, dec_iv{};
+    mb_job<aes128> enc{&aes, mb_mode::cbc_encrypt, buf.data(), buf.data(), buf.size(), iv.data()};
+    mb_job<aes128> dec{&aes, mb_mode::cbc_decrypt, buf.data(), buf.data(), buf.size(), dec_iv.data()};
+
+    mb_manager<aes128> mb;
+    mb.submit(enc);
+    int order = 0;
+    mb.flush([&](mb_job<aes128>& job) {
+        if (&job == &enc) {
+            runtime_assert(order++ == 0);
+            runtime_assert(buf != text);
+            mb.submit(dec);
+        } else {
+            runtime_assert(order++ == 1);
+        }
+    });
+    runtime_assert(enc.done && dec.done);
+    runtime_assert(buf == text);
+    runtime_assert(iv == dec_iv);
+}
+
+void test_mb_check_x86()
+{
+    aes128 aes;
+    std::uint8_t buf[32], iv[16];
+    mb_manager<aes128> mb;
+
+    mb_job<aes128> jobs[] = {
+        {nullptr, mb_mode::ctr, buf, buf, 16, iv},
+        {&aes, mb_mode::ecb_encrypt, buf, buf, 17},
+        {&aes, mb_mode::cbc_decrypt, buf, buf, 32},
+        {&aes, mb_mode::ctr, buf, buf, 17, iv},
+    };
+    auto throws = [&](mb_job<aes128>& job) {
+        try {
+            mb.submit(job);
+        } catch (const std::invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    runtime_assert(throws(jobs[0]));
+    runtime_assert(throws(jobs[1]));
+    runtime_assert(throws(jobs[2]));
+    runtime_assert(!throws(jobs[3]));
+    runtime_assert(mb.pending() == 1);
+}
+
+struct mb_tag {};
+using counted128_enc = aes_base<4, 4, 10, key_dir::encrypt, cheap_aes::counting_stats<mb_tag>>;
+
+// an encrypt-only schedule: no decrypting lanes, and every block counted
+void test_mb_encrypt_only_x86()
+{
+    using stats = counted128_enc::stats_type;
+    const counted128_enc aes(counted128_enc::key_array{4, 5, 6});
+    const aes128 ref(aes128::key_array{4, 5, 6});
+    std::vector<std::uint8_t> text(16*11 + 5), ecb(16*11), ctr(text.size()), ecb_ref(ecb.size()), ctr_ref(ctr.size());
+    for (std::size_t i = 0; i < text.size(); i++)
+        text[i] = i * 3 + 7;
+
+    aes128::block_array iv{}, ref_iv{};
+    mb_job<counted128_enc> jobs[] = {
+        {&aes, mb_mode::ecb_encrypt, text.data(), ecb.data(), ecb.size()},
+        {&aes, mb_mode::ctr, text.data(), ctr.data(), ctr.size(), iv.data()},
+        {&aes, mb_mode::ecb_decrypt, ecb.data(), ecb.data(), ecb.size()},
+    };
+    mb_manager<counted128_enc> mb;
+    mb.submit(jobs[0]);
+    mb.submit(jobs[1]);
+    bool thrown = false;
+    try {
+        mb.submit(jobs[2]);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    runtime_assert(thrown);
+    runtime_assert(mb.pending() == 2);
+
+    const auto before = stats::snapshot();
+    mb.flush();
+    runtime_assert((stats::snapshot() - before).blocks == 11 + 12);
+
+    ref.encrypt_blocks(std::span(text).first(ecb.size()), ecb_ref);
+    ctr_crypt(ref, ref_iv, text, ctr_ref);
+    runtime_assert(ecb == ecb_ref && ctr == ctr_ref && iv == ref_iv);
+}
+
+// a decrypt-only schedule: no encrypting lanes, CTR included
+void test_mb_decrypt_only_x86()
+{
+    const aes128 ref(aes128::key_array{7, 8, 9});
+    const aes128_dec aes = ref.inverse();
+    std::vector<std::uint8_t> text(16*13), enc(text.size()), ecb(text.size()), cbc(text.size()), ref_cbc(text.size());
+    for (std::size_t i = 0; i < text.size(); i++)
+        text[i] = i * 11 + 5;
+    ref.encrypt_blocks(text, enc);
+
+    aes128::block_array iv{}, ref_iv{};
+    iv[0] = ref_iv[0] = 0x5a;
+    mb_job<aes128_dec> jobs[] = {
+        {&aes, mb_mode::ecb_decrypt, enc.data(), ecb.data(), ecb.size()},
+        {&aes, mb_mode::cbc_decrypt, enc.data(), cbc.data(), cbc.size(), iv.data()},
+        {&aes, mb_mode::ecb_encrypt, text.data(), ecb.data(), ecb.size()},
+        {&aes, mb_mode::cbc_encrypt, text.data(), cbc.data(), cbc.size(), iv.data()},
+        {&aes, mb_mode::ctr, text.data(), cbc.data(), cbc.size(), iv.data()},
+    };
+    mb_manager<aes128_dec> mb;
+    mb.submit(jobs[0]);
+    mb.submit(jobs[1]);
+    for (auto& job : std::span(jobs).subspan(2)) {
+        bool thrown = false;
+        try {
+            mb.submit(job);
+        } catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        runtime_assert(thrown);
+    }
+    runtime_assert(mb.pending() == 2);
+    mb.flush();
+
+    cbc_decrypt(ref, ref_iv, enc, ref_cbc);
+    runtime_assert(ecb == text && cbc == ref_cbc && iv == ref_iv);
+}
+
+int main()
+{
+    test_mb_mixed_x86<aes128>();
+    test_mb_mixed_x86<aes192>();
+    test_mb_mixed_x86<aes256>();
+    test_mb_chain_x86();
+    test_mb_check_x86();
+    test_mb_encrypt_only_x86();
+    test_mb_decrypt_only_x86();
+}
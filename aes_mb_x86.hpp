@@ -0,0 +1,265 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <type_traits>
+#include <immintrin.h>
+#include "aes_ctr_x86.hpp"
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    enum class mb_mode { ecb_encrypt, ecb_decrypt, cbc_encrypt, cbc_decrypt, ctr };
+
+    // One buffer of a multi-buffer batch. iv is the CBC IV or the CTR counter
+    // block (big-endian 128-bit) and is chained as by cbc_encrypt / ctr_crypt.
+    // ECB and CBC lengths are a multiple of 16. The job is owned by the caller
+    // and has to stay alive until done.
+    template <class AES>
+    struct mb_job
+    {
+        const AES* aes = nullptr;
+        mb_mode mode = mb_mode::ecb_encrypt;
+        const std::uint8_t* in = nullptr;
+        std::uint8_t* out = nullptr;
+        std::size_t len = 0;
+        std::uint8_t* iv = nullptr;
+        void* user = nullptr;
+        bool done = false;
+    };
+
+    // Up to 8 jobs of one direction, each with its own round keys, one block
+    // per lane per pass of the round loop. A lane is refilled from the queue
+    // as soon as its job finishes.
+    template <class AES, bool Decrypt>
+    class mb_lanes
+    {
+    private:
+        static constexpr int Nr = AES::key_size() / 4 + 6;
+
+        struct lane
+        {
+            mb_job<AES>* job;
+            const __m128i* keys;
+            const std::uint8_t* in;
+            std::uint8_t* out;
+            std::size_t len;
+            __m128i chain;
+            ctr_counter<ctr_inc::be128> ctr;
+        };
+
+        lane lanes[8];
+        std::size_t m = 0;
+        std::deque<mb_job<AES>*> queue;
+
+    public:
+        void push(mb_job<AES>* job) {
+            queue.push_back(job);
+        }
+
+        bool idle() const {
+            return m == 0 && queue.empty();
+        }
+
+        std::size_t pending() const {
+            return m + queue.size();
+        }
+
+        template <class F>
+        void step(F& on_done) {
+            fill(on_done);
+            if (m == 0)
+                return;
+
+            __m128i s[8];
+            const __m128i* k[8];
+            for (std::size_t j = 0; j < m; j++) {
+                s[j] = input(lanes[j]);
+                k[j] = lanes[j].keys;
+            }
+
+            stats_t<AES>::blocks(m);
+            switch (m) {
+            case 1: rounds<1>(s, k); break;
+            case 2: rounds<2>(s, k); break;
+            case 3: rounds<3>(s, k); break;
+            case 4: rounds<4>(s, k); break;
+            case 5: rounds<5>(s, k); break;
+            case 6: rounds<6>(s, k); break;
+            case 7: rounds<7>(s, k); break;
+            default: rounds<8>(s, k); break;
+            }
+
+            for (std::size_t j = 0; j < m; j++)
+                output(lanes[j], s[j]);
+
+            for (std::size_t j = 0; j < m;) {
+                if (lanes[j].len == 0) {
+                    finish(lanes[j], on_done);
+                    lanes[j] = lanes[--m];
+                } else {
+                    j++;
+                }
+            }
+        }
+
+    private:
+        template <class F>
+        void fill(F& on_done) {
+            while (m < 8 && !queue.empty()) {
+                auto job = queue.front();
+                queue.pop_front();
+
+                auto& x = lanes[m];
+                x.job = job;
+                if constexpr (Decrypt)
+                    x.keys = job->aes->inv_round_keys();
+                else
+                    x.keys = job->aes->round_keys();
+                x.in = job->in;
+                x.out = job->out;
+                x.len = job->len;
+                if (job->mode == mb_mode::ctr)
+                    x.ctr = ctr_counter<ctr_inc::be128>(job->iv);
+                else if (job->iv)
+                    x.chain = _mm_loadu_si128((const __m128i*)job->iv);
+
+                if (x.len == 0)
+                    finish(x, on_done);
+                else
+                    m++;
+            }
+        }
+
+        template <class F>
+        static void finish(lane& x, F& on_done) {
+            const auto mode = x.job->mode;
+            if (mode == mb_mode::ctr)
+                x.ctr.store(x.job->iv);
+            else if (mode == mb_mode::cbc_encrypt || mode == mb_mode::cbc_decrypt)
+                _mm_storeu_si128((__m128i*)x.job->iv, x.chain);
+            x.job->done = true;
+            on_done(*x.job);
+        }
+
+        static __m128i input(lane& x) {
+            switch (x.job->mode) {
+            case mb_mode::ctr:
+                return x.ctr.next();
+            case mb_mode::cbc_encrypt:
+                return _mm_xor_si128(x.chain, _mm_loadu_si128((const __m128i*)x.in));
+            default:
+                return _mm_loadu_si128((const __m128i*)x.in);
+            }
+        }
+
+        static void output(lane& x, __m128i s) {
+            switch (x.job->mode) {
+            case mb_mode::ctr:
+                if (x.len < 16) {
+                    std::uint8_t ks[16];
+                    _mm_storeu_si128((__m128i*)ks, s);
+                    for (std::size_t i = 0; i < x.len; i++)
+                        x.out[i] = x.in[i] ^ ks[i];
+                    x.len = 0;
+                    return;
+                }
+                s = _mm_xor_si128(s, _mm_loadu_si128((const __m128i*)x.in));
+                break;
+            case mb_mode::cbc_encrypt:
+                x.chain = s;
+                break;
+            case mb_mode::cbc_decrypt: {
+                // read before the store for in-place use
+                const auto c = _mm_loadu_si128((const __m128i*)x.in);
+                s = _mm_xor_si128(s, x.chain);
+                x.chain = c;
+                break;
+            }
+            default:
+                break;
+            }
+            _mm_storeu_si128((__m128i*)x.out, s);
+            x.in += 16;
+            x.out += 16;
+            x.len -= 16;
+        }
+
+        // the same round of N lanes back to back, each lane with its own keys
+        template <std::size_t N>
+        static inline void rounds(__m128i (&s)[8], const __m128i* (&k)[8]) {
+            for (std::size_t j = 0; j < N; j++)
+                s[j] = _mm_xor_si128(s[j], k[j][0]);
+            for (int i = 1; i < Nr; i++)
+                for (std::size_t j = 0; j < N; j++)
+                    s[j] = Decrypt ? _mm_aesdec_si128(s[j], k[j][i]) : _mm_aesenc_si128(s[j], k[j][i]);
+            for (std::size_t j = 0; j < N; j++)
+                s[j] = Decrypt ? _mm_aesdeclast_si128(s[j], k[j][Nr]) : _mm_aesenclast_si128(s[j], k[j][Nr]);
+        }
+    };
+
+    // the lanes of a direction the AES has no schedule for
+    template <class AES, bool Decrypt>
+    struct mb_no_lanes
+    {
+        void push(mb_job<AES>*) {
+            throw std::invalid_argument(Decrypt ? "cheap_aes: AES has no decryption schedule"
+                                                : "cheap_aes: AES has no encryption schedule");
+        }
+
+        bool idle() const { return true; }
+        std::size_t pending() const { return 0; }
+        template <class F>
+        void step(F&) {}
+    };
+
+    // Multi-buffer scheduler: jobs under any number of keys are submitted,
+    // then flush() runs encrypting and decrypting lanes side by side and
+    // reports each job through on_done(job) as it completes. on_done may
+    // submit more jobs. An encrypt-only AES takes no decrypting jobs, a
+    // decrypt-only one none that encrypt (CTR included).
+    template <class AES>
+    class mb_manager
+    {
+    private:
+        std::conditional_t<has_round_keys<AES>, mb_lanes<AES, false>, mb_no_lanes<AES, false>> enc;
+        std::conditional_t<has_inv_round_keys<AES>, mb_lanes<AES, true>, mb_no_lanes<AES, true>> dec;
+
+    public:
+        void submit(mb_job<AES>& job) {
+            if (!job.aes)
+                throw std::invalid_argument("cheap_aes: job has no key");
+            if (job.mode != mb_mode::ctr && job.len % 16 != 0)
+                throw std::invalid_argument("cheap_aes: input is not a multiple of the block size");
+            if (job.mode != mb_mode::ecb_encrypt && job.mode != mb_mode::ecb_decrypt && !job.iv)
+                throw std::invalid_argument("cheap_aes: job has no IV");
+
+            job.done = false;
+            if (job.mode == mb_mode::ecb_decrypt || job.mode == mb_mode::cbc_decrypt)
+                dec.push(&job);
+            else
+                enc.push(&job);
+        }
+
+        std::size_t pending() const {
+            return enc.pending() + dec.pending();
+        }
+
+        template <class F>
+        void flush(F&& on_done) {
+            while (!enc.idle() || !dec.idle()) {
+                enc.step(on_done);
+                dec.step(on_done);
+            }
+        }
+
+        void flush() {
+            flush([](mb_job<AES>&) {});
+        }
+    };
+}
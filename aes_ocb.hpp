@@ -0,0 +1,227 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include "aes.hpp"
+
+namespace cheap_aes
+{
+    // OCB3 of RFC 7253 with 128-bit tags, block by block so that it runs in
+    // constexpr. The nonce is 1 to 15 bytes.
+    template <class AES>
+    class ocb_base
+    {
+    public:
+        static constexpr int key_size() { return AES::key_size(); };
+        static constexpr int tag_size() { return 16; };
+        static constexpr int max_nonce_size() { return 15; };
+        using key_array = typename AES::key_array;
+        using tag_array = std::array<std::uint8_t, tag_size()>;
+        using block_array = std::array<std::uint8_t, 16>;
+
+    private:
+        AES aes;
+        // L_*, L_$ and L_i for every ntz(i) of a 64-bit block count
+        block_array l_star{}, l_dollar{};
+        block_array l[64] = {};
+
+    public:
+        constexpr ocb_base() {}
+
+        constexpr explicit ocb_base(const std::uint8_t key[AES::key_size()]) {
+            set(key);
+        }
+
+        constexpr explicit ocb_base(const key_array& key) {
+            set(&key[0]);
+        }
+
+        constexpr void set(const std::uint8_t key[AES::key_size()]) {
+            aes.set(key);
+            l_star = aes.encrypt(block_array{});
+            l_dollar = twice(l_star);
+            l[0] = twice(l_dollar);
+            for (int i = 1; i < 64; i++)
+                l[i] = twice(l[i-1]);
+        }
+
+        constexpr void set(const key_array& key) {
+            set(&key[0]);
+        }
+
+        constexpr void seal(const std::uint8_t* nonce, std::size_t nonce_len,
+                            const std::uint8_t* aad, std::size_t aad_len,
+                            const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                            std::uint8_t tag[16]) const {
+            typename stats_t<AES>::call scope(len);
+            auto offset = initial_offset(nonce, nonce_len);
+            block_array sum{};
+            crypt<false>(offset, sum, in, out, len);
+            make_tag(offset, sum, aad, aad_len, tag);
+        }
+
+        // returns false and clears out when the tag does not match
+        constexpr bool open(const std::uint8_t* nonce, std::size_t nonce_len,
+                            const std::uint8_t* aad, std::size_t aad_len,
+                            const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                            const std::uint8_t tag[16]) const {
+            typename stats_t<AES>::call scope(len);
+            auto offset = initial_offset(nonce, nonce_len);
+            block_array sum{};
+            crypt<true>(offset, sum, in, out, len);
+            std::uint8_t expected[16];
+            make_tag(offset, sum, aad, aad_len, expected);
+
+            std::uint8_t diff = 0;
+            for (int i = 0; i < 16; i++)
+                diff |= expected[i] ^ tag[i];
+            if (diff != 0) {
+                std::fill(out, out + len, 0);
+                return false;
+            }
+            return true;
+        }
+
+        constexpr void seal(std::span<const std::uint8_t> nonce, std::span<const std::uint8_t> aad,
+                            std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                            tag_array& tag) const {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            seal(nonce.data(), nonce.size(), aad.data(), aad.size(), in.data(), out.data(), in.size(), &tag[0]);
+        }
+
+        constexpr bool open(std::span<const std::uint8_t> nonce, std::span<const std::uint8_t> aad,
+                            std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                            const tag_array& tag) const {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            return open(nonce.data(), nonce.size(), aad.data(), aad.size(), in.data(), out.data(), in.size(), &tag[0]);
+        }
+
+    private:
+        // Offset_0 from Ktop, the nonce block with its low 6 bits cleared,
+        // and Stretch shifted left by those 6 bits
+        constexpr block_array initial_offset(const std::uint8_t* nonce, std::size_t nonce_len) const {
+            if (nonce_len == 0 || nonce_len > (std::size_t)max_nonce_size())
+                throw std::invalid_argument("cheap_aes: OCB nonce must be 1 to 15 bytes");
+            block_array n{};
+            n[15 - nonce_len] = 1;
+            std::copy(nonce, nonce + nonce_len, n.begin() + 16 - nonce_len);
+            const int bottom = n[15] & 63;
+            n[15] &= 0xc0;
+
+            const auto ktop = aes.encrypt(n);
+            std::uint8_t stretch[25] = {};
+            std::copy(ktop.begin(), ktop.end(), stretch);
+            for (int i = 0; i < 8; i++)
+                stretch[16 + i] = ktop[i] ^ ktop[i + 1];
+
+            block_array offset;
+            const int bytes = bottom / 8, bits = bottom % 8;
+            for (int i = 0; i < 16; i++)
+                offset[i] = (std::uint8_t)(stretch[i + bytes] << bits | (bits ? stretch[i + bytes + 1] >> (8 - bits) : 0));
+            return offset;
+        }
+
+        template <bool Decrypt>
+        constexpr void crypt(block_array& offset, block_array& sum,
+                             const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            const auto n = len / 16;
+            for (std::size_t i = 0; i < n; i++, in += 16, out += 16) {
+                xor_block(offset, l[std::countr_zero(i + 1)]);
+                // p is the plaintext, kept apart from in for in-place use
+                block_array x, p;
+                for (int j = 0; j < 16; j++) {
+                    p[j] = in[j];
+                    x[j] = p[j] ^ offset[j];
+                }
+                x = Decrypt ? aes.decrypt(x) : aes.encrypt(x);
+                for (int j = 0; j < 16; j++) {
+                    out[j] = x[j] ^ offset[j];
+                    if (Decrypt)
+                        p[j] = out[j];
+                }
+                xor_block(sum, p);
+            }
+
+            if (const auto r = len % 16; r > 0) {
+                xor_block(offset, l_star);
+                const auto pad = aes.encrypt(offset);
+                block_array p{};
+                for (std::size_t j = 0; j < r; j++) {
+                    const auto x = in[j];
+                    out[j] = x ^ pad[j];
+                    p[j] = Decrypt ? out[j] : x;
+                }
+                p[r] = 0x80;
+                xor_block(sum, p);
+            }
+        }
+
+        // ENCIPHER(Checksum ^ Offset ^ L_$) ^ HASH(A)
+        constexpr void make_tag(const block_array& offset, block_array sum,
+                                const std::uint8_t* aad, std::size_t aad_len, std::uint8_t tag[16]) const {
+            xor_block(sum, offset);
+            xor_block(sum, l_dollar);
+            const auto t = aes.encrypt(sum);
+            const auto h = hash(aad, aad_len);
+            for (int i = 0; i < 16; i++)
+                tag[i] = t[i] ^ h[i];
+        }
+
+        constexpr block_array hash(const std::uint8_t* aad, std::size_t len) const {
+            block_array offset{}, sum{};
+            const auto n = len / 16;
+            for (std::size_t i = 0; i < n; i++, aad += 16) {
+                xor_block(offset, l[std::countr_zero(i + 1)]);
+                auto x = offset;
+                xor_block(x, aad);
+                xor_block(sum, aes.encrypt(x));
+            }
+            if (const auto r = len % 16; r > 0) {
+                xor_block(offset, l_star);
+                auto x = padded(aad, r);
+                xor_block(x, offset);
+                xor_block(sum, aes.encrypt(x));
+            }
+            return sum;
+        }
+
+        // r < 16 bytes, then a one bit and zeros
+        static constexpr block_array padded(const std::uint8_t* p, std::size_t r) {
+            block_array x{};
+            std::copy(p, p + r, x.begin());
+            x[r] = 0x80;
+            return x;
+        }
+
+        static constexpr void xor_block(block_array& x, const std::uint8_t* y) {
+            for (int i = 0; i < 16; i++)
+                x[i] ^= y[i];
+        }
+
+        static constexpr void xor_block(block_array& x, const block_array& y) {
+            xor_block(x, &y[0]);
+        }
+
+        // multiplication by x in GF(2^128), big-endian as OCB defines it
+        static constexpr block_array twice(const block_array& s) {
+            block_array r;
+            for (int i = 0; i < 15; i++)
+                r[i] = (std::uint8_t)(s[i] << 1 | s[i + 1] >> 7);
+            r[15] = (std::uint8_t)(s[15] << 1 ^ (s[0] >> 7) * 0x87);
+            return r;
+        }
+    };
+
+    using ocb128 = ocb_base<aes128>;
+    using ocb192 = ocb_base<aes192>;
+    using ocb256 = ocb_base<aes256>;
+}
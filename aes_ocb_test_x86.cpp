@@ -0,0 +1,172 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes_ocb.hpp"
+#include "aes_ocb_x86.hpp"
+
+using namespace cheap_aes::x86;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+// RFC 7253 appendix A: K = 000102...0f, N = BBAA99887766554433221100 + i,
+// A and P are the first aad_len and len bytes of 00 01 02 ...; each vector
+// is sealed and opened both out of place and in place
+constexpr auto rfc_key = 0x000102030405060708090a0b0c0d0e0f_bytes;
+
+template <class OCB, std::size_t N>
+constexpr bool rfc_vector(const OCB& ocb, int i, std::size_t aad_len, std::size_t len, const std::array<std::uint8_t, N>& expected)
+{
+    std::array<std::uint8_t, 40> data{};
+    for (std::size_t j = 0; j < data.size(); j++)
+        data[j] = j;
+    auto nonce = 0xbbaa99887766554433221100_bytes;
+    nonce[11] += i;
+
+    std::array<std::uint8_t, 56> enc{};
+    ocb.seal(nonce.data(), nonce.size(), data.data(), aad_len, data.data(), enc.data(), len, enc.data() + len);
+    if (len + 16 != N || !std::equal(expected.begin(), expected.end(), enc.begin()))
+        return false;
+
+    std::array<std::uint8_t, 40> dec{};
+    if (!ocb.open(nonce.data(), nonce.size(), data.data(), aad_len, enc.data(), dec.data(), len, enc.data() + len))
+        return false;
+    if (!std::equal(dec.begin(), dec.begin() + len, data.begin()))
+        return false;
+
+    // again in place, the tag after the text
+    std::array<std::uint8_t, 56> buf{};
+    std::copy_n(data.begin(), len, buf.begin());
+    ocb.seal(nonce.data(), nonce.size(), data.data(), aad_len, buf.data(), buf.data(), len, buf.data() + len);
+    if (!std::equal(expected.begin(), expected.end(), buf.begin()))
+        return false;
+    if (!ocb.open(nonce.data(), nonce.size(), data.data(), aad_len, buf.data(), buf.data(), len, buf.data() + len))
+        return false;
+    return std::equal(buf.begin(), buf.begin() + len, data.begin());
+}
+
+constexpr cheap_aes::ocb128 rfc_ocb(rfc_key);
+static_assert(rfc_vector(rfc_ocb, 0, 0, 0, 0x785407bfffc8ad9edcc5520ac9111ee6_bytes));
+static_assert(rfc_vector(rfc_ocb, 1, 8, 8, 0x6820b3657b6f615a5725bda0d3b4eb3a257c9af1f8f03009_bytes));
+static_assert(rfc_vector(rfc_ocb, 2, 8, 0, 0x81017f8203f081277152fade694a0a00_bytes));
+static_assert(rfc_vector(rfc_ocb, 3, 0, 8, 0x45dd69f8f5aae72414054cd1f35d82760b2cd00d2f99bfa9_bytes));
+static_assert(rfc_vector(rfc_ocb, 7, 24, 24, 0x1ca2207308c87c010756104d8840ce1952f09673a448a122c92c62241051f57356d7f3c90bb0e07f_bytes));
+static_assert(rfc_vector(rfc_ocb, 13, 40, 40, 0xd5ca91748410c1751ff8a2f618255b68a0a12e093ff454606e59f9c1d0ddc54b65e8628e568bad7aed07ba06a4a69483a7035490c5769e60_bytes));
+
+template <class OCB>
+void test_ocb_rfc_x86()
+{
+    const OCB ocb(rfc_key);
+    runtime_assert(rfc_vector(ocb, 0, 0, 0, 0x785407bfffc8ad9edcc5520ac9111ee6_bytes));
+    runtime_assert(rfc_vector(ocb, 1, 8, 8, 0x6820b3657b6f615a5725bda0d3b4eb3a257c9af1f8f03009_bytes));
+    runtime_assert(rfc_vector(ocb, 2, 8, 0, 0x81017f8203f081277152fade694a0a00_bytes));
+    runtime_assert(rfc_vector(ocb, 3, 0, 8, 0x45dd69f8f5aae72414054cd1f35d82760b2cd00d2f99bfa9_bytes));
+    runtime_assert(rfc_vector(ocb, 4, 16, 16, 0x571d535b60b277188be5147170a9a22c3ad7a4ff3835b8c5701c1ccec8fc3358_bytes));
+    runtime_assert(rfc_vector(ocb, 5, 16, 0, 0x8cf761b6902ef764462ad86498ca6b97_bytes));
+    runtime_assert(rfc_vector(ocb, 6, 0, 16, 0x5ce88ec2e0692706a915c00aeb8b2396f40e1c743f52436bdf06d8fa1eca343d_bytes));
+    runtime_assert(rfc_vector(ocb, 7, 24, 24, 0x1ca2207308c87c010756104d8840ce1952f09673a448a122c92c62241051f57356d7f3c90bb0e07f_bytes));
+    runtime_assert(rfc_vector(ocb, 8, 24, 0, 0x6dc225a071fc1b9f7c69f93b0f1e10de_bytes));
+    runtime_assert(rfc_vector(ocb, 9, 0, 24, 0x221bd0de7fa6fe993eccd769460a0af2d6cded0c395b1c3ce725f32494b9f914d85c0b1eb38357ff_bytes));
+    runtime_assert(rfc_vector(ocb, 10, 32, 32, 0xbd6f6c496201c69296c11efd138a467abd3c707924b964deaffc40319af5a48540fbba186c5553c68ad9f592a79a4240_bytes));
+    runtime_assert(rfc_vector(ocb, 11, 32, 0, 0xfe80690bee8a485d11f32965bc9d2a32_bytes));
+    runtime_assert(rfc_vector(ocb, 12, 0, 32, 0x2942bfc773bda23cabc6acfd9bfd5835bd300f0973792ef46040c53f1432bcdfb5e1dde3bc18a5f840b52e653444d5df_bytes));
+    runtime_assert(rfc_vector(ocb, 13, 40, 40, 0xd5ca91748410c1751ff8a2f618255b68a0a12e093ff454606e59f9c1d0ddc54b65e8628e568bad7aed07ba06a4a69483a7035490c5769e60_bytes));
+    runtime_assert(rfc_vector(ocb, 14, 40, 0, 0xc5cd9d1850c141e358649994ee701b68_bytes));
+    runtime_assert(rfc_vector(ocb, 15, 0, 40, 0x4412923493c57d5de0d700f753cce0d1d2d95060122e9f15a5ddbfc5787e50b5cc55ee507bcb084e479ad363ac366b95a98ca5f3000b1479_bytes));
+}
+
+// RFC 7253 appendix A, the iterated test of every length up to 127 bytes
+template <class OCB>
+typename OCB::tag_array iterated()
+{
+    typename OCB::key_array key{};
+    key.back() = 128;
+    const OCB ocb(key);
+    const auto seal = [&](std::uint64_t n, std::span<const std::uint8_t> a, std::span<const std::uint8_t> p) {
+        std::array<std::uint8_t, 12> nonce{};
+        for (int j = 0; j < 8; j++)
+            nonce[11 - j] = n >> 8*j;
+        std::vector<std::uint8_t> c(p.size() + 16);
+        typename OCB::tag_array tag;
+        ocb.seal(nonce, a, p, std::span(c).first(p.size()), tag);
+        std::copy(tag.begin(), tag.end(), c.begin() + p.size());
+        return c;
+    };
+
+    std::vector<std::uint8_t> c;
+    for (std::uint64_t i = 0; i < 128; i++) {
+        const std::vector<std::uint8_t> s(i);
+        for (auto& part : { seal(3*i + 1, s, s), seal(3*i + 2, {}, s), seal(3*i + 3, s, {}) })
+            c.insert(c.end(), part.begin(), part.end());
+    }
+    const auto out = seal(385, c, {});
+    typename OCB::tag_array tag{};
+    std::copy_n(out.begin(), tag.size(), tag.begin());
+    return tag;
+}
+
+void test_ocb_iterated_x86()
+{
+    runtime_assert(iterated<cheap_aes::ocb128>() == 0x67e944d23256c5e0b6c61fa22fdf1ea2_bytes);
+    runtime_assert(iterated<cheap_aes::ocb192>() == 0xf673f2c3e7174aae7bae986ca9f29e17_bytes);
+    runtime_assert(iterated<cheap_aes::ocb256>() == 0xd90eb8e9c977c88b79dd793d7ffa161c_bytes);
+    runtime_assert(iterated<ocb128>() == 0x67e944d23256c5e0b6c61fa22fdf1ea2_bytes);
+    runtime_assert(iterated<ocb192>() == 0xf673f2c3e7174aae7bae986ca9f29e17_bytes);
+    runtime_assert(iterated<ocb256>() == 0xd90eb8e9c977c88b79dd793d7ffa161c_bytes);
+}
+
+// the 8-wide paths, in place, against the portable implementation, and
+// every nonce length
+void test_ocb_long_x86()
+{
+    const auto key = 0x603deb1015ca71be2b73aef0857d77811f352c073b6108d77d9814a09acb5f1f_bytes;
+    const ocb256 ocb(key);
+    const cheap_aes::ocb256 ref(key);
+    std::vector<std::uint8_t> text(2100);
+    for (std::size_t i = 0; i < text.size(); i++)
+        text[i] = i * 7 + 3;
+
+    std::size_t nonce_len = 1;
+    for (std::size_t len : {1, 15, 16, 127, 128, 129, 255, 256, 1000, 2048, 2100}) {
+        for (std::size_t aad_len : {0, 17, 128, 300}) {
+            const std::span<const std::uint8_t> nonce(text.data() + 5, nonce_len);
+            const std::span<const std::uint8_t> aad(text.data() + 11, aad_len);
+            std::vector<std::uint8_t> enc(len), expected(len);
+            ocb256::tag_array tag, expected_tag;
+            ocb.seal(nonce, aad, std::span(text).first(len), enc, tag);
+            ref.seal(nonce, aad, std::span(text).first(len), expected, expected_tag);
+            runtime_assert(enc == expected && tag == expected_tag);
+
+            auto buf = enc;
+            runtime_assert(ocb.open(nonce, aad, buf, buf, tag));
+            runtime_assert(std::equal(buf.begin(), buf.end(), text.begin()));
+
+            buf = enc;
+            buf[len / 2] ^= 1;
+            runtime_assert(!ocb.open(nonce, aad, buf, buf, tag));
+            runtime_assert(std::ranges::all_of(buf, [](auto x) { return x == 0; }));
+            nonce_len = nonce_len % 15 + 1;
+        }
+    }
+
+    bool thrown = false;
+    try {
+        ocb256::tag_array tag;
+        ocb.seal(std::span(text).first(16), {}, {}, {}, tag);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    runtime_assert(thrown);
+}
+
+int main()
+{
+    test_ocb_rfc_x86<cheap_aes::ocb128>();
+    test_ocb_rfc_x86<ocb128>();
+    test_ocb_iterated_x86();
+    test_ocb_long_x86();
+}
@@ -0,0 +1,251 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <immintrin.h>
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    // OCB3 of RFC 7253 with 128-bit tags, the nonce is 1 to 15 bytes.
+    // The offsets of 8 consecutive blocks are the running offset XOR the
+    // L_i table, so 8 blocks go through the interleaved kernels with only
+    // XORs around them and no multiplication as in GHASH. Decryption runs
+    // the inverse cipher, so the context keeps both schedules.
+    template <class AES>
+    class ocb_base
+    {
+        static_assert(has_round_keys<AES> && has_inv_round_keys<AES>, "ocb_base: AES has to keep both schedules");
+
+    public:
+        static constexpr int key_size() { return AES::key_size(); };
+        static constexpr int tag_size() { return 16; };
+        static constexpr int max_nonce_size() { return 15; };
+        using key_array = typename AES::key_array;
+        using tag_array = std::array<std::uint8_t, tag_size()>;
+
+    private:
+        AES aes;
+        // L_*, L_$ and L_i for every ntz(i) of a 64-bit block count
+        __m128i l_star, l_dollar;
+        __m128i l[64];
+        // L_ntz(1) ^ .. ^ L_ntz(j+1), the offset of block j of 8 from the one before them
+        __m128i l_sum[7];
+
+    public:
+        ocb_base() {}
+
+        explicit ocb_base(const std::uint8_t key[AES::key_size()]) {
+            set(key);
+        }
+
+        explicit ocb_base(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void set(const std::uint8_t key[AES::key_size()]) {
+            aes.set(key);
+            l_star = aes.encrypt_si128(_mm_setzero_si128());
+            l_dollar = twice(l_star);
+            l[0] = twice(l_dollar);
+            for (int i = 1; i < 64; i++)
+                l[i] = twice(l[i-1]);
+            l_sum[0] = l[0];
+            for (int j = 1; j < 7; j++)
+                l_sum[j] = _mm_xor_si128(l_sum[j-1], l[std::countr_zero(unsigned(j + 1))]);
+        }
+
+        void set(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void seal(const std::uint8_t* nonce, std::size_t nonce_len,
+                  const std::uint8_t* aad, std::size_t aad_len,
+                  const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                  std::uint8_t tag[16]) const {
+            typename stats_t<AES>::call scope(len);
+            auto offset = initial_offset(nonce, nonce_len);
+            auto sum = _mm_setzero_si128();
+            crypt<false>(offset, sum, in, out, len);
+            _mm_storeu_si128((__m128i*)tag, make_tag(offset, sum, aad, aad_len));
+        }
+
+        // decrypts and sums in one pass, out is cleared when the tag does not match
+        bool open(const std::uint8_t* nonce, std::size_t nonce_len,
+                  const std::uint8_t* aad, std::size_t aad_len,
+                  const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                  const std::uint8_t tag[16]) const {
+            typename stats_t<AES>::call scope(len);
+            auto offset = initial_offset(nonce, nonce_len);
+            auto sum = _mm_setzero_si128();
+            crypt<true>(offset, sum, in, out, len);
+            std::uint8_t expected[16];
+            _mm_storeu_si128((__m128i*)expected, make_tag(offset, sum, aad, aad_len));
+
+            std::uint8_t diff = 0;
+            for (int i = 0; i < 16; i++)
+                diff |= expected[i] ^ tag[i];
+            if (diff != 0) {
+                std::memset(out, 0, len);
+                return false;
+            }
+            return true;
+        }
+
+        void seal(std::span<const std::uint8_t> nonce, std::span<const std::uint8_t> aad,
+                  std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                  tag_array& tag) const {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            seal(nonce.data(), nonce.size(), aad.data(), aad.size(), in.data(), out.data(), in.size(), &tag[0]);
+        }
+
+        bool open(std::span<const std::uint8_t> nonce, std::span<const std::uint8_t> aad,
+                  std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                  const tag_array& tag) const {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+            return open(nonce.data(), nonce.size(), aad.data(), aad.size(), in.data(), out.data(), in.size(), &tag[0]);
+        }
+
+    private:
+        // Offset_0 from Ktop, the nonce block with its low 6 bits cleared,
+        // and Stretch shifted left by those 6 bits
+        __m128i initial_offset(const std::uint8_t* nonce, std::size_t nonce_len) const {
+            if (nonce_len == 0 || nonce_len > (std::size_t)max_nonce_size())
+                throw std::invalid_argument("cheap_aes: OCB nonce must be 1 to 15 bytes");
+            std::uint8_t n[16] = {};
+            n[15 - nonce_len] = 1;
+            std::memcpy(n + 16 - nonce_len, nonce, nonce_len);
+            const int bottom = n[15] & 63;
+            n[15] &= 0xc0;
+
+            std::uint8_t stretch[25] = {};
+            _mm_storeu_si128((__m128i*)stretch, aes.encrypt_si128(_mm_loadu_si128((const __m128i*)n)));
+            for (int i = 0; i < 8; i++)
+                stretch[16 + i] = stretch[i] ^ stretch[i + 1];
+
+            std::uint8_t offset[16];
+            const int bytes = bottom / 8, bits = bottom % 8;
+            for (int i = 0; i < 16; i++)
+                offset[i] = (std::uint8_t)(stretch[i + bytes] << bits | (bits ? stretch[i + bytes + 1] >> (8 - bits) : 0));
+            return _mm_loadu_si128((const __m128i*)offset);
+        }
+
+        // the offset of block j of 8 after i blocks, from the offset before them;
+        // recomputed rather than kept for all 8 blocks, which would not fit in registers
+        __m128i batch_offset(__m128i offset, std::uint64_t i, std::size_t j) const {
+            if (j < 7)
+                return _mm_xor_si128(offset, l_sum[j]);
+            return _mm_xor_si128(_mm_xor_si128(offset, l_sum[6]), l[std::countr_zero(i + 8)]);
+        }
+
+        template <bool Decrypt>
+        void crypt(__m128i& offset, __m128i& sum, const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            std::uint64_t i = 0;
+            for (; len >= 8*16; len -= 8*16, in += 8*16, out += 8*16, i += 8) {
+                __m128i s[8];
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < 8; j++) {
+                    const auto x = _mm_loadu_si128((const __m128i*)in + j);
+                    if constexpr (!Decrypt)
+                        sum = _mm_xor_si128(sum, x);
+                    s[j] = _mm_xor_si128(x, batch_offset(offset, i, j));
+                }
+                if constexpr (Decrypt)
+                    aes.decrypt_si128(s);
+                else
+                    aes.encrypt_si128(s);
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < 8; j++) {
+                    const auto y = _mm_xor_si128(s[j], batch_offset(offset, i, j));
+                    if constexpr (Decrypt)
+                        sum = _mm_xor_si128(sum, y);
+                    _mm_storeu_si128((__m128i*)out + j, y);
+                }
+                offset = batch_offset(offset, i, 7);
+            }
+
+            for (; len >= 16; len -= 16, in += 16, out += 16) {
+                offset = _mm_xor_si128(offset, l[std::countr_zero(++i)]);
+                const auto x = _mm_loadu_si128((const __m128i*)in);
+                auto y = _mm_xor_si128(x, offset);
+                y = _mm_xor_si128(Decrypt ? aes.decrypt_si128(y) : aes.encrypt_si128(y), offset);
+                sum = _mm_xor_si128(sum, Decrypt ? y : x);
+                _mm_storeu_si128((__m128i*)out, y);
+            }
+
+            if (len > 0) {
+                offset = _mm_xor_si128(offset, l_star);
+                std::uint8_t pad[16], p[16] = {};
+                _mm_storeu_si128((__m128i*)pad, aes.encrypt_si128(offset));
+                for (std::size_t j = 0; j < len; j++) {
+                    const auto x = in[j];
+                    out[j] = x ^ pad[j];
+                    p[j] = Decrypt ? out[j] : x;
+                }
+                p[len] = 0x80;
+                sum = _mm_xor_si128(sum, _mm_loadu_si128((const __m128i*)p));
+            }
+        }
+
+        // ENCIPHER(Checksum ^ Offset ^ L_$) ^ HASH(A)
+        __m128i make_tag(__m128i offset, __m128i sum, const std::uint8_t* aad, std::size_t aad_len) const {
+            const auto t = aes.encrypt_si128(_mm_xor_si128(_mm_xor_si128(sum, offset), l_dollar));
+            return _mm_xor_si128(t, hash(aad, aad_len));
+        }
+
+        __m128i hash(const std::uint8_t* aad, std::size_t len) const {
+            auto offset = _mm_setzero_si128();
+            auto sum = _mm_setzero_si128();
+            std::uint64_t i = 0;
+            for (; len >= 8*16; len -= 8*16, aad += 8*16, i += 8) {
+                __m128i s[8];
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < 8; j++)
+                    s[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)aad + j), batch_offset(offset, i, j));
+                offset = batch_offset(offset, i, 7);
+                aes.encrypt_si128(s);
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < 8; j++)
+                    sum = _mm_xor_si128(sum, s[j]);
+            }
+
+            for (; len >= 16; len -= 16, aad += 16) {
+                offset = _mm_xor_si128(offset, l[std::countr_zero(++i)]);
+                sum = _mm_xor_si128(sum, aes.encrypt_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i*)aad), offset)));
+            }
+
+            if (len > 0) {
+                offset = _mm_xor_si128(offset, l_star);
+                std::uint8_t p[16] = {};
+                std::memcpy(p, aad, len);
+                p[len] = 0x80;
+                sum = _mm_xor_si128(sum, aes.encrypt_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i*)p), offset)));
+            }
+            return sum;
+        }
+
+        // multiplication by x in GF(2^128) on the big-endian block
+        static __m128i twice(__m128i s) {
+            const auto bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+            const auto x = _mm_shuffle_epi8(s, bswap);
+            auto r = _mm_or_si128(_mm_slli_epi64(x, 1), _mm_slli_si128(_mm_srli_epi64(x, 63), 8));
+            // all ones when the top bit shifted out
+            const auto top = _mm_shuffle_epi32(_mm_srai_epi32(x, 31), 0xff);
+            r = _mm_xor_si128(r, _mm_and_si128(top, _mm_set_epi64x(0, 0x87)));
+            return _mm_shuffle_epi8(r, bswap);
+        }
+    };
+
+    using ocb128 = ocb_base<aes128>;
+    using ocb192 = ocb_base<aes192>;
+    using ocb256 = ocb_base<aes256>;
+}
@@ -0,0 +1,174 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "aes_parallel_x86.hpp"
+
+using namespace cheap_aes::x86;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+// small chunks and no threshold, so that short buffers are split many ways
+constexpr parallel_config small{ 1000, 0 };
+
+std::vector<std::uint8_t> make_text(std::size_t len)
+{
+    std::vector<std::uint8_t> text(len);
+    for (std::size_t i = 0; i < len; i++)
+        text[i] = i * 13 + (i >> 8);
+    return text;
+}
+
+void test_pool_x86()
+{
+    thread_pool pool(4, true);
+    runtime_assert(pool.size() == 4);
+
+    std::vector<std::atomic<int>> hits(1000);
+    for (int round = 0; round < 3; round++) {
+        pool.run(hits.size(), [&](std::size_t i) { hits[i]++; });
+        for (auto& h : hits)
+            runtime_assert(h == round + 1);
+    }
+
+    bool thrown = false;
+    try {
+        pool.run(100, [](std::size_t i) {
+            if (i == 42)
+                throw std::runtime_error("task");
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    runtime_assert(thrown);
+
+    // a task calling run() of its own pool fails instead of deadlocking,
+    // another pool may be used
+    thread_pool inner(2);
+    std::atomic<int> nested = 0, inner_hits = 0;
+    thrown = false;
+    try {
+        pool.run(8, [&](std::size_t) {
+            inner.run(4, [&](std::size_t) { inner_hits++; });
+            try {
+                pool.run(2, [](std::size_t) {});
+            } catch (const std::logic_error&) {
+                nested++;
+                throw;
+            }
+        });
+    } catch (const std::logic_error&) {
+        thrown = true;
+    }
+    runtime_assert(thrown);
+    runtime_assert(nested == 8);
+    runtime_assert(inner_hits == 32);
+
+    // run() from several threads at once takes turns
+    for (auto& h : hits)
+        h = 0;
+    std::vector<std::thread> callers;
+    for (int t = 0; t < 4; t++)
+        callers.emplace_back([&] {
+            for (int round = 0; round < 50; round++)
+                pool.run(hits.size(), [&](std::size_t i) { hits[i]++; });
+        });
+    for (auto& t : callers)
+        t.join();
+    for (auto& h : hits)
+        runtime_assert(h == 200);
+}
+
+void test_parallel_ecb_ctr_x86()
+{
+    thread_pool pool(4);
+    aes128 aes(std::array<std::uint8_t, 16>{1, 2, 3, 4});
+    for (std::size_t len : {16*0, 16*1, 16*62, 16*63, 16*1000 + 5}) {
+        const auto text = make_text(len);
+        std::vector<std::uint8_t> ref(len), buf(len);
+
+        const auto whole = len / 16;
+        aes.encrypt_blocks(text.data(), ref.data(), whole);
+        parallel_encrypt_blocks(pool, aes, text.data(), buf.data(), whole, small);
+        runtime_assert(std::memcmp(buf.data(), ref.data(), whole * 16) == 0);
+        parallel_decrypt_blocks(pool, aes, buf.data(), buf.data(), whole, small);
+        runtime_assert(std::memcmp(buf.data(), text.data(), whole * 16) == 0);
+
+        // the low 32 bits of the counter wrap in the middle
+        aes128::block_array c1{}, c2{};
+        c1.fill(0xab);
+        c1[12] = c1[13] = c1[14] = 0xff;
+        c1[15] = 0xf0;
+        c2 = c1;
+        ctr_crypt<ctr_inc::be32>(aes, c1, text, ref);
+        parallel_ctr_crypt<ctr_inc::be32>(pool, aes, c2, text, buf, small);
+        runtime_assert(buf == ref);
+        runtime_assert(c1 == c2);
+
+        c1.fill(0xff);
+        c2 = c1;
+        ctr_crypt(aes, c1, text, ref);
+        parallel_ctr_crypt(pool, aes, c2, text, buf, small);
+        runtime_assert(buf == ref);
+        runtime_assert(c1 == c2);
+    }
+}
+
+void test_parallel_xts_x86()
+{
+    thread_pool pool(3);
+    xts128::key_array key;
+    for (std::size_t i = 0; i < key.size(); i++)
+        key[i] = i * 5 + 1;
+    xts128 xts(key);
+
+    for (std::size_t unit : {512, 4096, 520}) {
+        const auto text = make_text(unit * 37);
+        std::vector<std::uint8_t> ref(text.size()), buf(text.size());
+        xts.encrypt_sectors(7, unit, text.data(), ref.data(), text.size());
+        parallel_encrypt_sectors(pool, xts, 7, unit, text.data(), buf.data(), text.size(), small);
+        runtime_assert(buf == ref);
+        parallel_decrypt_sectors(pool, xts, 7, unit, buf.data(), buf.data(), buf.size(), small);
+        runtime_assert(buf == text);
+    }
+}
+
+void test_parallel_gcm_x86()
+{
+    thread_pool pool(4);
+    gcm256 gcm(gcm256::key_array{9, 8, 7});
+    const auto aad = make_text(45);
+    for (std::size_t iv_len : {12, 20}) {
+        const auto iv = make_text(iv_len);
+        for (std::size_t len : {0, 1, 999, 1000, 1008, 1024*10 + 3, 1024*64}) {
+            const auto text = make_text(len);
+            std::vector<std::uint8_t> ref(len), buf(len);
+            std::uint8_t ref_tag[16], tag[16];
+            gcm.seal(iv.data(), iv.size(), aad.data(), aad.size(), text.data(), ref.data(), len, ref_tag);
+            parallel_seal(pool, gcm, iv.data(), iv.size(), aad.data(), aad.size(), text.data(), buf.data(), len, tag, small);
+            runtime_assert(buf == ref);
+            runtime_assert(std::memcmp(tag, ref_tag, 16) == 0);
+
+            runtime_assert(parallel_open(pool, gcm, iv.data(), iv.size(), aad.data(), aad.size(), buf.data(), buf.data(), len, tag, small));
+            runtime_assert(buf == text);
+
+            if (len > 0) {
+                tag[0] ^= 1;
+                runtime_assert(!parallel_open(pool, gcm, iv.data(), iv.size(), aad.data(), aad.size(), ref.data(), buf.data(), len, tag, small));
+                runtime_assert(buf == std::vector<std::uint8_t>(len));
+            }
+        }
+    }
+}
+
+int main()
+{
+    test_pool_x86();
+    test_parallel_ecb_ctr_x86();
+    test_parallel_xts_x86();
+    test_parallel_gcm_x86();
+}
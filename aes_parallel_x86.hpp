@@ -0,0 +1,402 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <immintrin.h>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "aes_ctr_x86.hpp"
+#include "aes_gcm_x86.hpp"
+#include "aes_x86.hpp"
+#include "aes_xts_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    // A fixed set of workers for run(n, f). The calling thread is worker 0.
+    // Each worker starts on its own contiguous range of the n tasks and
+    // then steals from the others. With pin, worker i stays on the i-th
+    // CPU the process may use, so a buffer split the same way every call
+    // is worked on where its pages were first touched. Calls of run() from
+    // several threads take turns; f must not call run() of the same pool.
+    class thread_pool
+    {
+    private:
+        struct alignas(64) range
+        {
+            std::atomic<std::size_t> next;
+            std::size_t end;
+        };
+
+        std::vector<std::thread> threads;
+        std::unique_ptr<range[]> ranges;
+        unsigned nworkers;
+
+        std::mutex m;
+        std::condition_variable wake, idle;
+        std::uint64_t generation = 0;
+        unsigned busy = 0;
+        bool stop = false;
+
+        // held for a whole run(), call, ctx, ranges and error are per call
+        std::mutex run_m;
+        void (*call)(void*, std::size_t) = nullptr;
+        void* ctx = nullptr;
+        std::exception_ptr error;
+
+        // the pool whose tasks this thread is running
+        static inline thread_local const thread_pool* current = nullptr;
+
+        struct task_scope
+        {
+            const thread_pool* saved;
+            explicit task_scope(const thread_pool* p) : saved(std::exchange(current, p)) {}
+            ~task_scope() { current = saved; }
+        };
+
+    public:
+        explicit thread_pool(unsigned n = std::thread::hardware_concurrency(), bool pin = false)
+            : ranges(new range[std::max(n, 1u)]), nworkers(std::max(n, 1u)) {
+            const auto cpus = allowed_cpus();
+            for (unsigned i = 1; i < nworkers; i++) {
+                threads.emplace_back([this, i] { worker(i); });
+                if (pin && !cpus.empty())
+                    pin_thread(threads.back(), cpus[i % cpus.size()]);
+            }
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        ~thread_pool() {
+            {
+                std::lock_guard lock(m);
+                stop = true;
+            }
+            wake.notify_all();
+            for (auto& t : threads)
+                t.join();
+        }
+
+        unsigned size() const {
+            return nworkers;
+        }
+
+        // f(i) for every i in [0, n), returns when all are done.
+        // The first exception thrown by f is rethrown here. A call from
+        // inside f, which would deadlock, throws std::logic_error.
+        template <class F>
+        void run(std::size_t n, F&& f) {
+            if (current == this)
+                throw std::logic_error("cheap_aes: thread_pool::run called from one of its tasks");
+
+            if (nworkers == 1 || n <= 1) {
+                task_scope scope(this);
+                for (std::size_t i = 0; i < n; i++)
+                    f(i);
+                return;
+            }
+
+            std::lock_guard serial(run_m);
+            {
+                std::lock_guard lock(m);
+                for (unsigned w = 0; w < nworkers; w++) {
+                    ranges[w].next.store(n * w / nworkers, std::memory_order_relaxed);
+                    ranges[w].end = n * (w + 1) / nworkers;
+                }
+                call = [](void* p, std::size_t i) { (*static_cast<std::remove_reference_t<F>*>(p))(i); };
+                ctx = (void*)&f;
+                error = nullptr;
+                busy = nworkers - 1;
+                generation++;
+            }
+            wake.notify_all();
+
+            {
+                task_scope scope(this);
+                work(0);
+            }
+
+            std::unique_lock lock(m);
+            idle.wait(lock, [this] { return busy == 0; });
+            if (error)
+                std::rethrow_exception(std::exchange(error, nullptr));
+        }
+
+    private:
+        void worker(unsigned self) {
+            current = this;
+            std::uint64_t seen = 0;
+            for (;;) {
+                {
+                    std::unique_lock lock(m);
+                    wake.wait(lock, [&] { return stop || generation != seen; });
+                    if (stop)
+                        return;
+                    seen = generation;
+                }
+                work(self);
+                {
+                    std::lock_guard lock(m);
+                    busy--;
+                }
+                idle.notify_one();
+            }
+        }
+
+        // own range first, then the others' in turn
+        void work(unsigned self) {
+            for (unsigned k = 0; k < nworkers; k++) {
+                auto& r = ranges[(self + k) % nworkers];
+                for (;;) {
+                    const auto i = r.next.fetch_add(1, std::memory_order_relaxed);
+                    if (i >= r.end)
+                        break;
+                    try {
+                        call(ctx, i);
+                    } catch (...) {
+                        std::lock_guard lock(m);
+                        if (!error)
+                            error = std::current_exception();
+                    }
+                }
+            }
+        }
+
+        static std::vector<int> allowed_cpus() {
+            std::vector<int> cpus;
+#if defined(__linux__)
+            cpu_set_t set;
+            if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+                for (int c = 0; c < CPU_SETSIZE; c++)
+                    if (CPU_ISSET(c, &set))
+                        cpus.push_back(c);
+            }
+#endif
+            return cpus;
+        }
+
+        static void pin_thread([[maybe_unused]] std::thread& t, [[maybe_unused]] int cpu) {
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#endif
+        }
+    };
+
+    // chunk is the bytes per task, about the size of L2. Calls shorter than
+    // threshold run on the calling thread alone.
+    struct parallel_config
+    {
+        std::size_t chunk = 256 * 1024;
+        std::size_t threshold = 1024 * 1024;
+    };
+
+    inline std::size_t parallel_chunk(const parallel_config& cfg, std::size_t unit) {
+        return std::max<std::size_t>(cfg.chunk / unit, 1) * unit;
+    }
+
+    // f(offset, len) over chunk sized parts of len bytes
+    template <class F>
+    void parallel_split(thread_pool& pool, std::size_t len, std::size_t chunk, F&& f) {
+        pool.run((len + chunk - 1) / chunk, [&](std::size_t k) {
+            const auto offset = k * chunk;
+            f(offset, std::min(chunk, len - offset));
+        });
+    }
+
+    template <class AES>
+    void parallel_encrypt_blocks(thread_pool& pool, const AES& aes,
+                                 const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks,
+                                 const parallel_config& cfg = {}) {
+        if (nblocks * 16 < cfg.threshold)
+            return aes.encrypt_blocks(in, out, nblocks);
+        parallel_split(pool, nblocks * 16, parallel_chunk(cfg, 16), [&](std::size_t offset, std::size_t len) {
+            aes.encrypt_blocks(in + offset, out + offset, len / 16);
+        });
+    }
+
+    template <class AES>
+    void parallel_decrypt_blocks(thread_pool& pool, const AES& aes,
+                                 const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks,
+                                 const parallel_config& cfg = {}) {
+        if (nblocks * 16 < cfg.threshold)
+            return aes.decrypt_blocks(in, out, nblocks);
+        parallel_split(pool, nblocks * 16, parallel_chunk(cfg, 16), [&](std::size_t offset, std::size_t len) {
+            aes.decrypt_blocks(in + offset, out + offset, len / 16);
+        });
+    }
+
+    // backends with a CTR kernel of their own, such as dispatch::aes_base
+    template <class AES>
+    concept has_ctr_crypt = requires(const AES& aes, std::uint8_t* p, std::size_t n) { aes.ctr_crypt(p, p, p, n); };
+
+    template <ctr_inc Inc, class AES>
+    void parallel_ctr_part(const AES& aes, std::uint8_t counter[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len) {
+        if constexpr (Inc == ctr_inc::be128 && has_ctr_crypt<AES>)
+            aes.ctr_crypt(counter, in, out, len);
+        else
+            ctr_crypt<Inc>(aes, counter, in, out, len);
+    }
+
+    // counter is left as by ctr_crypt, each chunk starts from its own offset
+    template <ctr_inc Inc = ctr_inc::be128, class AES>
+    void parallel_ctr_crypt(thread_pool& pool, const AES& aes, std::uint8_t counter[16],
+                            const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                            const parallel_config& cfg = {}) {
+        if (len < cfg.threshold)
+            return parallel_ctr_part<Inc>(aes, counter, in, out, len);
+
+        const ctr_counter<Inc> start(counter);
+        parallel_split(pool, len, parallel_chunk(cfg, 16), [&](std::size_t offset, std::size_t part) {
+            auto ctr = start;
+            ctr.skip(offset / 16);
+            std::uint8_t block[16];
+            ctr.store(block);
+            parallel_ctr_part<Inc>(aes, block, in + offset, out + offset, part);
+        });
+
+        auto end = start;
+        end.skip((len + 15) / 16);
+        end.store(counter);
+    }
+
+    template <class XTS>
+    void parallel_encrypt_sectors(thread_pool& pool, const XTS& xts, std::uint64_t sector, std::size_t unit_size,
+                                  const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                                  const parallel_config& cfg = {}) {
+        if (len < cfg.threshold || unit_size == 0 || len % unit_size != 0)
+            return xts.encrypt_sectors(sector, unit_size, in, out, len);
+        parallel_split(pool, len, parallel_chunk(cfg, unit_size), [&](std::size_t offset, std::size_t part) {
+            xts.encrypt_sectors(sector + offset / unit_size, unit_size, in + offset, out + offset, part);
+        });
+    }
+
+    template <class XTS>
+    void parallel_decrypt_sectors(thread_pool& pool, const XTS& xts, std::uint64_t sector, std::size_t unit_size,
+                                  const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                                  const parallel_config& cfg = {}) {
+        if (len < cfg.threshold || unit_size == 0 || len % unit_size != 0)
+            return xts.decrypt_sectors(sector, unit_size, in, out, len);
+        parallel_split(pool, len, parallel_chunk(cfg, unit_size), [&](std::size_t offset, std::size_t part) {
+            xts.decrypt_sectors(sector + offset / unit_size, unit_size, in + offset, out + offset, part);
+        });
+    }
+
+    // GCM with the chunks' GHASH digests joined in order through powers of H
+    template <bool Decrypt, class GCM>
+    void parallel_gcm_crypt(thread_pool& pool, const GCM& gcm, const std::uint8_t j0[16],
+                            const std::uint8_t* aad, std::size_t aad_len,
+                            const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                            std::uint8_t tag[16], const parallel_config& cfg) {
+        struct part_digest
+        {
+            __m128i y;
+        };
+
+        const auto chunk = parallel_chunk(cfg, 16);
+        const auto n = (len + chunk - 1) / chunk;
+        std::vector<part_digest> ys(n);
+        parallel_split(pool, len, chunk, [&](std::size_t offset, std::size_t part) {
+            gcm.template crypt_part<Decrypt>(j0, offset / 16, in + offset, out + offset, part, ys[offset / chunk].y);
+        });
+
+        const auto& gh = gcm.hash();
+        auto y = _mm_setzero_si128();
+        gh.update(y, aad, aad_len);
+        const auto hc = gh.power(chunk / 16);
+        for (std::size_t k = 0; k < n; k++) {
+            const auto h = k + 1 < n ? hc : gh.power((len - k * chunk + 15) / 16);
+            y = _mm_xor_si128(ghash::mul(y, h), ys[k].y);
+        }
+        gcm.finish(j0, y, aad_len, len, tag);
+    }
+
+    template <class GCM>
+    void parallel_seal(thread_pool& pool, const GCM& gcm,
+                       const std::uint8_t* iv, std::size_t iv_len,
+                       const std::uint8_t* aad, std::size_t aad_len,
+                       const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                       std::uint8_t tag[16], const parallel_config& cfg = {}) {
+        if (len < cfg.threshold)
+            return gcm.seal(iv, iv_len, aad, aad_len, in, out, len, tag);
+
+        std::uint8_t j0[16];
+        gcm.pre_counter(iv, iv_len, j0);
+        parallel_gcm_crypt<false>(pool, gcm, j0, aad, aad_len, in, out, len, tag, cfg);
+    }
+
+    // out is cleared when the tag does not match
+    template <class GCM>
+    bool parallel_open(thread_pool& pool, const GCM& gcm,
+                       const std::uint8_t* iv, std::size_t iv_len,
+                       const std::uint8_t* aad, std::size_t aad_len,
+                       const std::uint8_t* in, std::uint8_t* out, std::size_t len,
+                       const std::uint8_t tag[16], const parallel_config& cfg = {}) {
+        if (len < cfg.threshold)
+            return gcm.open(iv, iv_len, aad, aad_len, in, out, len, tag);
+
+        std::uint8_t j0[16], expected[16];
+        gcm.pre_counter(iv, iv_len, j0);
+        parallel_gcm_crypt<true>(pool, gcm, j0, aad, aad_len, in, out, len, expected, cfg);
+
+        std::uint8_t diff = 0;
+        for (int i = 0; i < 16; i++)
+            diff |= expected[i] ^ tag[i];
+        if (diff != 0) {
+            std::memset(out, 0, len);
+            return false;
+        }
+        return true;
+    }
+
+    inline void parallel_check_blocks(std::size_t in_size, std::size_t out_size) {
+        if (in_size % 16 != 0)
+            throw std::invalid_argument("cheap_aes: input is not a multiple of the block size");
+        if (out_size < in_size)
+            throw std::invalid_argument("cheap_aes: output is shorter than input");
+    }
+
+    template <class AES>
+    void parallel_encrypt_blocks(thread_pool& pool, const AES& aes,
+                                 std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                                 const parallel_config& cfg = {}) {
+        parallel_check_blocks(in.size(), out.size());
+        parallel_encrypt_blocks(pool, aes, in.data(), out.data(), in.size() / 16, cfg);
+    }
+
+    template <class AES>
+    void parallel_decrypt_blocks(thread_pool& pool, const AES& aes,
+                                 std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                                 const parallel_config& cfg = {}) {
+        parallel_check_blocks(in.size(), out.size());
+        parallel_decrypt_blocks(pool, aes, in.data(), out.data(), in.size() / 16, cfg);
+    }
+
+    template <ctr_inc Inc = ctr_inc::be128, class AES>
+    void parallel_ctr_crypt(thread_pool& pool, const AES& aes, typename AES::block_array& counter,
+                            std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                            const parallel_config& cfg = {}) {
+        if (out.size() < in.size())
+            throw std::invalid_argument("cheap_aes: output is shorter than input");
+        parallel_ctr_crypt<Inc>(pool, aes, counter.data(), in.data(), out.data(), in.size(), cfg);
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+namespace cheap_aes
+{
+    // Scatter-gather lists: a message as a chain of fragments, in order.
+    // The modes take an input and an output list, or one list to work in place.
+    using sg_list = std::span<const std::span<std::uint8_t>>;
+    using sg_const_list = std::span<const std::span<const std::uint8_t>>;
+
+    // A read or write position in a fragment list. Empty fragments are skipped.
+    template <class T>
+    class sg_cursor
+    {
+    private:
+        std::span<const std::span<T>> frags;
+        std::size_t i = 0;
+        std::size_t off = 0;
+
+    public:
+        explicit sg_cursor(std::span<const std::span<T>> frags) : frags(frags) {
+            skip_empty();
+        }
+
+        // the bytes from here to the end of the list
+        std::size_t size() const {
+            std::size_t n = 0;
+            for (auto j = i; j < frags.size(); j++)
+                n += frags[j].size();
+            return n - off;
+        }
+
+        // the bytes from here to the end of the fragment
+        std::size_t contiguous() const {
+            return i < frags.size() ? frags[i].size() - off : 0;
+        }
+
+        T* data() const {
+            return frags[i].data() + off;
+        }
+
+        // n is at most contiguous()
+        void advance(std::size_t n) {
+            off += n;
+            skip_empty();
+        }
+
+        // copies n bytes out of the list, across fragment ends
+        void read(std::uint8_t* p, std::size_t n) {
+            while (n > 0) {
+                const auto m = std::min(n, contiguous());
+                std::memcpy(p, data(), m);
+                advance(m);
+                p += m;
+                n -= m;
+            }
+        }
+
+        void write(const std::uint8_t* p, std::size_t n) requires (!std::is_const_v<T>) {
+            while (n > 0) {
+                const auto m = std::min(n, contiguous());
+                std::memcpy(data(), p, m);
+                advance(m);
+                p += m;
+                n -= m;
+            }
+        }
+
+        void fill(std::uint8_t x, std::size_t n) requires (!std::is_const_v<T>) {
+            while (n > 0) {
+                const auto m = std::min(n, contiguous());
+                std::memset(data(), x, m);
+                advance(m);
+                n -= m;
+            }
+        }
+
+    private:
+        void skip_empty() {
+            while (i < frags.size() && off == frags[i].size()) {
+                i++;
+                off = 0;
+            }
+        }
+    };
+
+    // Walks an input and an output list in step, for len bytes. Runs of
+    // whole blocks that are contiguous on both sides go to run(in, out, n)
+    // as they are; a block across fragment ends (or a partial last one)
+    // is gathered into one block, given to run(b, b, m) and scattered back.
+    template <class In, class F>
+    void sg_blocks(sg_cursor<In>& in, sg_cursor<std::uint8_t>& out, std::size_t len, F&& run) {
+        while (len > 0) {
+            const auto n = std::min({in.contiguous(), out.contiguous(), len}) / 16 * 16;
+            if (n > 0) {
+                run(in.data(), out.data(), n);
+                in.advance(n);
+                out.advance(n);
+                len -= n;
+            } else {
+                const auto m = std::min<std::size_t>(len, 16);
+                alignas(16) std::uint8_t b[16];
+                in.read(b, m);
+                run(b, b, m);
+                out.write(b, m);
+                len -= m;
+            }
+        }
+    }
+
+    inline void sg_check(std::size_t in_size, std::size_t out_size) {
+        if (out_size < in_size)
+            throw std::invalid_argument("cheap_aes: output is shorter than input");
+    }
+}
@@ -0,0 +1,171 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include "aes_cbc_x86.hpp"
+#include "aes_ctr_x86.hpp"
+#include "aes_gcm_x86.hpp"
+
+using namespace cheap_aes::x86;
+using cheap_aes::sg_list;
+using cheap_aes::sg_const_list;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+std::vector<std::uint8_t> make_text(std::size_t len)
+{
+    std::vector<std::uint8_t> text(len);
+    for (std::size_t i = 0; i < len; i++)
+        text[i] = i * 13 + (i >> 8);
+    return text;
+}
+
+// cuts buf into fragments of the given sizes repeated, with empty ones in between
+template <class T>
+std::vector<std::span<T>> cut(std::span<T> buf, std::initializer_list<std::size_t> sizes)
+{
+    std::vector<std::span<T>> frags;
+    for (std::size_t off = 0; off < buf.size();) {
+        for (auto n : sizes) {
+            n = std::min(n, buf.size() - off);
+            frags.push_back(buf.subspan(off, n));
+            off += n;
+        }
+    }
+    frags.push_back(buf.subspan(buf.size()));
+    return frags;
+}
+
+struct layout
+{
+    std::initializer_list<std::size_t> in, out;
+};
+
+const layout layouts[] = {
+    {{1000}, {1000}},
+    {{16}, {16}},
+    {{7, 0, 30, 200}, {64, 1}},
+    {{1}, {3, 160, 0, 15}},
+    {{128, 5, 123}, {256}},
+};
+
+// every layout out of place, then in place over the input's fragments;
+// crypt gets the lists to hand on to the mode
+template <class F, class G>
+void each_layout(std::size_t len, F&& reference, G&& crypt)
+{
+    const auto text = make_text(len);
+    std::vector<std::uint8_t> ref(len);
+    reference(text, ref);
+
+    for (auto& l : layouts) {
+        std::vector<std::uint8_t> in = text, out(len);
+        const auto src = cut(std::span<const std::uint8_t>(in), l.in);
+        const auto dst = cut(std::span<std::uint8_t>(out), l.out);
+        crypt(sg_const_list(src), sg_list(dst));
+        runtime_assert(out == ref);
+
+        const auto buf = cut(std::span<std::uint8_t>(in), l.in);
+        crypt(sg_list(buf));
+        runtime_assert(in == ref);
+    }
+}
+
+void test_sg_ctr_x86()
+{
+    aes128 aes(aes128::key_array{1, 2, 3});
+    for (std::size_t len : {0, 1, 15, 16, 17, 200, 1000, 4099}) {
+        aes128::block_array c0;
+        c0.fill(0xff);
+        c0[0] = 1;
+        aes128::block_array c_ref = c0;
+        each_layout(len, [&](auto& text, auto& ref) { ctr_crypt<ctr_inc::be32>(aes, c_ref, text, ref); },
+            [&](auto... lists) {
+                auto c = c0;
+                ctr_crypt<ctr_inc::be32>(aes, c, lists...);
+                runtime_assert(c == c_ref);
+            });
+    }
+}
+
+void test_sg_cbc_x86()
+{
+    aes192 aes(aes192::key_array{4, 5, 6});
+    for (std::size_t len : {0, 16, 32, 208, 1008, 4096}) {
+        const aes192::block_array iv0{9, 8, 7};
+        for (bool decrypt : {false, true}) {
+            auto iv_ref = iv0;
+            each_layout(len, [&](auto& text, auto& ref) {
+                    if (decrypt)
+                        cbc_decrypt(aes, iv_ref, text, ref);
+                    else
+                        cbc_encrypt(aes, iv_ref, text, ref);
+                },
+                [&](auto... lists) {
+                    auto iv = iv0;
+                    if (decrypt)
+                        cbc_decrypt(aes, iv, lists...);
+                    else
+                        cbc_encrypt(aes, iv, lists...);
+                    runtime_assert(iv == iv_ref);
+                });
+        }
+    }
+
+    std::uint8_t buf[40];
+    auto frags = cut(std::span<std::uint8_t>(buf), {7});
+    aes192::block_array iv{};
+    bool thrown = false;
+    try {
+        cbc_encrypt(aes, iv, frags);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    runtime_assert(thrown);
+}
+
+void test_sg_gcm_x86()
+{
+    gcm256 gcm(gcm256::key_array{9, 8, 7});
+    const auto aad = make_text(20);
+    const auto iv = make_text(12);
+    for (std::size_t len : {0, 1, 16, 17, 127, 128, 129, 1000, 4099}) {
+        gcm256::tag_array ref_tag;
+        each_layout(len, [&](auto& text, auto& ref) { gcm.seal(iv, aad, text, ref, ref_tag); },
+            [&](auto... lists) {
+                gcm256::tag_array tag;
+                gcm.seal(iv, aad, lists..., tag);
+                runtime_assert(tag == ref_tag);
+            });
+
+        // and back, with a bad tag clearing every output fragment
+        const auto text = make_text(len);
+        std::vector<std::uint8_t> enc(len);
+        gcm.seal(iv, aad, text, enc, ref_tag);
+        for (auto& l : layouts) {
+            auto buf = enc;
+            const auto frags = cut(std::span<std::uint8_t>(buf), l.in);
+            runtime_assert(gcm.open(iv, aad, sg_list(frags), ref_tag));
+            runtime_assert(buf == text);
+
+            std::vector<std::uint8_t> out(len, 0x55);
+            const auto src = cut(std::span<const std::uint8_t>(enc), l.in);
+            const auto dst = cut(std::span<std::uint8_t>(out), l.out);
+            auto bad = ref_tag;
+            bad[3] ^= 0x10;
+            runtime_assert(!gcm.open(iv, aad, sg_const_list(src), sg_list(dst), bad));
+            runtime_assert(std::ranges::all_of(out, [](auto x) { return x == 0; }));
+        }
+    }
+}
+
+int main()
+{
+    test_sg_ctr_x86();
+    test_sg_cbc_x86();
+    test_sg_gcm_x86();
+}
@@ -0,0 +1,21 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <array>
+#include <cstddef>
+#include "aes.hpp"
+
+namespace cheap_aes
+{
+    template <std::size_t KeySize> struct aes_of_key_size;
+    template <> struct aes_of_key_size<16> { using type = aes128; };
+    template <> struct aes_of_key_size<24> { using type = aes192; };
+    template <> struct aes_of_key_size<32> { using type = aes256; };
+
+    // A fixed key expanded by the compiler. Both schedules are constant
+    // initialized into read-only data, so there is no key setup at run time.
+    //   constexpr auto& aes = static_aes<0x000102030405060708090a0b0c0d0e0f_bytes>;
+    template <std::array Key>
+    inline constexpr typename aes_of_key_size<Key.size()>::type static_aes(Key);
+}
@@ -0,0 +1,20 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <array>
+#include "aes_static.hpp"
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    template <int Nk, int Nb, int Nr>
+    constexpr aes_base<Nk, Nb, Nr> from_schedule(const cheap_aes::aes_base<Nk, Nb, Nr>& aes) {
+        return aes_base<Nk, Nb, Nr>(aes.round_keys(), aes.inv_round_keys());
+    }
+
+    // cheap_aes::static_aes for AES-NI: the aesenc and aesdec (aesimc'd)
+    // schedules are baked as aligned __m128i, nothing is expanded at run time
+    template <std::array Key>
+    inline constexpr auto static_aes = from_schedule(cheap_aes::static_aes<Key>);
+}
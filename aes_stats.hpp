@@ -0,0 +1,236 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// The policies live in a namespace of their own: as a template argument
+// of x86::aes_base, cheap_aes itself would become an associated namespace
+// and its portable mode functions would compete with the x86 ones.
+namespace cheap_aes::stats
+{
+    // What a counting policy has seen, summed over all threads.
+    struct stats_snapshot
+    {
+        std::uint64_t blocks = 0;        // block cipher invocations
+        std::uint64_t bytes = 0;         // bytes through bulk calls
+        std::uint64_t calls = 0;         // bulk calls, nested ones are not counted again
+        std::uint64_t key_setups = 0;
+        std::uint64_t inv_schedules = 0; // decryption schedules derived from the encryption one
+
+        // bulk call latency: cycles[i] counts calls of [2^(i-1), 2^i) ticks,
+        // all zero unless the policy keeps a histogram
+        std::array<std::uint64_t, 64> cycles{};
+
+        stats_snapshot& operator-=(const stats_snapshot& s) {
+            blocks -= s.blocks;
+            bytes -= s.bytes;
+            calls -= s.calls;
+            key_setups -= s.key_setups;
+            inv_schedules -= s.inv_schedules;
+            for (std::size_t i = 0; i < cycles.size(); i++)
+                cycles[i] -= s.cycles[i];
+            return *this;
+        }
+
+        friend stats_snapshot operator-(stats_snapshot a, const stats_snapshot& b) {
+            return a -= b;
+        }
+    };
+
+    // The default policy: every hook is empty and compiles away.
+    struct no_stats
+    {
+        static constexpr void blocks(std::size_t) {}
+        static constexpr void key_setup() {}
+        static constexpr void inv_schedule() {}
+
+        // scope of one bulk call over len bytes
+        struct call
+        {
+            constexpr explicit call(std::size_t) {}
+        };
+    };
+
+    // Counts into per-thread, cache-line sized slots that only their own
+    // thread writes, so the hot path is a plain load and store. Tag keeps
+    // the counters of different users apart; Latency adds an rdtsc pair per
+    // outermost bulk call and a log2 histogram of its cycles.
+    template <class Tag = void, bool Latency = false>
+    class counting_stats
+    {
+    private:
+        struct alignas(64) slot
+        {
+            std::atomic<std::uint64_t> blocks{}, bytes{}, calls{}, key_setups{}, inv_schedules{};
+            std::atomic<std::uint64_t> cycles[Latency ? 64 : 1]{};
+            unsigned depth = 0;
+        };
+
+        struct registry
+        {
+            std::mutex m;
+            std::vector<const slot*> live;
+            stats_snapshot retired;
+        };
+
+        // registers the thread's slot and folds it into retired on thread exit
+        struct holder
+        {
+            slot s;
+
+            holder() {
+                auto& r = reg();
+                std::lock_guard lock(r.m);
+                r.live.push_back(&s);
+            }
+
+            ~holder() {
+                auto& r = reg();
+                std::lock_guard lock(r.m);
+                add(r.retired, s);
+                std::erase(r.live, &s);
+            }
+        };
+
+    public:
+        static constexpr void blocks(std::size_t n) {
+            if (!std::is_constant_evaluated())
+                bump(local().blocks, n);
+        }
+
+        static constexpr void key_setup() {
+            if (!std::is_constant_evaluated())
+                bump(local().key_setups, 1);
+        }
+
+        static constexpr void inv_schedule() {
+            if (!std::is_constant_evaluated())
+                bump(local().inv_schedules, 1);
+        }
+
+        class call
+        {
+        private:
+            slot* s = nullptr;
+            std::uint64_t start = 0;
+
+        public:
+            constexpr explicit call(std::size_t len) {
+                if (!std::is_constant_evaluated())
+                    enter(len);
+            }
+
+            call(const call&) = delete;
+            call& operator=(const call&) = delete;
+
+            constexpr ~call() {
+                if (s)
+                    leave();
+            }
+
+        private:
+            void enter(std::size_t len) {
+                s = &local();
+                if (s->depth++ > 0)
+                    return;
+                bump(s->bytes, len);
+                bump(s->calls, 1);
+                if constexpr (Latency)
+                    start = ticks();
+            }
+
+            void leave() {
+                if (--s->depth > 0)
+                    return;
+                if constexpr (Latency)
+                    bump(s->cycles[std::min<std::uint64_t>(std::bit_width(ticks() - start), 63)], 1);
+            }
+        };
+
+        // the counters so far, for an exporter to scrape from any thread
+        static stats_snapshot snapshot() {
+            auto& r = reg();
+            std::lock_guard lock(r.m);
+            auto total = r.retired;
+            for (auto s : r.live)
+                add(total, *s);
+            return total;
+        }
+
+    private:
+        static registry& reg() {
+            static registry r;
+            return r;
+        }
+
+        static slot& local() {
+            thread_local holder h;
+            return h.s;
+        }
+
+        // single writer, so no locked read-modify-write is needed
+        static void bump(std::atomic<std::uint64_t>& a, std::uint64_t n) {
+            a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        static void add(stats_snapshot& total, const slot& s) {
+            total.blocks += s.blocks.load(std::memory_order_relaxed);
+            total.bytes += s.bytes.load(std::memory_order_relaxed);
+            total.calls += s.calls.load(std::memory_order_relaxed);
+            total.key_setups += s.key_setups.load(std::memory_order_relaxed);
+            total.inv_schedules += s.inv_schedules.load(std::memory_order_relaxed);
+            if constexpr (Latency) {
+                for (std::size_t i = 0; i < total.cycles.size(); i++)
+                    total.cycles[i] += s.cycles[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        static std::uint64_t ticks() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+        }
+    };
+
+}
+
+namespace cheap_aes
+{
+    using stats::stats_snapshot;
+    using stats::no_stats;
+    using stats::counting_stats;
+
+    // the policy of a cipher type, no_stats for backends without one
+    template <class AES>
+    struct stats_of
+    {
+        using type = no_stats;
+    };
+
+    template <class AES>
+        requires requires { typename AES::stats_type; }
+    struct stats_of<AES>
+    {
+        using type = typename AES::stats_type;
+    };
+
+    template <class AES>
+    using stats_t = typename stats_of<AES>::type;
+}
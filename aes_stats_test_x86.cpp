@@ -0,0 +1,163 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <array>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "aes.hpp"
+#include "aes_ctr.hpp"
+#include "aes_gcm.hpp"
+#include "aes_stats.hpp"
+#include "aes_cbc_x86.hpp"
+#include "aes_ctr_x86.hpp"
+#include "aes_gcm_x86.hpp"
+#include "aes_x86.hpp"
+#include "aes_xts_x86.hpp"
+
+using namespace cheap_aes;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+struct portable_tag {};
+struct x86_tag {};
+struct thread_tag {};
+struct latency_tag {};
+
+using soft_stats = counting_stats<portable_tag>;
+using soft128 = aes_base<4, 4, 10, soft_stats>;
+
+using hard_stats = counting_stats<x86_tag>;
+using hard128 = x86::aes_base<4, 4, 10, x86::key_dir::both, hard_stats>;
+using hard128_enc = x86::aes_base<4, 4, 10, x86::key_dir::encrypt, hard_stats>;
+
+// the default policy adds nothing, and counting still works at compile time
+static_assert(sizeof(x86::aes_base<4, 4, 10, x86::key_dir::both, no_stats>) == sizeof(x86::aes128));
+static_assert(sizeof(hard128) == sizeof(x86::aes128));
+static_assert(std::is_same_v<stats_t<x86::aes128>, no_stats>);
+static_assert(std::is_same_v<stats_t<hard128>, hard_stats>);
+static_assert(soft128(soft128::key_array{1}).encrypt(soft128::block_array{2}) ==
+              aes128(aes128::key_array{1}).encrypt(aes128::block_array{2}));
+
+void test_stats_portable()
+{
+    const auto before = soft_stats::snapshot();
+
+    soft128 aes(soft128::key_array{1, 2, 3});
+    std::vector<std::uint8_t> buf(16*10 + 5);
+    aes.encrypt_blocks(buf.data(), buf.data(), 10);
+    aes.decrypt_blocks(buf.data(), buf.data(), 10);
+    soft128::block_array counter{};
+    ctr_crypt(aes, counter, buf, buf);
+
+    gcm_base<soft128> gcm(soft128::key_array{4});
+    std::uint8_t iv[12] = {}, tag[16];
+    gcm.seal(iv, 12, nullptr, 0, buf.data(), buf.data(), 40, tag);
+
+    const auto d = soft_stats::snapshot() - before;
+    runtime_assert(d.key_setups == 2);
+    runtime_assert(d.inv_schedules == 2);
+    // ECB 10 + 10, CTR 11, GCM hash key 1, 3 keystream blocks, tag 1
+    runtime_assert(d.blocks == 20 + 11 + 1 + 3 + 1);
+    // ctr_crypt's inner encrypt_blocks calls are not counted again
+    runtime_assert(d.calls == 4);
+    runtime_assert(d.bytes == 160 + 160 + buf.size() + 40);
+    runtime_assert(d.cycles == stats_snapshot().cycles);
+}
+
+void test_stats_x86()
+{
+    const auto before = hard_stats::snapshot();
+
+    hard128 aes(hard128::key_array{1, 2, 3});
+    hard128_enc enc(hard128::key_array{1, 2, 3});
+    std::vector<std::uint8_t> buf(16*20), ref(buf.size());
+
+    // an encrypt-only context derives the inverse schedule for each decrypting call
+    aes.encrypt_blocks(buf.data(), ref.data(), 20);
+    enc.decrypt_blocks(ref.data(), buf.data(), 20);
+    enc.decrypt(&ref[0], &buf[0]);
+    auto dec = enc.inverse();
+    dec.decrypt_blocks(ref.data(), buf.data(), 20);
+
+    std::uint8_t iv[16] = {};
+    x86::cbc_encrypt(aes, iv, buf.data(), buf.data(), buf.size());
+    x86::ctr_crypt(aes, iv, buf.data(), buf.data(), 33);
+
+    auto d = hard_stats::snapshot() - before;
+    runtime_assert(d.key_setups == 2);
+    runtime_assert(d.inv_schedules == 1 + 3);
+    runtime_assert(d.blocks == 20 + 20 + 1 + 20 + 20 + 3);
+    runtime_assert(d.calls == 5);
+    runtime_assert(d.bytes == 4 * buf.size() + 33);
+
+    const auto mid = hard_stats::snapshot();
+    x86::gcm_base<hard128> gcm(hard128::key_array{5});
+    std::uint8_t tag[16];
+    gcm.seal(iv, 12, nullptr, 0, buf.data(), buf.data(), 100, tag);
+    runtime_assert(gcm.open(iv, 12, nullptr, 0, buf.data(), buf.data(), 100, tag));
+
+    x86::xts_base<hard128> xts(x86::xts_base<hard128>::key_array{6});
+    xts.encrypt_sectors(0, 64, buf.data(), buf.data(), buf.size());
+
+    d = hard_stats::snapshot() - mid;
+    runtime_assert(d.key_setups == 1 + 2);
+    runtime_assert(d.calls == 3);
+    runtime_assert(d.bytes == 100 + 100 + buf.size());
+}
+
+// slots of running threads are read live, those of finished ones are kept
+void test_stats_threads()
+{
+    using stats = counting_stats<thread_tag>;
+    using aes = x86::aes_base<4, 4, 10, x86::key_dir::encrypt, stats>;
+    constexpr int nthreads = 4;
+
+    const auto before = stats::snapshot();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; t++) {
+        threads.emplace_back([t] {
+            aes a(aes::key_array{(std::uint8_t)t});
+            std::vector<std::uint8_t> buf(16 * (t + 1));
+            for (int i = 0; i < 100; i++)
+                a.encrypt_blocks(buf.data(), buf.data(), t + 1);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    aes a(aes::key_array{});
+    const auto d = stats::snapshot() - before;
+    runtime_assert(d.key_setups == nthreads + 1);
+    runtime_assert(d.inv_schedules == 0);
+    runtime_assert(d.calls == 100 * nthreads);
+    runtime_assert(d.blocks == 100 * (1 + 2 + 3 + 4));
+    runtime_assert(d.bytes == 16 * d.blocks);
+}
+
+void test_stats_latency()
+{
+    using stats = counting_stats<latency_tag, true>;
+    using aes = x86::aes_base<4, 4, 10, x86::key_dir::both, stats>;
+
+    aes a(aes::key_array{7});
+    std::vector<std::uint8_t> buf(4096);
+    aes::block_array counter{};
+    for (int i = 0; i < 50; i++)
+        x86::ctr_crypt(a, counter, buf, buf);
+
+    const auto s = stats::snapshot();
+    runtime_assert(s.calls == 50);
+    runtime_assert(std::accumulate(s.cycles.begin(), s.cycles.end(), std::uint64_t(0)) == 50);
+    // 256 blocks take more than a handful of ticks
+    runtime_assert(std::accumulate(s.cycles.begin(), s.cycles.begin() + 5, std::uint64_t(0)) == 0);
+}
+
+int main()
+{
+    test_stats_portable();
+    test_stats_x86();
+    test_stats_threads();
+    test_stats_latency();
+}
@@ -1,12 +1,20 @@
 // The MIT License
 // Copyright 2023 funanz <granz.fisherman@gmail.com>
 // https://opensource.org/licenses/MIT
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <bytes_literals.hpp>
 #include "aes.hpp"
+#include "aes_ctr.hpp"
+#include "aes_gcm.hpp"
+#include "aes_static.hpp"
 
 using namespace cheap_aes;
 using namespace bytes_literals;
 
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
 void test_aes128()
 {
     constexpr auto key = 0x000102030405060708090a0b0c0d0e0f_bytes;
@@ -40,9 +48,185 @@ void test_aes256()
     static_assert(dec == text);
 }
 
+void test_blocks()
+{
+    constexpr aes128 aes(0x000102030405060708090a0b0c0d0e0f_bytes);
+    constexpr auto text = 0x00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff_bytes;
+    constexpr auto enc = [&] {
+        std::array<std::uint8_t, 32> out;
+        aes.encrypt_blocks(text, out);
+        return out;
+    }();
+    static_assert(enc == 0x69c4e0d86a7b0430d8cdb78070b4c55a69c4e0d86a7b0430d8cdb78070b4c55a_bytes);
+    constexpr auto dec = [&] {
+        std::array<std::uint8_t, 32> out;
+        aes.decrypt_blocks(enc.data(), out.data(), 2);
+        return out;
+    }();
+    static_assert(dec == text);
+}
+
+template <class AES, std::size_t N>
+constexpr auto encrypt_blocks(const typename AES::key_array& key, const std::array<std::uint8_t, N>& text)
+{
+    AES aes(key);
+    std::array<std::uint8_t, N> out;
+    aes.encrypt_blocks(text, out);
+    return out;
+}
+
+// the T-table path taken at run time against the byte-wise constexpr path
+template <class AES>
+void test_runtime()
+{
+    constexpr auto key = [] {
+        typename AES::key_array key;
+        for (std::size_t i = 0; i < key.size(); i++)
+            key[i] = i * 3 + 1;
+        return key;
+    }();
+    constexpr auto text = [] {
+        std::array<std::uint8_t, 16*64> text;
+        for (std::size_t i = 0; i < text.size(); i++)
+            text[i] = i * 7 + 1;
+        return text;
+    }();
+    constexpr auto expected = encrypt_blocks<AES>(key, text);
+
+    AES aes(key);
+    std::array<std::uint8_t, text.size()> enc;
+    aes.encrypt_blocks(text, enc);
+    runtime_assert(enc == expected);
+
+    std::array<std::uint8_t, text.size()> dec;
+    aes.decrypt_blocks(enc, dec);
+    runtime_assert(dec == text);
+}
+
+void test_static()
+{
+    constexpr auto& aes = static_aes<0x000102030405060708090a0b0c0d0e0f_bytes>;
+    static_assert(std::is_same_v<decltype(aes), const aes128&>);
+    static_assert(aes.encrypt(0x00112233445566778899aabbccddeeff_bytes) == 0x69c4e0d86a7b0430d8cdb78070b4c55a_bytes);
+    static_assert(aes.decrypt(0x69c4e0d86a7b0430d8cdb78070b4c55a_bytes) == 0x00112233445566778899aabbccddeeff_bytes);
+
+    constexpr auto& aes256 = static_aes<0x000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f_bytes>;
+    static_assert(aes256.encrypt(0x00112233445566778899aabbccddeeff_bytes) == 0x8ea2b7ca516745bfeafc49904b496089_bytes);
+}
+
+// NIST SP 800-38A F.5.1, with a 32-bit counter that wraps
+void test_ctr()
+{
+    constexpr aes128 aes(0x2b7e151628aed2a6abf7158809cf4f3c_bytes);
+    constexpr auto text = 0x6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e5130c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710_bytes;
+    constexpr auto enc = [&] {
+        auto ctr = 0xf0f1f2f3f4f5f6f7f8f9fafbfcfdfeff_bytes;
+        std::array<std::uint8_t, text.size()> out;
+        ctr_crypt(aes, ctr, text, out);
+        return std::pair(out, ctr);
+    }();
+    static_assert(enc.first == 0x874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee_bytes);
+    static_assert(enc.second == 0xf0f1f2f3f4f5f6f7f8f9fafbfcfdff03_bytes);
+
+    constexpr auto wrap = [&] {
+        auto ctr = 0x0000000000000000000000ffffffffff_bytes;
+        std::array<std::uint8_t, 20> out{};
+        ctr_crypt<ctr_inc::be32>(aes, &ctr[0], out.data(), out.data(), out.size());
+        return ctr;
+    }();
+    static_assert(wrap == 0x0000000000000000000000ff00000001_bytes);
+}
+
+// The Galois/Counter Mode of Operation (GCM), test cases 2 and 3
+void test_ghash()
+{
+    constexpr ghash gh(0x66e94bd4ef8a2c3b884cfa59ca342b2e_bytes);
+    constexpr auto c = 0x0388dace60b6a392f328c2b971b2fe78_bytes;
+    static_assert(gh.digest({}, c) == 0xf38cbb1ad69223dcc3457ae5b6b0f885_bytes);
+
+    constexpr ghash gh3(0xb83b533708bf535d0aa6e52980d53b78_bytes);
+    constexpr auto c3 = 0x42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985_bytes;
+    static_assert(gh3.digest({}, c3) == 0x7f1b32b81b820d02614f8895ac1d4eac_bytes);
+}
+
+template <class GCM, std::size_t N>
+constexpr auto gcm_seal(const GCM& gcm, std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                        const std::array<std::uint8_t, N>& text)
+{
+    std::pair<std::array<std::uint8_t, N>, typename GCM::tag_array> r;
+    gcm.seal(iv, aad, text, r.first, r.second);
+    return r;
+}
+
+template <class GCM, std::size_t N>
+constexpr auto gcm_open(const GCM& gcm, std::span<const std::uint8_t> iv, std::span<const std::uint8_t> aad,
+                        const std::array<std::uint8_t, N>& enc, const typename GCM::tag_array& tag)
+{
+    std::pair<std::array<std::uint8_t, N>, bool> r;
+    r.second = gcm.open(iv, aad, enc, r.first, tag);
+    return r;
+}
+
+constexpr auto gcm_key = 0xfeffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308_bytes;
+constexpr auto gcm_iv = 0xcafebabefacedbaddecaf888_bytes;
+constexpr auto gcm_aad = 0xfeedfacedeadbeeffeedfacedeadbeefabaddad2_bytes;
+constexpr auto gcm_text = 0xd9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39_bytes;
+
+void test_gcm128()
+{
+    constexpr gcm128 gcm0(aes128::key_array{});
+    constexpr auto empty = gcm_seal(gcm0, std::array<std::uint8_t, 12>{}, {}, std::array<std::uint8_t, 0>{});
+    static_assert(empty.second == 0x58e2fccefa7e3061367f1d57a4e7455a_bytes);
+
+    constexpr gcm128 gcm(0xfeffe9928665731c6d6a8f9467308308_bytes);
+    constexpr auto enc = gcm_seal(gcm, gcm_iv, gcm_aad, gcm_text);
+    static_assert(enc.first == 0x42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091_bytes);
+    static_assert(enc.second == 0x5bc94fbc3221a5db94fae95ae7121a47_bytes);
+    constexpr auto dec = gcm_open(gcm, gcm_iv, gcm_aad, enc.first, enc.second);
+    static_assert(dec.second && dec.first == gcm_text);
+    constexpr auto bad = gcm_open(gcm, gcm_iv, {}, enc.first, enc.second);
+    static_assert(!bad.second);
+
+    // 64-bit and 480-bit IVs
+    constexpr auto enc8 = gcm_seal(gcm, 0xcafebabefacedbad_bytes, gcm_aad, gcm_text);
+    static_assert(enc8.first == 0x61353b4c2806934a777ff51fa22a4755699b2a714fcdc6f83766e5f97b6c742373806900e49f24b22b097544d4896b424989b5e1ebac0f07c23f4598_bytes);
+    static_assert(enc8.second == 0x3612d2e79e3b0785561be14aaca2fccb_bytes);
+    constexpr auto enc60 = gcm_seal(gcm, 0x9313225df88406e555909c5aff5269aa6a7a9538534f7da1e4c303d2a318a728c3c0c95156809539fcf0e2429a6b525416aedbf5a0de6a57a637b39b_bytes, gcm_aad, gcm_text);
+    static_assert(enc60.first == 0x8ce24998625615b603a033aca13fb894be9112a5c3a211a8ba262a3cca7e2ca701e4a9a4fba43c90ccdcb281d48c7c6fd62875d2aca417034c34aee5_bytes);
+    static_assert(enc60.second == 0x619cc5aefffe0bfa462af43c1699d050_bytes);
+}
+
+void test_gcm192()
+{
+    constexpr gcm192 gcm(0xfeffe9928665731c6d6a8f9467308308feffe9928665731c_bytes);
+    constexpr auto enc = gcm_seal(gcm, gcm_iv, gcm_aad, gcm_text);
+    static_assert(enc.first == 0x3980ca0b3c00e841eb06fac4872a2757859e1ceaa6efd984628593b40ca1e19c7d773d00c144c525ac619d18c84a3f4718e2448b2fe324d9ccda2710_bytes);
+    static_assert(enc.second == 0x2519498e80f1478f37ba55bd6d27618c_bytes);
+}
+
+void test_gcm256()
+{
+    constexpr gcm256 gcm(gcm_key);
+    constexpr auto enc = gcm_seal(gcm, gcm_iv, gcm_aad, gcm_text);
+    static_assert(enc.first == 0x522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662_bytes);
+    static_assert(enc.second == 0x76fc6ece0f4e1768cddf8853bb2d551b_bytes);
+    constexpr auto dec = gcm_open(gcm, gcm_iv, gcm_aad, enc.first, enc.second);
+    static_assert(dec.second && dec.first == gcm_text);
+}
+
 int main()
 {
     test_aes128();
     test_aes192();
     test_aes256();
+    test_blocks();
+    test_runtime<aes128>();
+    test_runtime<aes192>();
+    test_runtime<aes256>();
+    test_static();
+    test_ctr();
+    test_ghash();
+    test_gcm128();
+    test_gcm192();
+    test_gcm256();
 }
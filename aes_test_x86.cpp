@@ -1,9 +1,13 @@
 // The MIT License
 // Copyright 2023 funanz <granz.fisherman@gmail.com>
 // https://opensource.org/licenses/MIT
+#include <cstring>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 #include <bytes_literals.hpp>
 #include "aes_x86.hpp"
+#include "aes_static_x86.hpp"
 
 using namespace cheap_aes::x86;
 using namespace bytes_literals;
@@ -43,9 +47,182 @@ void test_aes256_x86()
     runtime_assert(dec == text);
 }
 
+template <class AES>
+void test_blocks_x86(const typename AES::key_array& key)
+{
+    AES aes(key);
+    for (std::size_t n : {0, 1, 3, 4, 7, 8, 15, 16, 21}) {
+        std::vector<std::uint8_t> text(n * 16);
+        for (std::size_t i = 0; i < text.size(); i++)
+            text[i] = i * 7 + 1;
+
+        std::vector<std::uint8_t> enc(text.size());
+        aes.encrypt_blocks(text, enc);
+        for (std::size_t i = 0; i < n; i++) {
+            std::uint8_t block[16];
+            aes.encrypt(&text[16*i], block);
+            runtime_assert(std::memcmp(block, &enc[16*i], 16) == 0);
+        }
+
+        std::vector<std::uint8_t> dec(text.size());
+        aes.decrypt_blocks(enc.data(), dec.data(), n);
+        runtime_assert(dec == text);
+
+        aes.encrypt_blocks(dec, dec);
+        runtime_assert(dec == enc);
+    }
+}
+
+// the baked schedules have to match the ones aeskeygenassist and aesimc produce
+template <auto Key, class AES>
+void test_static_x86(const typename AES::block_array& expected)
+{
+    const auto& aes = static_aes<Key>;
+    static_assert(std::is_same_v<decltype(aes), const AES&>);
+    AES ref(Key);
+    for (int i = 0; i <= (int)Key.size() / 4 + 6; i++) {
+        runtime_assert(std::memcmp(&aes.round_keys()[i], &ref.round_keys()[i], 16) == 0);
+        runtime_assert(std::memcmp(&aes.inv_round_keys()[i], &ref.inv_round_keys()[i], 16) == 0);
+    }
+
+    auto text = 0x00112233445566778899aabbccddeeff_bytes;
+    runtime_assert(aes.encrypt(text) == expected);
+    runtime_assert(aes.decrypt(expected) == text);
+}
+
+template <class AES>
+concept can_encrypt = requires(const AES& aes, typename AES::block_array b) { aes.encrypt(b); };
+
+template <class AES>
+concept keeps_inverse = requires(const AES& aes) { aes.inv_round_keys(); };
+
+// direction-specific contexts against the full one
+template <class AES, class Enc, class Dec>
+void test_key_dir_x86(const typename AES::key_array& key)
+{
+    static_assert(sizeof(Enc) < sizeof(AES) && sizeof(Dec) == sizeof(Enc));
+    static_assert(alignof(AES) == 64 && alignof(Enc) == 64 && alignof(Dec) == 64);
+    static_assert(can_encrypt<Enc> && !can_encrypt<Dec>);
+
+    AES aes(key);
+    Enc enc(key);
+    Dec dec(key);
+    const auto inv = enc.inverse();
+
+    std::vector<std::uint8_t> text(16*13), ref(text.size()), buf(text.size());
+    for (std::size_t i = 0; i < text.size(); i++)
+        text[i] = i * 7 + 1;
+
+    aes.encrypt_blocks(text, ref);
+    enc.encrypt_blocks(text, buf);
+    runtime_assert(buf == ref);
+
+    // the encrypt-only context decrypts with a schedule derived for the call
+    enc.decrypt_blocks(ref, buf);
+    runtime_assert(buf == text);
+    dec.decrypt_blocks(ref, buf);
+    runtime_assert(buf == text);
+    inv.decrypt_blocks(ref, buf);
+    runtime_assert(buf == text);
+
+    typename AES::block_array block;
+    std::memcpy(block.data(), ref.data(), 16);
+    runtime_assert(std::memcmp(enc.decrypt(block).data(), text.data(), 16) == 0);
+    for (int i = 0; i <= (int)key.size() / 4 + 6; i++) {
+        runtime_assert(std::memcmp(&dec.inv_round_keys()[i], &aes.inv_round_keys()[i], 16) == 0);
+        runtime_assert(std::memcmp(&inv.inv_round_keys()[i], &aes.inv_round_keys()[i], 16) == 0);
+    }
+}
+
+// batched key setup against one key at a time, schedule by schedule
+template <class AES>
+void test_set_keys_x86()
+{
+    constexpr int rounds = AES::key_size() / 4 + 7;
+    for (std::size_t count : {0, 1, 7, 8, 13, 19}) {
+        std::vector<typename AES::key_array> keys(count);
+        for (std::size_t n = 0; n < count; n++)
+            for (std::size_t i = 0; i < keys[n].size(); i++)
+                keys[n][i] = n * 37 + i * 11 + (i >> 2);
+
+        std::vector<AES> batch(count);
+        AES::set_keys(batch, keys);
+        for (std::size_t n = 0; n < count; n++) {
+            const AES one(keys[n]);
+            for (int i = 0; i < rounds; i++) {
+                if constexpr (can_encrypt<AES>)
+                    runtime_assert(std::memcmp(&batch[n].round_keys()[i], &one.round_keys()[i], 16) == 0);
+                if constexpr (keeps_inverse<AES>)
+                    runtime_assert(std::memcmp(&batch[n].inv_round_keys()[i], &one.inv_round_keys()[i], 16) == 0);
+            }
+        }
+    }
+
+    std::vector<AES> batch(3);
+    std::vector<typename AES::key_array> keys(2);
+    bool thrown = false;
+    try {
+        AES::set_keys(batch, keys);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    runtime_assert(thrown);
+}
+
+// non-temporal stores from every offset against a 64-byte line, the same
+// blocks as through the caches; an unaligned out falls back to those
+template <class AES>
+void test_streaming_x86()
+{
+    const AES aes(typename AES::key_array{1, 2, 3});
+    alignas(64) static std::uint8_t text[100 * 16 + 64], out[100 * 16 + 64];
+    for (std::size_t i = 0; i < sizeof(text); i++)
+        text[i] = i * 11 + 5;
+
+    for (std::size_t off : {0, 16, 32, 48, 3}) {
+        for (std::size_t n : {0, 1, 3, 4, 8, 11, 16, 37, 100}) {
+            std::vector<std::uint8_t> enc(n * 16), dec(n * 16);
+            aes.encrypt_blocks(text + off, enc.data(), n, store_hint::cached);
+            aes.decrypt_blocks(text + off, dec.data(), n, store_hint::cached);
+
+            aes.encrypt_blocks(text + off, out + off, n, store_hint::streaming);
+            runtime_assert(std::memcmp(out + off, enc.data(), n * 16) == 0);
+            aes.decrypt_blocks(text + off, out + off, n, store_hint::streaming);
+            runtime_assert(std::memcmp(out + off, dec.data(), n * 16) == 0);
+
+            // in place, and automatic above the threshold
+            std::memcpy(out + off, text + off, n * 16);
+            streaming_threshold = 64;
+            aes.encrypt_blocks(out + off, out + off, n);
+            streaming_threshold = std::size_t(32) << 20;
+            runtime_assert(std::memcmp(out + off, enc.data(), n * 16) == 0);
+        }
+    }
+}
+
 int main()
 {
     test_aes128_x86();
     test_aes192_x86();
     test_aes256_x86();
+    test_blocks_x86<aes128>(0x000102030405060708090a0b0c0d0e0f_bytes);
+    test_blocks_x86<aes192>(0x000102030405060708090a0b0c0d0e0f1011121314151617_bytes);
+    test_blocks_x86<aes256>(0x000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f_bytes);
+    test_static_x86<0x000102030405060708090a0b0c0d0e0f_bytes, aes128>(0x69c4e0d86a7b0430d8cdb78070b4c55a_bytes);
+    test_static_x86<0x000102030405060708090a0b0c0d0e0f1011121314151617_bytes, aes192>(0xdda97ca4864cdfe06eaf70a0ec0d7191_bytes);
+    test_static_x86<0x000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f_bytes, aes256>(0x8ea2b7ca516745bfeafc49904b496089_bytes);
+    test_key_dir_x86<aes128, aes128_enc, aes128_dec>(0x000102030405060708090a0b0c0d0e0f_bytes);
+    test_key_dir_x86<aes192, aes192_enc, aes192_dec>(0x000102030405060708090a0b0c0d0e0f1011121314151617_bytes);
+    test_key_dir_x86<aes256, aes256_enc, aes256_dec>(0x000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f_bytes);
+    test_set_keys_x86<aes128>();
+    test_set_keys_x86<aes192>();
+    test_set_keys_x86<aes256>();
+    test_set_keys_x86<aes128_enc>();
+    test_set_keys_x86<aes192_enc>();
+    test_set_keys_x86<aes256_enc>();
+    test_set_keys_x86<aes128_dec>();
+    test_set_keys_x86<aes192_dec>();
+    test_set_keys_x86<aes256_dec>();
+    test_streaming_x86<aes128>();
+    test_streaming_x86<aes256_enc>();
 }
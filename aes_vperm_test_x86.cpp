@@ -0,0 +1,78 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <stdexcept>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes.hpp"
+#include "aes_vperm_x86.hpp"
+
+using namespace cheap_aes::vperm;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+void test_aes128_vperm()
+{
+    aes128 aes(0x000102030405060708090a0b0c0d0e0f_bytes);
+    auto text = 0x00112233445566778899aabbccddeeff_bytes;
+    auto enc = aes.encrypt(text);
+    runtime_assert(enc == 0x69c4e0d86a7b0430d8cdb78070b4c55a_bytes);
+    runtime_assert(aes.decrypt(enc) == text);
+}
+
+void test_aes192_vperm()
+{
+    aes192 aes(0x000102030405060708090a0b0c0d0e0f1011121314151617_bytes);
+    auto text = 0x00112233445566778899aabbccddeeff_bytes;
+    auto enc = aes.encrypt(text);
+    runtime_assert(enc == 0xdda97ca4864cdfe06eaf70a0ec0d7191_bytes);
+    runtime_assert(aes.decrypt(enc) == text);
+}
+
+void test_aes256_vperm()
+{
+    aes256 aes(0x000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f_bytes);
+    auto text = 0x00112233445566778899aabbccddeeff_bytes;
+    auto enc = aes.encrypt(text);
+    runtime_assert(enc == 0x8ea2b7ca516745bfeafc49904b496089_bytes);
+    runtime_assert(aes.decrypt(enc) == text);
+}
+
+// all byte values through every round, and several key schedules,
+// against the table implementation
+template <class AES, class Ref>
+void test_blocks_vperm()
+{
+    for (int seed : {2, 0x80, 0xff, 0x3d}) {
+        typename AES::key_array key;
+        for (std::size_t i = 0; i < key.size(); i++)
+            key[i] = i * 5 + seed;
+        AES aes(key);
+        Ref ref(key);
+
+        for (std::size_t n : {1, 3, 4, 5, 16, 19}) {
+            std::vector<std::uint8_t> text(16*n);
+            for (std::size_t i = 0; i < text.size(); i++)
+                text[i] = i * 7 + 1;
+
+            std::vector<std::uint8_t> enc(text.size()), expected(text.size());
+            aes.encrypt_blocks(text, enc);
+            ref.encrypt_blocks(text, expected);
+            runtime_assert(enc == expected);
+
+            aes.decrypt_blocks(enc, enc);
+            runtime_assert(enc == text);
+        }
+    }
+}
+
+int main()
+{
+    test_aes128_vperm();
+    test_aes192_vperm();
+    test_aes256_vperm();
+    test_blocks_vperm<aes128, cheap_aes::aes128>();
+    test_blocks_vperm<aes192, cheap_aes::aes192>();
+    test_blocks_vperm<aes256, cheap_aes::aes256>();
+}
@@ -0,0 +1,409 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <tmmintrin.h>
+
+namespace cheap_aes::vperm
+{
+    // AES with SSSE3 only, for CPUs without AES-NI, after M. Hamburg,
+    // "Accelerating AES with Vector Permute Instructions".
+    // A byte x is written as i + k w over GF(16) = {x : x^16 = x} with
+    // w^2 + w = lambda, so that its inverse is a chain of 16-entry pshufb
+    // lookups on the nibbles i and k. No address depends on secret data,
+    // in the key schedule neither. Between rounds the state stays in that
+    // nibble basis.
+    template <int Nk, int Nb, int Nr>
+    class aes_base
+    {
+    public:
+        static constexpr int key_size() { return 4 * Nk; };
+        static constexpr int block_size() { return 4 * Nb; };
+        using key_array = std::array<std::uint8_t, key_size()>;
+        using block_array = std::array<std::uint8_t, block_size()>;
+
+    private:
+        __m128i ek[Nr+1];
+        __m128i dk[Nr+1];
+
+    public:
+        aes_base() {}
+
+        explicit aes_base(const std::uint8_t key[4*Nk]) {
+            set(key);
+        }
+
+        explicit aes_base(const key_array& key) {
+            set(&key[0]);
+        }
+
+        // The schedule is expanded with the same pshufb S-box as the rounds
+        // and moved into the nibble basis by pshufb, so no key byte is used
+        // as an index here either.
+        void set(const std::uint8_t key[4*Nk]) {
+            std::uint8_t w[16*(Nr+1)];
+            std::memcpy(w, key, 4*Nk);
+            std::uint8_t rcon = 1;
+            for (int i = Nk; i < 4*(Nr+1); i++) {
+                std::uint8_t t[4];
+                std::memcpy(t, &w[4*(i-1)], 4);
+                if (i % Nk == 0) {
+                    const std::uint8_t t0 = t[0];
+                    t[0] = t[1], t[1] = t[2], t[2] = t[3], t[3] = t0;
+                    sub_word(t);
+                    t[0] ^= rcon;
+                    rcon = (std::uint8_t)(rcon << 1 ^ (rcon & 0x80 ? 0x1b : 0));
+                } else if (Nk > 6 && i % Nk == 4) {
+                    sub_word(t);
+                }
+                for (int j = 0; j < 4; j++)
+                    w[4*i + j] = w[4*(i-Nk) + j] ^ t[j];
+            }
+
+            // the S-box constant is carried by the round keys
+            const auto c = _mm_set1_epi8(0x63);
+            const auto c5 = _mm_set1_epi8(tower(0x05));
+            for (int round = 0; round <= Nr; round++) {
+                const auto we = _mm_loadu_si128((const __m128i*)&w[16*round]);
+                const auto wd = _mm_loadu_si128((const __m128i*)&w[16*(Nr - round)]);
+                if (round == 0)
+                    ek[round] = transform(load(in_tower), we);
+                else if (round < Nr)
+                    ek[round] = transform(load(in_tower), _mm_xor_si128(we, c));
+                else
+                    ek[round] = _mm_xor_si128(we, c);
+
+                if (round == 0)
+                    dk[round] = _mm_xor_si128(transform(load(in_inv_tower), wd), c5);
+                else if (round < Nr)
+                    dk[round] = _mm_xor_si128(inv_mix_columns(wd), c5);
+                else
+                    dk[round] = wd;
+            }
+        }
+
+        void set(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void encrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
+            encrypt_blocks(in, out, 1);
+        }
+
+        void encrypt(const block_array& in, block_array& out) const {
+            encrypt_blocks(&in[0], &out[0], 1);
+        }
+
+        block_array encrypt(const block_array& in) const {
+            block_array out;
+            encrypt_blocks(&in[0], &out[0], 1);
+            return out;
+        }
+
+        void decrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
+            decrypt_blocks(in, out, 1);
+        }
+
+        void decrypt(const block_array& in, block_array& out) const {
+            decrypt_blocks(&in[0], &out[0], 1);
+        }
+
+        block_array decrypt(const block_array& in) const {
+            block_array out;
+            decrypt_blocks(&in[0], &out[0], 1);
+            return out;
+        }
+
+        // ECB over nblocks consecutive blocks, 4 interleaved per pass
+        void encrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks) const {
+            crypt_blocks<false>(in, out, nblocks);
+        }
+
+        void encrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check_blocks(in, out);
+            crypt_blocks<false>(in.data(), out.data(), in.size() / block_size());
+        }
+
+        void decrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks) const {
+            crypt_blocks<true>(in, out, nblocks);
+        }
+
+        void decrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check_blocks(in, out);
+            crypt_blocks<true>(in.data(), out.data(), in.size() / block_size());
+        }
+
+    private:
+        template <bool Inverse>
+        void crypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t n) const {
+            for (; n >= 4; n -= 4, in += 64, out += 64)
+                crypt_n<Inverse, 4>(in, out);
+            for (; n > 0; n--, in += 16, out += 16)
+                crypt_n<Inverse, 1>(in, out);
+        }
+
+        template <bool Inverse, std::size_t N>
+        void crypt_n(const std::uint8_t* in, std::uint8_t* out) const {
+            __m128i x[N];
+            for (std::size_t i = 0; i < N; i++)
+                x[i] = _mm_loadu_si128((const __m128i*)&in[16*i]);
+            if (Inverse)
+                inv_cipher(x);
+            else
+                cipher(x);
+            for (std::size_t i = 0; i < N; i++)
+                _mm_storeu_si128((__m128i*)&out[16*i], x[i]);
+        }
+
+        template <std::size_t N>
+        void cipher(__m128i (&x)[N]) const {
+            const auto shift = _mm_setr_epi8(0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11);
+            const auto sb1 = load(out_sbox), sb2 = load(out_sbox2);
+
+            for (auto& s : x)
+                s = _mm_xor_si128(transform(load(in_tower), s), ek[0]);
+
+            for (int round = 1; round < Nr; round++) {
+                for (auto& s : x) {
+                    __m128i io, jo;
+                    inverse(_mm_shuffle_epi8(s, shift), io, jo);
+                    const auto b = lookup(sb1, io, jo);
+                    const auto b2 = lookup(sb2, io, jo);
+                    // MixColumns: 2 b0 + 3 b1 + b2 + b3
+                    auto t = _mm_xor_si128(b2, rotate<1>(_mm_xor_si128(b2, b)));
+                    t = _mm_xor_si128(t, rotate<2>(_mm_xor_si128(b, rotate<1>(b))));
+                    s = _mm_xor_si128(t, ek[round]);
+                }
+            }
+
+            const auto sbo = load(out_sbox_last);
+            for (auto& s : x) {
+                __m128i io, jo;
+                inverse(_mm_shuffle_epi8(s, shift), io, jo);
+                s = _mm_xor_si128(lookup(sbo, io, jo), ek[Nr]);
+            }
+        }
+
+        // the Equivalent Inverse Cipher, with InvMixColumns folded into the output lookups
+        template <std::size_t N>
+        void inv_cipher(__m128i (&x)[N]) const {
+            const auto shift = _mm_setr_epi8(0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3);
+            const auto d9 = load(out_inv9), d11 = load(out_inv11);
+            const auto d13 = load(out_inv13), d14 = load(out_inv14);
+
+            for (auto& s : x)
+                s = _mm_xor_si128(transform(load(in_inv_tower), s), dk[0]);
+
+            for (int round = 1; round < Nr; round++) {
+                for (auto& s : x) {
+                    __m128i io, jo;
+                    inverse(_mm_shuffle_epi8(s, shift), io, jo);
+                    // InvMixColumns: 14 b0 + 11 b1 + 13 b2 + 9 b3
+                    auto t = _mm_xor_si128(lookup(d14, io, jo), rotate<1>(lookup(d11, io, jo)));
+                    t = _mm_xor_si128(t, rotate<2>(_mm_xor_si128(lookup(d13, io, jo), rotate<1>(lookup(d9, io, jo)))));
+                    s = _mm_xor_si128(t, dk[round]);
+                }
+            }
+
+            const auto dbo = load(out_inv_last);
+            for (auto& s : x) {
+                __m128i io, jo;
+                inverse(_mm_shuffle_epi8(s, shift), io, jo);
+                s = _mm_xor_si128(lookup(dbo, io, jo), dk[Nr]);
+            }
+        }
+
+        // 1/(i + k w) as two nibbles io and jo, a table lookup on each gives the result
+        static inline void inverse(__m128i x, __m128i& io, __m128i& jo) {
+            const auto mask = _mm_set1_epi8(0x0f);
+            const auto inv = load(gf16_inv);
+            const auto i = _mm_and_si128(_mm_srli_epi32(x, 4), mask);
+            const auto k = _mm_and_si128(x, mask);
+            const auto j = _mm_xor_si128(i, k);
+            const auto ak = _mm_shuffle_epi8(load(gf16_div_lambda), k);
+            const auto iak = _mm_xor_si128(_mm_shuffle_epi8(inv, i), ak);
+            const auto jak = _mm_xor_si128(_mm_shuffle_epi8(inv, j), ak);
+            io = _mm_xor_si128(_mm_shuffle_epi8(inv, iak), j);
+            jo = _mm_xor_si128(_mm_shuffle_epi8(inv, jak), i);
+        }
+
+        struct table_pair {
+            __m128i lo, hi;
+        };
+
+        static inline table_pair load(const std::array<std::array<std::uint8_t, 16>, 2>& t) {
+            return {_mm_loadu_si128((const __m128i*)&t[0]), _mm_loadu_si128((const __m128i*)&t[1])};
+        }
+
+        static inline __m128i load(const std::array<std::uint8_t, 16>& t) {
+            return _mm_loadu_si128((const __m128i*)&t);
+        }
+
+        static inline __m128i lookup(const table_pair& t, __m128i io, __m128i jo) {
+            return _mm_xor_si128(_mm_shuffle_epi8(t.lo, io), _mm_shuffle_epi8(t.hi, jo));
+        }
+
+        // a linear map on bytes as one lookup per nibble
+        static inline __m128i transform(const table_pair& t, __m128i x) {
+            const auto mask = _mm_set1_epi8(0x0f);
+            return _mm_xor_si128(_mm_shuffle_epi8(t.lo, _mm_and_si128(x, mask)),
+                                 _mm_shuffle_epi8(t.hi, _mm_and_si128(_mm_srli_epi32(x, 4), mask)));
+        }
+
+        // every column rotated up by R rows
+        template <int R>
+        static inline __m128i rotate(__m128i x) {
+            return _mm_shuffle_epi8(x, _mm_setr_epi8(
+                R%4, (R+1)%4, (R+2)%4, (R+3)%4,
+                4 + R%4, 4 + (R+1)%4, 4 + (R+2)%4, 4 + (R+3)%4,
+                8 + R%4, 8 + (R+1)%4, 8 + (R+2)%4, 8 + (R+3)%4,
+                12 + R%4, 12 + (R+1)%4, 12 + (R+2)%4, 12 + (R+3)%4));
+        }
+
+        // SubWord on 4 bytes through the nibble basis
+        static void sub_word(std::uint8_t t[4]) {
+            std::int32_t x;
+            std::memcpy(&x, t, 4);
+            __m128i io, jo;
+            inverse(transform(load(in_tower), _mm_cvtsi32_si128(x)), io, jo);
+            x = _mm_cvtsi128_si32(_mm_xor_si128(lookup(load(out_sbox_last), io, jo), _mm_set1_epi8(0x63)));
+            std::memcpy(t, &x, 4);
+        }
+
+        // InvMixColumns of a round key, into the basis of the inverse rounds
+        static __m128i inv_mix_columns(__m128i k) {
+            auto t = _mm_xor_si128(transform(load(in_inv14), k), transform(load(in_inv11), rotate<1>(k)));
+            t = _mm_xor_si128(t, transform(load(in_inv13), rotate<2>(k)));
+            return _mm_xor_si128(t, transform(load(in_inv9), rotate<3>(k)));
+        }
+
+        static void check_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+            if (in.size() % block_size() != 0)
+                throw std::invalid_argument("cheap_aes: input is not a multiple of the block size");
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+        }
+
+        static_assert(Nb == 4);
+
+        // GF(2^8) with the AES polynomial
+        static constexpr std::uint8_t gf256m(std::uint8_t a, std::uint8_t b) {
+            std::uint8_t r = 0;
+            for (int i = 0; i < 8; i++) {
+                if (b & 1)
+                    r ^= a;
+                b >>= 1;
+                a = (a & 0x80) ? (a << 1 ^ 0x1b) : a << 1;
+            }
+            return r;
+        }
+
+        static constexpr std::uint8_t gf256inv(std::uint8_t a) {
+            std::uint8_t r = 1;
+            for (int i = 0; i < 254; i++)
+                r = gf256m(r, a);
+            return r;
+        }
+
+        // the nibble n as an element of GF(16), over the basis 0x01, 0x0c, 0x50, 0xb0
+        static constexpr std::uint8_t gf16(int n) {
+            constexpr std::uint8_t basis[4] = {0x01, 0x0c, 0x50, 0xb0};
+            std::uint8_t r = 0;
+            for (int b = 0; b < 4; b++)
+                if (n >> b & 1)
+                    r ^= basis[b];
+            return r;
+        }
+
+        static constexpr int gf16_code(std::uint8_t x) {
+            for (int n = 0; n < 16; n++)
+                if (gf16(n) == x)
+                    return n;
+            return -1;
+        }
+
+        static constexpr std::uint8_t tower_w = 0x12;
+        static constexpr std::uint8_t tower_lambda = 0x0d;
+        static_assert((gf256m(tower_w, tower_w) ^ tower_w) == tower_lambda);
+
+        // the affine part of SubBytes without its constant, and its inverse
+        static constexpr std::uint8_t affine(std::uint8_t x) {
+            return x ^ std::rotl(x, 1) ^ std::rotl(x, 2) ^ std::rotl(x, 3) ^ std::rotl(x, 4);
+        }
+
+        static constexpr std::uint8_t inv_affine(std::uint8_t x) {
+            return std::rotl(x, 1) ^ std::rotl(x, 3) ^ std::rotl(x, 6);
+        }
+
+        using table = std::array<std::uint8_t, 16>;
+        using table2 = std::array<table, 2>;
+
+        // 1/n and lambda^-1/n on GF(16), 1/0 is 0x80 so that pshufb on it yields 0
+        static constexpr table make_gf16_div(std::uint8_t a) {
+            table t;
+            t[0] = 0x80;
+            for (int n = 1; n < 16; n++)
+                t[n] = gf16_code(gf256m(a, gf256inv(gf16(n))));
+            return t;
+        }
+
+        // F(x) split over the low and the high nibble of x, for linear F
+        template <class F>
+        static constexpr table2 make_in(F f) {
+            table2 t;
+            for (int n = 0; n < 16; n++) {
+                t[0][n] = f(n);
+                t[1][n] = f(n << 4);
+            }
+            return t;
+        }
+
+        // F(1/x) from io and jo, as F((lambda + w)/io) + F((1 + lambda + w)/jo) for linear F
+        template <class F>
+        static constexpr table2 make_out(F f) {
+            table2 t;
+            for (int n = 0; n < 16; n++) {
+                const auto r = gf256inv(gf16(n));
+                t[0][n] = f(gf256m(r, tower_lambda ^ tower_w));
+                t[1][n] = f(gf256m(r, 1 ^ tower_lambda ^ tower_w));
+            }
+            return t;
+        }
+
+        // x = i + k w to i << 4 | k
+        static constexpr std::uint8_t tower(std::uint8_t x) {
+            for (int c = 0; c < 256; c++)
+                if ((gf16(c >> 4) ^ gf256m(gf16(c & 0x0f), tower_w)) == x)
+                    return c;
+            return 0;
+        }
+
+        static constexpr table gf16_inv = make_gf16_div(1);
+        static constexpr table gf16_div_lambda = make_gf16_div(gf256inv(tower_lambda));
+        static constexpr table2 in_tower = make_in([](std::uint8_t x) { return tower(x); });
+        static constexpr table2 in_inv_tower = make_in([](std::uint8_t x) { return tower(inv_affine(x)); });
+        static constexpr table2 in_inv9 = make_in([](std::uint8_t x) { return tower(inv_affine(gf256m(0x09, x))); });
+        static constexpr table2 in_inv11 = make_in([](std::uint8_t x) { return tower(inv_affine(gf256m(0x0b, x))); });
+        static constexpr table2 in_inv13 = make_in([](std::uint8_t x) { return tower(inv_affine(gf256m(0x0d, x))); });
+        static constexpr table2 in_inv14 = make_in([](std::uint8_t x) { return tower(inv_affine(gf256m(0x0e, x))); });
+        static constexpr table2 out_sbox = make_out([](std::uint8_t x) { return tower(affine(x)); });
+        static constexpr table2 out_sbox2 = make_out([](std::uint8_t x) { return tower(gf256m(2, affine(x))); });
+        static constexpr table2 out_sbox_last = make_out([](std::uint8_t x) { return affine(x); });
+        static constexpr table2 out_inv9 = make_out([](std::uint8_t x) { return tower(inv_affine(gf256m(0x09, x))); });
+        static constexpr table2 out_inv11 = make_out([](std::uint8_t x) { return tower(inv_affine(gf256m(0x0b, x))); });
+        static constexpr table2 out_inv13 = make_out([](std::uint8_t x) { return tower(inv_affine(gf256m(0x0d, x))); });
+        static constexpr table2 out_inv14 = make_out([](std::uint8_t x) { return tower(inv_affine(gf256m(0x0e, x))); });
+        static constexpr table2 out_inv_last = make_out([](std::uint8_t x) { return x; });
+    };
+
+    using aes128 = aes_base<4, 4, 10>;
+    using aes192 = aes_base<6, 4, 12>;
+    using aes256 = aes_base<8, 4, 14>;
+}
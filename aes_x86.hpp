@@ -3,75 +3,307 @@
 // Copyright 2023 funanz <granz.fisherman@gmail.com>
 // https://opensource.org/licenses/MIT
 #include <array>
+#include <atomic>
 #include <bit>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <span>
+#include <stdexcept>
 #include <immintrin.h>
+#include "aes_stats.hpp"
+
+// The per-block loops of the interleaved kernels have to be unrolled for the
+// blocks to stay in registers, which -O2 does not do on its own.
+#if defined(__GNUC__) && !defined(__clang__)
+#define CHEAP_AES_UNROLL _Pragma("GCC unroll 8")
+#else
+#define CHEAP_AES_UNROLL
+#endif
 
 namespace cheap_aes::x86
 {
-    template <int Nk, int Nb, int Nr>
-    class aes_base
+    // Which schedules a context keeps. An encrypt-only context derives the
+    // decryption schedule on the stack when it is asked to decrypt; a
+    // decrypt-only one cannot encrypt.
+    enum class key_dir { both, encrypt, decrypt };
+
+    // How the bulk calls write their output. streaming goes around the
+    // caches with non-temporal stores, for buffers much larger than the last
+    // level cache that would evict the working set of everything else and
+    // pay a read for ownership of every line; automatic streams from
+    // streaming_threshold bytes.
+    enum class store_hint { automatic, cached, streaming };
+
+    inline std::atomic<std::size_t> streaming_threshold{std::size_t(32) << 20};
+
+    // streaming needs out 16-byte aligned, otherwise the hint is ignored
+    inline bool use_streaming(store_hint hint, const std::uint8_t* out, std::size_t len) {
+        if ((std::uintptr_t)out % 16 != 0)
+            return false;
+        return hint == store_hint::streaming ||
+            (hint == store_hint::automatic && len >= streaming_threshold.load(std::memory_order_relaxed));
+    }
+
+    // n blocks through f, which transforms __m128i (&)[N] in place, with
+    // non-temporal stores 8 blocks at a time from the first 64-byte line of
+    // out and the input prefetched ahead. The head before that line and the
+    // tail go through the caches; an sfence orders the stores at the end.
+    template <class F>
+    inline void stream_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t n, F&& f) {
+        constexpr std::size_t prefetch_distance = 1024;
+        const auto single = [&] {
+            __m128i s[1] = { _mm_loadu_si128((const __m128i*)in) };
+            f(s);
+            _mm_storeu_si128((__m128i*)out, s[0]);
+            n--, in += 16, out += 16;
+        };
+
+        while (n > 0 && (std::uintptr_t)out % 64 != 0)
+            single();
+        for (; n >= 8; n -= 8, in += 8*16, out += 8*16) {
+            _mm_prefetch((const char*)in + prefetch_distance, _MM_HINT_T0);
+            _mm_prefetch((const char*)in + prefetch_distance + 64, _MM_HINT_T0);
+            __m128i s[8];
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < 8; j++)
+                s[j] = _mm_loadu_si128((const __m128i*)in + j);
+            f(s);
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < 8; j++)
+                _mm_stream_si128((__m128i*)out + j, s[j]);
+        }
+        while (n > 0)
+            single();
+        _mm_sfence();
+    }
+
+    // Stats is the instrumentation policy, see aes_stats.hpp
+    template <int Nk, int Nb, int Nr, key_dir Dir = key_dir::both, class Stats = no_stats>
+    class alignas(64) aes_base
     {
     public:
         static constexpr int key_size() { return 4 * Nk; };
         static constexpr int block_size() { return 4 * Nb; };
         using key_array = std::array<std::uint8_t, key_size()>;
         using block_array = std::array<std::uint8_t, block_size()>;
+        using stats_type = Stats;
 
     private:
-        __m128i w[Nr+1];
-        __m128i dw[Nr+1];
+        static constexpr bool has_w = Dir != key_dir::decrypt;
+        static constexpr bool has_dw = Dir != key_dir::encrypt;
+
+        // w then dw, whichever of them are kept
+        __m128i ks[(has_w + has_dw) * (Nr+1)];
+
+        template <int, int, int, key_dir, class>
+        friend class aes_base;
 
     public:
         aes_base() {}
 
         explicit aes_base(const std::uint8_t key[4*Nk]) {
-            key_expansion(&key[0], &w[0], &dw[0]);
+            set(&key[0]);
         }
 
         explicit aes_base(const key_array& key) {
-            key_expansion(&key[0], &w[0], &dw[0]);
+            set(&key[0]);
+        }
+
+        // adopts schedules in the layout of cheap_aes::aes_base::round_keys()
+        // and inv_round_keys(), so that one expanded at compile time is used as is
+        constexpr aes_base(const std::array<std::uint32_t, Nb*(Nr+1)>& ew, const std::array<std::uint32_t, Nb*(Nr+1)>& dew) {
+            for (int i = 0; i <= Nr; i++) {
+                if constexpr (has_w)
+                    ks[i] = to_si128(&ew[4*i]);
+                if constexpr (has_dw)
+                    ks[(has_w ? Nr+1 : 0) + i] = to_si128(&dew[4*i]);
+            }
         }
 
         void set(const std::uint8_t key[4*Nk]) {
-            key_expansion(&key[0], &w[0], &dw[0]);
+            Stats::key_setup();
+            if constexpr (has_dw)
+                Stats::inv_schedule();
+            if constexpr (has_w) {
+                key_expansion(&key[0], &ks[0]);
+                if constexpr (has_dw)
+                    inv_key(&ks[0], &ks[Nr+1]);
+            } else {
+                __m128i w[Nr+1];
+                key_expansion(&key[0], w);
+                inv_key(w, &ks[0]);
+            }
         }
 
         void set(const key_array& key) {
-            key_expansion(&key[0], &w[0], &dw[0]);
+            set(&key[0]);
         }
 
-        void encrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
-            cipher(&in[0], &out[0], &w[0]);
+        // Sets aes[i] to keys[i]. The schedules of 8 keys are expanded in
+        // lockstep, each chain with aesenclast in place of aeskeygenassist.
+        static void set_keys(std::span<aes_base> aes, std::span<const key_array> keys) {
+            if (aes.size() != keys.size())
+                throw std::invalid_argument("cheap_aes: contexts and keys differ in number");
+            std::size_t i = 0;
+            for (; keys.size() - i >= 8; i += 8)
+                set_n<8>(&aes[i], &keys[i]);
+            switch (keys.size() - i) {
+            case 1: set_n<1>(&aes[i], &keys[i]); break;
+            case 2: set_n<2>(&aes[i], &keys[i]); break;
+            case 3: set_n<3>(&aes[i], &keys[i]); break;
+            case 4: set_n<4>(&aes[i], &keys[i]); break;
+            case 5: set_n<5>(&aes[i], &keys[i]); break;
+            case 6: set_n<6>(&aes[i], &keys[i]); break;
+            case 7: set_n<7>(&aes[i], &keys[i]); break;
+            }
         }
 
-        void encrypt(const block_array& in, block_array& out) const {
-            cipher(&in[0], &out[0], &w[0]);
+        // the decrypt-only context of the same key, from the kept schedule
+        aes_base<Nk, Nb, Nr, key_dir::decrypt, Stats> inverse() const requires has_w {
+            aes_base<Nk, Nb, Nr, key_dir::decrypt, Stats> aes;
+            if constexpr (has_dw) {
+                std::memcpy(aes.ks, dw(), sizeof(aes.ks));
+            } else {
+                Stats::inv_schedule();
+                inv_key(w(), aes.ks);
+            }
+            return aes;
         }
 
-        block_array encrypt(const block_array& in) const {
+        void encrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const requires has_w {
+            Stats::blocks(1);
+            cipher(&in[0], &out[0], w());
+        }
+
+        void encrypt(const block_array& in, block_array& out) const requires has_w {
+            Stats::blocks(1);
+            cipher(&in[0], &out[0], w());
+        }
+
+        block_array encrypt(const block_array& in) const requires has_w {
+            Stats::blocks(1);
             block_array out;
-            cipher(&in[0], &out[0], &w[0]);
+            cipher(&in[0], &out[0], w());
             return out;
         }
 
         void decrypt(const std::uint8_t in[4*Nb], std::uint8_t out[4*Nb]) const {
-            inv_cipher(&in[0], &out[0], &dw[0]);
+            Stats::blocks(1);
+            with_dw([&](const __m128i* dw) { inv_cipher(&in[0], &out[0], dw); });
         }
 
         void decrypt(const block_array& in, block_array& out) const {
-            inv_cipher(&in[0], &out[0], &dw[0]);
+            Stats::blocks(1);
+            with_dw([&](const __m128i* dw) { inv_cipher(&in[0], &out[0], dw); });
         }
 
         block_array decrypt(const block_array& in) const {
+            Stats::blocks(1);
             block_array out;
-            inv_cipher(&in[0], &out[0], &dw[0]);
+            with_dw([&](const __m128i* dw) { inv_cipher(&in[0], &out[0], dw); });
             return out;
         }
 
+        // ECB over nblocks consecutive blocks, interleaved 8/4 wide
+        void encrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks,
+                            store_hint hint = store_hint::automatic) const requires has_w {
+            typename Stats::call scope(nblocks * block_size());
+            Stats::blocks(nblocks);
+            cipher_blocks(in, out, nblocks, w(), hint);
+        }
+
+        void encrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                            store_hint hint = store_hint::automatic) const requires has_w {
+            check_blocks(in, out);
+            encrypt_blocks(in.data(), out.data(), in.size() / block_size(), hint);
+        }
+
+        void decrypt_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t nblocks,
+                            store_hint hint = store_hint::automatic) const {
+            typename Stats::call scope(nblocks * block_size());
+            Stats::blocks(nblocks);
+            with_dw([&](const __m128i* dw) { inv_cipher_blocks(in, out, nblocks, dw, hint); });
+        }
+
+        void decrypt_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out,
+                            store_hint hint = store_hint::automatic) const {
+            check_blocks(in, out);
+            decrypt_blocks(in.data(), out.data(), in.size() / block_size(), hint);
+        }
+
+        // the schedules as used by aesenc and aesdec (Equivalent Inverse Cipher)
+        const __m128i* round_keys() const requires has_w {
+            return w();
+        }
+
+        const __m128i* inv_round_keys() const requires has_dw {
+            return dw();
+        }
+
+        // register level entry points for the mode layers
+        __m128i encrypt_si128(__m128i state) const requires has_w {
+            Stats::blocks(1);
+            __m128i s[1] = { state };
+            cipher_x(s, w());
+            return s[0];
+        }
+
+        template <std::size_t N>
+        void encrypt_si128(__m128i (&state)[N]) const requires has_w {
+            Stats::blocks(N);
+            cipher_x(state, w());
+        }
+
+        // each_round(i) runs after the i-th middle round, to stitch other work in
+        template <std::size_t N, class F>
+        void encrypt_si128(__m128i (&state)[N], F&& each_round) const requires has_w {
+            Stats::blocks(N);
+            cipher_x(state, w(), each_round);
+        }
+
+        __m128i decrypt_si128(__m128i state) const {
+            Stats::blocks(1);
+            __m128i s[1] = { state };
+            with_dw([&](const __m128i* dw) { inv_cipher_x(s, dw); });
+            return s[0];
+        }
+
+        template <std::size_t N>
+        void decrypt_si128(__m128i (&state)[N]) const {
+            Stats::blocks(N);
+            with_dw([&](const __m128i* dw) { inv_cipher_x(state, dw); });
+        }
+
+        template <std::size_t N, class F>
+        void decrypt_si128(__m128i (&state)[N], F&& each_round) const {
+            Stats::blocks(N);
+            with_dw([&](const __m128i* dw) { inv_cipher_x(state, dw, each_round); });
+        }
+
     private:
-        static void key_expansion(const std::uint8_t key[4*Nk], __m128i w[Nr+1], __m128i dw[Nr+1]) {
+        const __m128i* w() const {
+            return &ks[0];
+        }
+
+        const __m128i* dw() const {
+            return &ks[has_w ? Nr+1 : 0];
+        }
+
+        // f(dw) with the kept decryption schedule, or one derived for the call
+        template <class F>
+        inline void with_dw(F&& f) const {
+            if constexpr (has_dw) {
+                f(dw());
+            } else {
+                __m128i dw[Nr+1];
+                Stats::inv_schedule();
+                inv_key(w(), dw);
+                f(dw);
+            }
+        }
+
+        static void key_expansion(const std::uint8_t key[4*Nk], __m128i w[Nr+1]) {
             if constexpr (Nk == 4 && Nb == 4 && Nr == 10)
                 key_expansion_128(key, w);
             else if constexpr (Nk == 6 && Nb == 4 && Nr == 12)
@@ -80,8 +312,6 @@ namespace cheap_aes::x86
                 key_expansion_256(key, w);
             else
                 key_expansion_gen(key, w);
-
-            inv_key(w, dw);
         }
 
         static void key_expansion_gen(const std::uint8_t key[4*Nk], __m128i w[Nr+1]) {
@@ -98,6 +328,17 @@ namespace cheap_aes::x86
             }
         }
 
+        // four big-endian words as the 16 bytes they stand for
+        static constexpr __m128i to_si128(const std::uint32_t p[4]) {
+            std::uint64_t x[2] = {};
+            for (int i = 0; i < 4; i++) {
+                const auto n = p[i];
+                const std::uint64_t le = n >> 24 | (n >> 8 & 0xff00) | (n << 8 & 0xff0000) | (std::uint64_t)(n & 0xff) << 24;
+                x[i/2] |= le << (32 * (i%2));
+            }
+            return __m128i{(long long)x[0], (long long)x[1]};
+        }
+
         static constexpr std::uint32_t word(std::uint8_t a, std::uint8_t b, std::uint8_t c, std::uint8_t d) {
             return a | b << 8 | c << 16 | d << 24;
         }
@@ -227,6 +468,108 @@ namespace cheap_aes::x86
             w[out] = x;
         }
 
+        template <std::size_t N>
+        static inline void set_n(aes_base* aes, const key_array* keys) {
+            __m128i tmp[has_w ? 1 : N][Nr+1];
+            __m128i* w[N];
+            for (std::size_t j = 0; j < N; j++) {
+                Stats::key_setup();
+                if constexpr (has_dw)
+                    Stats::inv_schedule();
+                w[j] = has_w ? &aes[j].ks[0] : tmp[has_w ? 0 : j];
+            }
+
+            key_expansion_x(keys, w);
+            if constexpr (has_dw)
+                for (std::size_t j = 0; j < N; j++)
+                    inv_key(w[j], &aes[j].ks[has_w ? Nr+1 : 0]);
+        }
+
+        template <std::size_t N>
+        static void key_expansion_x(const key_array* keys, __m128i* const (&w)[N]) {
+            if constexpr (Nk == 4 && Nb == 4 && Nr == 10)
+                key_expansion_128_x(keys, w);
+            else if constexpr (Nk == 6 && Nb == 4 && Nr == 12)
+                key_expansion_192_x(keys, w);
+            else if constexpr (Nk == 8 && Nb == 4 && Nr == 14)
+                key_expansion_256_x(keys, w);
+            else
+                for (std::size_t j = 0; j < N; j++)
+                    key_expansion_gen(&keys[j][0], w[j]);
+        }
+
+        // SubWord of the word that select puts in every column, xor rc.
+        // With the columns all alike ShiftRows moves nothing, so this is
+        // one aesenclast where aeskeygenassist is microcoded.
+        static inline __m128i sub_word_si128(__m128i x, __m128i select, __m128i rc) {
+            return _mm_aesenclast_si128(_mm_shuffle_epi8(x, select), rc);
+        }
+
+        // RotWord of word 3 or word 1, and word 3 as it is
+        static inline __m128i rot_word3() {
+            return _mm_set_epi8(12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13);
+        }
+
+        static inline __m128i rot_word1() {
+            return _mm_set_epi8(4, 7, 6, 5, 4, 7, 6, 5, 4, 7, 6, 5, 4, 7, 6, 5);
+        }
+
+        static inline __m128i word3() {
+            return _mm_set_epi8(15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13, 12);
+        }
+
+        template <std::size_t N>
+        static inline void key_expansion_128_x(const key_array* keys, __m128i* const (&w)[N]) {
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                w[j][0] = _mm_loadu_si128((const __m128i*)&keys[j][0]);
+            for (int i = 1; i <= 10; i++) {
+                const auto rc = _mm_set1_epi32(rcon[i]);
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < N; j++)
+                    key_expansion_128_update(w[j], i-1, i, sub_word_si128(w[j][i-1], rot_word3(), rc));
+            }
+        }
+
+        template <std::size_t N>
+        static inline void key_expansion_192_x(const key_array* keys, __m128i* const (&w)[N]) {
+            // where each step leaves its words, as in key_expansion_192
+            static constexpr int out[8][2] = {
+                {1, 2}, {3, 4}, {4, 5}, {6, 7}, {7, 8}, {9, 10}, {10, 11}, {12, -1},
+            };
+            __m128i state[N][2];
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++) {
+                std::memcpy(w[j], &keys[j][0], 24);
+                state[j][0] = w[j][0];
+                state[j][1] = w[j][1];
+            }
+            for (int i = 0; i < 8; i++) {
+                const auto rc = _mm_set1_epi32(rcon[i+1]);
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < N; j++)
+                    key_expansion_192_update(state[j], w[j], out[i][0], out[i][1],
+                                             sub_word_si128(state[j][1], rot_word1(), rc), i % 2 == 0);
+            }
+        }
+
+        template <std::size_t N>
+        static inline void key_expansion_256_x(const key_array* keys, __m128i* const (&w)[N]) {
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++) {
+                w[j][0] = _mm_loadu_si128((const __m128i*)&keys[j][0]);
+                w[j][1] = _mm_loadu_si128((const __m128i*)&keys[j][16]);
+            }
+            for (int i = 2; i <= 14; i++) {
+                // RotWord and rcon on the even steps only
+                const auto select = i % 2 == 0 ? rot_word3() : word3();
+                const auto rc = _mm_set1_epi32(i % 2 == 0 ? rcon[i/2] : 0);
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < N; j++)
+                    key_expansion_256_update(w[j], i-2, i, sub_word_si128(w[j][i-1], select, rc));
+            }
+        }
+
         static void inv_key(const __m128i w[Nr+1], __m128i dw[Nr+1]) {
             dw[Nr] = w[0];
             for (int i = 1; i < Nr; i++)
@@ -256,6 +599,104 @@ namespace cheap_aes::x86
             _mm_storeu_si128((__m128i*)out, state);
         }
 
+        // N independent blocks per round so that the AES unit stays busy
+        template <std::size_t N, class F = void (*)(int)>
+        static inline void cipher_x(__m128i (&state)[N], const __m128i w[Nr+1], F&& each_round = [](int) {}) {
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                state[j] = _mm_xor_si128(state[j], w[0]);
+            for (int i = 1; i < Nr; i++) {
+                auto k = w[i];
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < N; j++)
+                    state[j] = _mm_aesenc_si128(state[j], k);
+                each_round(i);
+            }
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                state[j] = _mm_aesenclast_si128(state[j], w[Nr]);
+        }
+
+        template <std::size_t N, class F = void (*)(int)>
+        static inline void inv_cipher_x(__m128i (&state)[N], const __m128i dw[Nr+1], F&& each_round = [](int) {}) {
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                state[j] = _mm_xor_si128(state[j], dw[0]);
+            for (int i = 1; i < Nr; i++) {
+                auto k = dw[i];
+                CHEAP_AES_UNROLL
+                for (std::size_t j = 0; j < N; j++)
+                    state[j] = _mm_aesdec_si128(state[j], k);
+                each_round(i);
+            }
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                state[j] = _mm_aesdeclast_si128(state[j], dw[Nr]);
+        }
+
+        template <std::size_t N>
+        static inline void cipher_n(const std::uint8_t* in, std::uint8_t* out, const __m128i w[Nr+1]) {
+            __m128i state[N];
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                state[j] = _mm_loadu_si128((const __m128i*)in + j);
+            cipher_x(state, w);
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                _mm_storeu_si128((__m128i*)out + j, state[j]);
+        }
+
+        template <std::size_t N>
+        static inline void inv_cipher_n(const std::uint8_t* in, std::uint8_t* out, const __m128i dw[Nr+1]) {
+            __m128i state[N];
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                state[j] = _mm_loadu_si128((const __m128i*)in + j);
+            inv_cipher_x(state, dw);
+            CHEAP_AES_UNROLL
+            for (std::size_t j = 0; j < N; j++)
+                _mm_storeu_si128((__m128i*)out + j, state[j]);
+        }
+
+        static void cipher_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t n, const __m128i w[Nr+1],
+                                  store_hint hint) {
+            if (use_streaming(hint, out, n * block_size())) {
+                stream_blocks(in, out, n, [&](auto& s) { cipher_x(s, w); });
+                return;
+            }
+            for (; n >= 8; n -= 8, in += 8*4*Nb, out += 8*4*Nb)
+                cipher_n<8>(in, out, w);
+            if (n >= 4) {
+                cipher_n<4>(in, out, w);
+                n -= 4, in += 4*4*Nb, out += 4*4*Nb;
+            }
+            for (; n > 0; n--, in += 4*Nb, out += 4*Nb)
+                cipher(in, out, w);
+        }
+
+        static void inv_cipher_blocks(const std::uint8_t* in, std::uint8_t* out, std::size_t n, const __m128i dw[Nr+1],
+                                      store_hint hint) {
+            if (use_streaming(hint, out, n * block_size())) {
+                stream_blocks(in, out, n, [&](auto& s) { inv_cipher_x(s, dw); });
+                return;
+            }
+            for (; n >= 8; n -= 8, in += 8*4*Nb, out += 8*4*Nb)
+                inv_cipher_n<8>(in, out, dw);
+            if (n >= 4) {
+                inv_cipher_n<4>(in, out, dw);
+                n -= 4, in += 4*4*Nb, out += 4*4*Nb;
+            }
+            for (; n > 0; n--, in += 4*Nb, out += 4*Nb)
+                inv_cipher(in, out, dw);
+        }
+
+        static void check_blocks(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+            if (in.size() % block_size() != 0)
+                throw std::invalid_argument("cheap_aes: input is not a multiple of the block size");
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+        }
+
         static constexpr std::uint8_t rcon[11] = {
             0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36,
         };
@@ -285,4 +726,19 @@ namespace cheap_aes::x86
     using aes128 = aes_base<4, 4, 10>;
     using aes192 = aes_base<6, 4, 12>;
     using aes256 = aes_base<8, 4, 14>;
+
+    using aes128_enc = aes_base<4, 4, 10, key_dir::encrypt>;
+    using aes192_enc = aes_base<6, 4, 12, key_dir::encrypt>;
+    using aes256_enc = aes_base<8, 4, 14, key_dir::encrypt>;
+
+    using aes128_dec = aes_base<4, 4, 10, key_dir::decrypt>;
+    using aes192_dec = aes_base<6, 4, 12, key_dir::decrypt>;
+    using aes256_dec = aes_base<8, 4, 14, key_dir::decrypt>;
+
+    // the schedules a context keeps, by its key_dir
+    template <class AES>
+    concept has_round_keys = requires(const AES& aes) { aes.round_keys(); };
+
+    template <class AES>
+    concept has_inv_round_keys = requires(const AES& aes) { aes.inv_round_keys(); };
 }
@@ -0,0 +1,156 @@
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <bytes_literals.hpp>
+#include "aes_xts_x86.hpp"
+
+using namespace cheap_aes::x86;
+using namespace bytes_literals;
+
+#define runtime_assert(expr) [](bool ok){ if (!ok) throw std::logic_error(#expr); }(expr)
+
+template <class XTS, std::size_t N>
+void test_xts_vector(const typename XTS::key_array& key, const typename XTS::tweak_array& tweak,
+                     const std::array<std::uint8_t, N>& text, const std::array<std::uint8_t, N>& expected)
+{
+    XTS xts(key);
+    std::array<std::uint8_t, N> enc, dec;
+    xts.encrypt(tweak, text, enc);
+    runtime_assert(enc == expected);
+    xts.decrypt(tweak, enc, dec);
+    runtime_assert(dec == text);
+}
+
+// IEEE 1619-2007 Annex B, vectors 1-3 and 15-18
+void test_xts128_x86()
+{
+    test_xts_vector<xts128>(
+        0x0000000000000000000000000000000000000000000000000000000000000000_bytes,
+        0x00000000000000000000000000000000_bytes,
+        0x0000000000000000000000000000000000000000000000000000000000000000_bytes,
+        0x917cf69ebd68b2ec9b9fe9a3eadda692cd43d2f59598ed858c02c2652fbf922e_bytes);
+    test_xts_vector<xts128>(
+        0x1111111111111111111111111111111122222222222222222222222222222222_bytes,
+        0x33333333330000000000000000000000_bytes,
+        0x4444444444444444444444444444444444444444444444444444444444444444_bytes,
+        0xc454185e6a16936e39334038acef838bfb186fff7480adc4289382ecd6d394f0_bytes);
+    test_xts_vector<xts128>(
+        0xfffefdfcfbfaf9f8f7f6f5f4f3f2f1f022222222222222222222222222222222_bytes,
+        0x33333333330000000000000000000000_bytes,
+        0x4444444444444444444444444444444444444444444444444444444444444444_bytes,
+        0xaf85336b597afc1a900b2eb21ec949d292df4c047e0b21532186a5971a227a89_bytes);
+
+    constexpr auto key = 0xfffefdfcfbfaf9f8f7f6f5f4f3f2f1f0bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0_bytes;
+    constexpr auto tweak = 0x9a785634120000000000000000000000_bytes;
+    test_xts_vector<xts128>(key, tweak, 0x000102030405060708090a0b0c0d0e0f10_bytes, 0x6c1625db4671522d3d7599601de7ca09ed_bytes);
+    test_xts_vector<xts128>(key, tweak, 0x000102030405060708090a0b0c0d0e0f1011_bytes, 0xd069444b7a7e0cab09e24447d24deb1fedbf_bytes);
+    test_xts_vector<xts128>(key, tweak, 0x000102030405060708090a0b0c0d0e0f101112_bytes, 0xe5df1351c0544ba1350b3363cd8ef4beedbf9d_bytes);
+    test_xts_vector<xts128>(key, tweak, 0x000102030405060708090a0b0c0d0e0f10111213_bytes, 0x9d84c813f719aa2c7be3f66171c7c5c2edbf9dac_bytes);
+}
+
+// IEEE 1619-2007 Annex B, vector 10, through the sector API
+void test_xts256_x86()
+{
+    xts256 xts(0x27182818284590452353602874713526624977572470936999595749669676273141592653589793238462643383279502884197169399375105820974944592_bytes);
+    std::vector<std::uint8_t> text(512);
+    for (std::size_t i = 0; i < text.size(); i++)
+        text[i] = i;
+    auto expected =
+        0x1c3b3a102f770386e4836c99e370cf9bea00803f5e482357a4ae12d414a3e63b5d31e276f8fe4a8d66b317f9ac683f44680a86ac35adfc3345befecb4bb188fd5776926c49a3095eb108fd1098baec70aaa66999a72a82f27d848b21d4a741b0c5cd4d5fff9dac89aeba122961d03a757123e9870f8acf1000020887891429ca2a3e7a7d7df7b10355165c8b9a6d0a7de8b062c4500dc4cd120c0f7418dae3d0b5781c34803fa75421c790dfe1de1834f280d7667b327f6c8cd7557e12ac3a0f93ec05c52e0493ef31a12d3d9260f79a289d6a379bc70c50841473d1a8cc81ec583e9645e07b8d9670655ba5bbcfecc6dc3966380ad8fecb17b6ba02469a020a84e18e8f84252070c13e9f1f289be54fbc481457778f616015e1327a02b140f1505eb309326d68378f8374595c849d84f4c333ec4423885143cb47bd71c5edae9be69a2ffeceb1bec9de244fbe15992b11b77c040f12bd8f6a975a44a0f90c29a9abc3d4d893927284c58754cce294529f8614dcd2aba991925fedc4ae74ffac6e333b93eb4aff0479da9a410e4450e0dd7ae4c6e2910900575da401fc07059f645e8b7e9bfdef33943054ff84011493c27b3429eaedb4ed5376441a77ed43851ad77f16f541dfd269d50d6a5f14fb0aab1cbb4c1550be97f7ab4066193c4caa773dad38014bd2092fa755c824bb5e54c4f36ffda9fcea70b9c6e693e148c151_bytes;
+
+    std::vector<std::uint8_t> enc(512);
+    xts.encrypt_sectors(0xff, 512, text, enc);
+    runtime_assert(std::ranges::equal(enc, expected));
+    xts.decrypt_sectors(0xff, 512, enc, enc);
+    runtime_assert(enc == text);
+}
+
+// one block at a time with the tweak doubled serially
+void xts_reference(const aes128& k1, const aes128& k2, const std::uint8_t tweak[16],
+                   const std::uint8_t* in, std::uint8_t* out, std::size_t len)
+{
+    std::uint8_t t[16], x[16], prev[16];
+    k2.encrypt(tweak, t);
+    auto step = [&](const std::uint8_t* p, std::uint8_t* q) {
+        for (int i = 0; i < 16; i++)
+            x[i] = p[i] ^ t[i];
+        k1.encrypt(x, x);
+        for (int i = 0; i < 16; i++)
+            q[i] = x[i] ^ t[i];
+        int carry = 0;
+        for (int i = 0; i < 16; i++) {
+            int c = t[i] >> 7;
+            t[i] = t[i] << 1 | carry;
+            carry = c;
+        }
+        if (carry)
+            t[0] ^= 0x87;
+    };
+    std::size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+        step(in + i, out + i);
+    if (i < len) {
+        const auto tail = len - i;
+        std::memcpy(prev, out + i - 16, 16);
+        std::memcpy(out + i, prev, tail);
+        std::memcpy(prev, in + i, tail);
+        step(prev, out + i - 16);
+    }
+}
+
+// the 8-wide paths and the batch API against the reference
+void test_xts_long_x86()
+{
+    auto key = 0x000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f_bytes;
+    xts128 xts(key);
+    aes128 k1(&key[0]), k2(&key[16]);
+    auto tweak = 0xfffffffffffffffffffffffffffffff0_bytes;
+
+    for (std::size_t len : {16, 17, 31, 32, 127, 128, 129, 143, 144, 255, 256, 300, 1000}) {
+        std::vector<std::uint8_t> text(len), enc(len), expected(len);
+        for (std::size_t i = 0; i < len; i++)
+            text[i] = i * 11 + 3;
+        xts.encrypt(tweak, text, enc);
+        xts_reference(k1, k2, &tweak[0], text.data(), expected.data(), len);
+        runtime_assert(enc == expected);
+        xts.decrypt(tweak, enc, enc);
+        runtime_assert(enc == text);
+    }
+
+    for (std::size_t unit : {16, 33, 512}) {
+        const std::size_t count = 19;
+        std::vector<std::uint8_t> text(unit * count), enc(text.size());
+        for (std::size_t i = 0; i < text.size(); i++)
+            text[i] = i * 5 + 1;
+        xts.encrypt_sectors(1000, unit, text, enc);
+        for (std::size_t s = 0; s < count; s++) {
+            xts128::tweak_array t{};
+            const std::uint64_t n = 1000 + s;
+            std::memcpy(t.data(), &n, 8);
+            std::vector<std::uint8_t> one(unit);
+            xts.encrypt(t, std::span(text).subspan(s * unit, unit), one);
+            runtime_assert(std::equal(one.begin(), one.end(), enc.begin() + s * unit));
+        }
+        xts.decrypt_sectors(1000, unit, enc, enc);
+        runtime_assert(enc == text);
+    }
+
+    bool thrown = false;
+    try {
+        std::array<std::uint8_t, 15> short_unit{};
+        xts.encrypt(tweak, short_unit, short_unit);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    runtime_assert(thrown);
+}
+
+int main()
+{
+    test_xts128_x86();
+    test_xts256_x86();
+    test_xts_long_x86();
+}
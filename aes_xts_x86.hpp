@@ -0,0 +1,201 @@
+#pragma once
+// The MIT License
+// Copyright 2023 funanz <granz.fisherman@gmail.com>
+// https://opensource.org/licenses/MIT
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <immintrin.h>
+#include "aes_x86.hpp"
+
+namespace cheap_aes::x86
+{
+    // XTS-AES (IEEE 1619). The key is Key1 (data) followed by Key2 (tweak).
+    // A data unit is at least one block. A partial last block is handled
+    // with ciphertext stealing.
+    template <class AES>
+    class xts_base
+    {
+    public:
+        static constexpr int key_size() { return 2 * AES::key_size(); };
+        static constexpr int block_size() { return 16; };
+        using key_array = std::array<std::uint8_t, key_size()>;
+        using tweak_array = std::array<std::uint8_t, 16>;
+
+    private:
+        AES data_aes;
+        AES tweak_aes;
+
+    public:
+        xts_base() {}
+
+        explicit xts_base(const std::uint8_t key[2*AES::key_size()]) {
+            set(key);
+        }
+
+        explicit xts_base(const key_array& key) {
+            set(&key[0]);
+        }
+
+        void set(const std::uint8_t key[2*AES::key_size()]) {
+            data_aes.set(key);
+            tweak_aes.set(key + AES::key_size());
+        }
+
+        void set(const key_array& key) {
+            set(&key[0]);
+        }
+
+        // one data unit of len bytes, tweak is the 128-bit value i (before encryption by Key2)
+        void encrypt(const std::uint8_t tweak[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            check_unit(len);
+            typename stats_t<AES>::call scope(len);
+            crypt<false>(tweak_aes.encrypt_si128(_mm_loadu_si128((const __m128i*)tweak)), in, out, len);
+        }
+
+        void decrypt(const std::uint8_t tweak[16], const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            check_unit(len);
+            typename stats_t<AES>::call scope(len);
+            crypt<true>(tweak_aes.encrypt_si128(_mm_loadu_si128((const __m128i*)tweak)), in, out, len);
+        }
+
+        void encrypt(const tweak_array& tweak, std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check(in, out);
+            encrypt(&tweak[0], in.data(), out.data(), in.size());
+        }
+
+        void decrypt(const tweak_array& tweak, std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check(in, out);
+            decrypt(&tweak[0], in.data(), out.data(), in.size());
+        }
+
+        // len / unit_size consecutive data units numbered from sector on,
+        // each with its number as a little-endian 128-bit tweak
+        void encrypt_sectors(std::uint64_t sector, std::size_t unit_size,
+                             const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            crypt_sectors<false>(sector, unit_size, in, out, len);
+        }
+
+        void decrypt_sectors(std::uint64_t sector, std::size_t unit_size,
+                             const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            crypt_sectors<true>(sector, unit_size, in, out, len);
+        }
+
+        void encrypt_sectors(std::uint64_t sector, std::size_t unit_size,
+                             std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check(in, out);
+            crypt_sectors<false>(sector, unit_size, in.data(), out.data(), in.size());
+        }
+
+        void decrypt_sectors(std::uint64_t sector, std::size_t unit_size,
+                             std::span<const std::uint8_t> in, std::span<std::uint8_t> out) const {
+            check(in, out);
+            crypt_sectors<true>(sector, unit_size, in.data(), out.data(), in.size());
+        }
+
+    private:
+        template <bool Decrypt>
+        void crypt_sectors(std::uint64_t sector, std::size_t unit_size,
+                           const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            check_unit(unit_size);
+            if (len % unit_size != 0)
+                throw std::invalid_argument("cheap_aes: input is not a multiple of the data unit size");
+            typename stats_t<AES>::call scope(len);
+
+            // the initial tweaks of 8 sectors in one pass of Key2
+            for (auto n = len / unit_size; n > 0;) {
+                const auto m = std::min<std::size_t>(n, 8);
+                __m128i t[8];
+                for (int j = 0; j < 8; j++)
+                    t[j] = _mm_set_epi64x(0, sector + j);
+                tweak_aes.encrypt_si128(t);
+                for (std::size_t j = 0; j < m; j++, in += unit_size, out += unit_size)
+                    crypt<Decrypt>(t[j], in, out, unit_size);
+                sector += m;
+                n -= m;
+            }
+        }
+
+        template <bool Decrypt>
+        void crypt(__m128i t, const std::uint8_t* in, std::uint8_t* out, std::size_t len) const {
+            // with a partial block, the last whole one is left for ciphertext stealing
+            const auto tail = len % 16;
+            auto n = len / 16 - (tail ? 1 : 0);
+
+            for (; n >= 8; n -= 8, in += 8*16, out += 8*16) {
+                __m128i tw[8], x[8];
+                next_tweaks(t, tw);
+                for (int j = 0; j < 8; j++)
+                    x[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in + j), tw[j]);
+                if (Decrypt)
+                    data_aes.decrypt_si128(x);
+                else
+                    data_aes.encrypt_si128(x);
+                for (int j = 0; j < 8; j++)
+                    _mm_storeu_si128((__m128i*)out + j, _mm_xor_si128(x[j], tw[j]));
+            }
+            for (; n > 0; n--, in += 16, out += 16) {
+                _mm_storeu_si128((__m128i*)out, crypt_block<Decrypt>(_mm_loadu_si128((const __m128i*)in), t));
+                t = mul_alpha<1>(t);
+            }
+
+            if (tail) {
+                // decryption undoes the last two blocks in the opposite tweak order
+                const auto t2 = mul_alpha<1>(t);
+                std::uint8_t b[16], last[16];
+                _mm_storeu_si128((__m128i*)b, crypt_block<Decrypt>(_mm_loadu_si128((const __m128i*)in), Decrypt ? t2 : t));
+                std::memcpy(last, b, 16);
+                std::memcpy(last, in + 16, tail);
+                std::memcpy(out + 16, b, tail);
+                _mm_storeu_si128((__m128i*)out, crypt_block<Decrypt>(_mm_loadu_si128((const __m128i*)last), Decrypt ? t : t2));
+            }
+        }
+
+        template <bool Decrypt>
+        __m128i crypt_block(__m128i x, __m128i t) const {
+            x = _mm_xor_si128(x, t);
+            x = Decrypt ? data_aes.decrypt_si128(x) : data_aes.encrypt_si128(x);
+            return _mm_xor_si128(x, t);
+        }
+
+        // t alpha^K in GF(2^128) for 0 < K < 64: the K bits shifted out of the
+        // top come back in through x^7 + x^2 + x + 1, one carry-less multiply
+        template <int K>
+        static inline __m128i mul_alpha(__m128i t) {
+            const auto carry = _mm_srli_epi64(t, 64 - K);
+            const auto x = _mm_or_si128(_mm_slli_epi64(t, K), _mm_slli_si128(carry, 8));
+            const auto r = _mm_clmulepi64_si128(_mm_srli_si128(carry, 8), _mm_cvtsi32_si128(0x87), 0x00);
+            return _mm_xor_si128(x, r);
+        }
+
+        // the tweaks of the next 8 blocks, each straight from t with no serial chain
+        static inline void next_tweaks(__m128i& t, __m128i (&tw)[8]) {
+            tw[0] = t;
+            tw[1] = mul_alpha<1>(t);
+            tw[2] = mul_alpha<2>(t);
+            tw[3] = mul_alpha<3>(t);
+            tw[4] = mul_alpha<4>(t);
+            tw[5] = mul_alpha<5>(t);
+            tw[6] = mul_alpha<6>(t);
+            tw[7] = mul_alpha<7>(t);
+            t = mul_alpha<8>(t);
+        }
+
+        static void check_unit(std::size_t len) {
+            if (len < 16)
+                throw std::invalid_argument("cheap_aes: XTS data unit is shorter than a block");
+        }
+
+        static void check(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) {
+            if (out.size() < in.size())
+                throw std::invalid_argument("cheap_aes: output is shorter than input");
+        }
+    };
+
+    using xts128 = xts_base<aes128>;
+    using xts256 = xts_base<aes256>;
+}